@@ -2,15 +2,19 @@
 #include <iostream>
 #include <vector>
 #include <random>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
-#include "data_loader.cpp"
+#include "../Common/datasets.cpp"
+#include "../Common/client_options.cpp"
+#include "../Common/wire_protocol.cpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
 const int NUM_EPOCHS = 5;
 const int LEARNERS_PER_EPOCH = 2;
+const int MAX_ROWS = 1000;  // Rows of the Santander file used for training
 
 struct WeakLearner {
     int feature_index;
@@ -18,7 +22,7 @@ struct WeakLearner {
     double alpha;
 };
 
-WeakLearner train_weak_learner(const MatrixXd& data, const VectorXd& labels, const VectorXd& weights) {
+WeakLearner train_weak_learner(const FeaturesRef<double>& data, const LabelsRef<double>& labels, const VectorXd& weights) {
     int n_samples = data.rows();
     int n_features = data.cols();
     WeakLearner best_learner = {0, 0, 0};
@@ -40,7 +44,7 @@ WeakLearner train_weak_learner(const MatrixXd& data, const VectorXd& labels, con
     return best_learner;
 }
 
-std::vector<WeakLearner> train_adaboost(const MatrixXd& data, const VectorXd& labels, int num_learners) {
+std::vector<WeakLearner> train_adaboost(const FeaturesRef<double>& data, const LabelsRef<double>& labels, int num_learners) {
     std::vector<WeakLearner> learners;
     VectorXd weights = VectorXd::Ones(data.rows()) / data.rows();
 
@@ -55,68 +59,40 @@ std::vector<WeakLearner> train_adaboost(const MatrixXd& data, const VectorXd& la
     return learners;
 }
 
-std::vector<double> serialize_learners(const std::vector<WeakLearner>& learners) {
-    std::vector<double> serialized;
-    for (const auto& learner : learners) {
-        serialized.push_back(learner.feature_index);
-        serialized.push_back(learner.threshold);
-        serialized.push_back(learner.alpha);
-    }
-    return serialized;
-}
-
-std::vector<WeakLearner> deserialize_learners(const std::vector<double>& serialized) {
-    std::vector<WeakLearner> learners;
-    for (size_t i = 0; i + 2 < serialized.size(); i += 3) {
-        WeakLearner learner;
-        learner.feature_index = static_cast<int>(serialized[i]);
-        learner.threshold = serialized[i + 1];
-        learner.alpha = serialized[i + 2];
-        learners.push_back(learner);
-    }
-    return learners;
+// The wire layout, with float thresholds that split the data as the doubles did
+std::vector<StumpRecord> pack_learners(const std::vector<WeakLearner>& learners) {
+    std::vector<StumpRecord> records;
+    for (const auto& learner : learners)
+        records.push_back({learner.feature_index, record_threshold(learner.threshold), static_cast<float>(learner.alpha)});
+    return records;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        ClientOptions options = parse_client_options(argc, argv);
+        reject_unsupported(options, OPTION_SHARD, "Adaboost");
         boost::asio::io_context io_context;
-        tcp::socket socket(io_context);
-        socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
-
-        std::vector<std::vector<float>> features;
-        std::vector<int> labels;
-        load_data("../Datasets/santander-customer-transaction-prediction.csv", features, labels);
+        FramedSocket socket = connect_to_server(io_context, options);
+
+        // Column-major: the weak learner scans data.col(feature_index). The cache
+        // itself when it holds doubles (convert_dataset --float64).
+        MappedDataset<double> dataset;
+        DatasetSchema schema = shard_of(santander_schema(), options);
+        schema.max_rows = MAX_ROWS;
+        load_data("../Datasets/santander-customer-transaction-prediction.csv", schema, dataset);
         std::cout<<"Data Read Succesfully"<<std::endl;
-        MatrixXd data(features.size(), features[0].size());
-        VectorXd label_vec(labels.size());
-        for (size_t i = 0; i < features.size(); ++i) {
-            for (size_t j = 0; j < features[i].size(); ++j) {
-                data(i, j) = features[i][j];
-            }
-            label_vec(i) = labels[i];
-        }
 
         for (int epoch = 0; epoch < NUM_EPOCHS; ++epoch) {
             std::cout << "[INFO] Epoch " << epoch + 1 << " begins...\n";
-            std::vector<WeakLearner> learners = train_adaboost(data, label_vec, LEARNERS_PER_EPOCH);
-            std::vector<double> serialized = serialize_learners(learners);
-
+            std::vector<WeakLearner> learners = train_adaboost(dataset.features(), dataset.labels(), LEARNERS_PER_EPOCH);
             int num_learners = learners.size();
-            int vec_size = serialized.size();
-
-            boost::asio::write(socket, boost::asio::buffer(&num_learners, sizeof(int)));
-            boost::asio::write(socket, boost::asio::buffer(&vec_size, sizeof(int)));
-            boost::asio::write(socket, boost::asio::buffer(serialized.data(), vec_size * sizeof(double)));
+            send_message(socket, MSG_UPDATE, MODEL_ADABOOST, num_learners, pack_learners(learners));
 
             std::cout << "[INFO] Sent " << num_learners << " learners to server in epoch " << epoch + 1 << ".\n";
 
             // Receive global model from server
-            int global_vec_size = 0;
-            boost::asio::read(socket, boost::asio::buffer(&global_vec_size, sizeof(int)));
-            std::vector<double> global_serialized(global_vec_size);
-            boost::asio::read(socket, boost::asio::buffer(global_serialized.data(), global_vec_size * sizeof(double)));
-
-            std::vector<WeakLearner> global_model = deserialize_learners(global_serialized);
+            std::vector<StumpRecord> global_model;
+            receive_message(socket, MSG_MODEL, MODEL_ADABOOST, global_model);
             std::cout << "[INFO] Received global model with " << global_model.size() << " weak learners.\n";
         }
 
@@ -0,0 +1,73 @@
+// Heap allocation counts for the server hot path. Built with -DFED_COUNT_ALLOCS,
+// malloc/calloc/realloc (and so operator new and Eigen's allocations) are
+// counted per thread, and each connection reports its allocations per message
+// when it closes. Without the flag the scopes and reports compile to nothing.
+// g++ ... server.cpp -DFED_COUNT_ALLOCS    (glibc only: wraps __libc_malloc)
+#pragma once
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef FED_COUNT_ALLOCS
+inline thread_local uint64_t thread_allocations = 0;
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    ++thread_allocations;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    ++thread_allocations;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    ++thread_allocations;
+    return __libc_realloc(ptr, size);
+}
+}
+#endif
+
+// Allocations of one connection: the first message (which sizes the buffers)
+// and the sum over the rest
+struct AllocationStats {
+    uint64_t current = 0;
+    uint64_t first = 0;
+    uint64_t steady = 0;
+    uint64_t messages = 0;
+
+    void end_message() {
+        if (messages++ == 0) first = current;
+        else steady += current;
+        current = 0;
+    }
+
+    void report() const {
+#ifdef FED_COUNT_ALLOCS
+        if (messages == 0) return;
+        std::cout << "[INFO] Allocations: " << first << " in the first message, ";
+        if (messages > 1) std::cout << static_cast<double>(steady) / (messages - 1) << " per message after that";
+        std::cout << " (" << messages << " messages)" << std::endl;
+#endif
+    }
+};
+
+// Adds the allocations made on this thread while it is alive to stats.current
+class AllocationScope {
+public:
+#ifdef FED_COUNT_ALLOCS
+    explicit AllocationScope(AllocationStats& stats) : stats_(stats), start_(thread_allocations) {}
+    ~AllocationScope() { stats_.current += thread_allocations - start_; }
+
+private:
+    AllocationStats& stats_;
+    uint64_t start_;
+#else
+    explicit AllocationScope(AllocationStats&) {}
+#endif
+};
@@ -0,0 +1,326 @@
+// Asynchronous framed server shared by every algorithm: one io_context run by
+// a fixed pool of worker threads, each connection a coroutine looping over
+// read-header / read-payload / handle / write-reply on its own strand; only a
+// subscribed connection also runs a push coroutine there. Needs C++20
+// (g++ -std=c++20) for the coroutines.
+// Quantized and sparse updates are decoded before the handler sees them.
+// Clients that set FLAG_ACCEPTS_DELTA get back only the model coordinates
+// changed since their previous reply, when that is smaller than the model.
+// The server listens on TCP and, with --socket, on an AF_UNIX socket; with
+// --shm it hands local clients that ask for it the model in shared memory.
+// Memory per idle client is one socket plus its payload buffer, not a thread.
+// A connection may carry many logical clients (MessageHeader::client_id); each
+// gets its own round count and delta base, and replies follow request order.
+// A connection that subscribes (FLAG_SUBSCRIBE) gets no replies; every new
+// model is pushed to it instead, coalesced while a previous push is in flight.
+// Every later message on it must be a subscribed update, or it is closed.
+// A client that opens with MSG_HELLO gets its codec if this build has it; its
+// compressed updates are inflated before decoding, and large replies and
+// pushes to it go out compressed at the client's level or --compression-level.
+// Buffers are sized by the first message and reused, so a steady stream of
+// same-shaped updates does not allocate (count with -DFED_COUNT_ALLOCS); once
+// a client subscribes, each update's payload is swapped into a pooled snapshot
+// that becomes the published model.
+// What a message means is SessionProtocol's business (server_protocol.cpp);
+// this file only moves its bytes. --backend uring serves the same protocol
+// from io_uring instead (uring_server.cpp).
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <csignal>
+#include <unistd.h>
+#include <boost/asio.hpp>
+#include "awaitable_protocol.cpp"
+#include "server_protocol.cpp"
+#include "uring_server.cpp"
+#include "alloc_stats.cpp"
+
+// Streams the first n coefficients of v, space-separated. Eigen's operator<<
+// would evaluate a temporary for an expression such as v.head(10).transpose().
+template <typename Derived>
+struct HeadOf {
+    const Derived& values;
+    Eigen::Index n;
+};
+
+template <typename Derived>
+HeadOf<Derived> head_of(const Eigen::DenseBase<Derived>& values, Eigen::Index n = 10) {
+    return {values.derived(), std::min(n, values.size())};
+}
+
+template <typename Derived>
+std::ostream& operator<<(std::ostream& out, const HeadOf<Derived>& head) {
+    for (Eigen::Index i = 0; i < head.n; ++i) out << (i ? " " : "") << head.values(i);
+    return out;
+}
+
+using FramedAcceptor = boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol>;
+
+template <typename Payload>
+class FramedSession : public std::enable_shared_from_this<FramedSession<Payload>> {
+public:
+    using T = typename Payload::value_type;
+    using Reply = typename SessionProtocol<Payload>::Reply;
+
+    FramedSession(FramedSocket socket, ServerContext<Payload>& context)
+        : socket_(std::move(socket)), strand_(boost::asio::make_strand(socket_.get_executor())),
+          wake_(strand_, boost::asio::steady_timer::time_point::max()), context_(context),
+          protocol_(context, socket_.compression) {}
+
+    ~FramedSession() {
+        socket_.compression.sent += protocol_.reply.compressed_stats;
+        socket_.compression.sent += push_.compressed_stats;
+        allocations_.report();
+    }
+
+    void start() {
+        set_no_delay(socket_);
+        boost::asio::co_spawn(strand_, serve(this->shared_from_this()), boost::asio::detached);
+    }
+
+    // Called under context_.push_mutex after `latest`, or this connection's
+    // applied count, changes. A push already being written is followed by one
+    // more with whatever is newest by then.
+    void push_latest() {
+        if (closed_ || push_pending_) return;
+        push_pending_ = true;
+        boost::asio::post(strand_, [self = this->shared_from_this()]() { self->wake_.cancel(); });
+    }
+
+private:
+    // Header, body, handler, reply, until the client hangs up or every client
+    // on the connection is done; dropping `self` then closes the socket
+    awaitable<void> serve([[maybe_unused]] std::shared_ptr<FramedSession> self) {
+        try {
+            while (!protocol_.finished()) {
+                boost::system::error_code ec;
+                co_await boost::asio::async_read(socket_, boost::asio::buffer(&protocol_.header, sizeof(protocol_.header)),
+                                                 boost::asio::redirect_error(use_awaitable, ec));
+                if (ec == boost::asio::error::eof) {
+                    size_t clients = protocol_.logical_clients();
+                    std::cout << "[DEBUG] Client disconnected";
+                    if (clients > 1) std::cout << " (" << clients << " logical clients)";
+                    std::cout << "." << std::endl;
+                    break;
+                }
+                if (ec) throw boost::system::system_error(ec);
+                boost::asio::mutable_buffer body;
+                {
+                    AllocationScope scope(allocations_);
+                    body = protocol_.accept_header();
+                }
+                // Its reply would be written here while push() may be writing too
+                if (subscribed_ && (protocol_.is_hello() || !(protocol_.header.flags & FLAG_SUBSCRIBE)))
+                    throw std::runtime_error("message without FLAG_SUBSCRIBE on a subscribed connection");
+                co_await boost::asio::async_read(socket_, body, use_awaitable);
+                if (protocol_.is_hello()) {
+                    co_await boost::asio::async_write(socket_, protocol_.answer_hello(), use_awaitable);
+                    continue;
+                }
+
+                // Compressed updates are inflated and quantized and sparse ones decoded first
+                bool subscribe = protocol_.header.flags & FLAG_SUBSCRIBE;
+                std::array<boost::asio::const_buffer, 3> reply;
+                {
+                    AllocationScope scope(allocations_);  // Covers the handler and the reply
+                    protocol_.finish_update();
+                    int count = handle_update(subscribe);
+                    protocol_.count_round();
+                    if (!subscribe)
+                        reply = reply_model_ ? protocol_.reply_with(*reply_model_, count) : protocol_.reply_to_update(count);
+                }
+                if (!subscribe) co_await boost::asio::async_write(socket_, reply, use_awaitable);  // Else it goes out as a push
+                reply_model_.reset();
+                allocations_.end_message();
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "[ERROR] Exception in handle_client: " << e.what() << std::endl;
+        }
+        close_subscription();
+    }
+
+    // The handler runs outside push_mutex, so updates from every connection are
+    // handled concurrently. With subscribers, its model is swapped into a pooled
+    // snapshot and only publishing that holds the lock. Two models handled at
+    // once may reach it in either order; their stamps keep the newer one.
+    int handle_update(bool subscribe) {
+        ModelStamp stamp(context_.model_clock);
+        int count = context_.handler(protocol_.header, protocol_.payload, stamp);
+        if (!subscribe && !context_.any_subscribers.load(std::memory_order_acquire)) return count;
+        if (stamp.version() == 0) throw std::logic_error("the update handler did not stamp its model");
+        auto snapshot = context_.snapshots.take(protocol_.payload);
+        if (!subscribe) reply_model_ = snapshot;  // The reply is built from it too
+        std::lock_guard<std::mutex> lock(context_.push_mutex);
+        if (subscribe) subscribe_locked();
+        publish_locked(std::move(snapshot), stamp.version(), count, subscribe);
+        return count;
+    }
+
+    // The first subscribed update registers the connection; pushes then use its encoding and flags
+    void subscribe_locked() {
+        if (subscribed_) return;
+        subscribed_ = true;
+        push_encoding_ = protocol_.reply_encoding();
+        push_flags_ = protocol_.header.flags;
+        context_.subscribers.push_back(this->shared_from_this());
+        context_.any_subscribers.store(true, std::memory_order_release);
+        boost::asio::co_spawn(strand_, push(this->shared_from_this()), boost::asio::detached);
+    }
+
+    // Makes snapshot, stamped version, the newest model and wakes every
+    // subscriber. A snapshot older than `latest` is dropped: `latest` already
+    // holds its update, so only this connection's applied count has changed.
+    void publish_locked(std::shared_ptr<const Payload> snapshot, uint64_t version, int count, bool subscribe) {
+        if (subscribe) applied_++;
+        if (version <= context_.latest_version) {
+            if (subscribe) push_latest();
+            return;
+        }
+        context_.latest = std::move(snapshot);
+        context_.latest_count = count;
+        context_.latest_version = version;
+
+        auto& subscribers = context_.subscribers;
+        for (size_t i = 0; i < subscribers.size();) {
+            if (auto subscriber = subscribers[i].lock()) {
+                subscriber->push_latest();
+                ++i;
+            } else {
+                subscribers[i] = std::move(subscribers.back());
+                subscribers.pop_back();
+            }
+        }
+    }
+
+    // A subscribed connection's pushes: whenever woken, writes the newest
+    // model, again while newer ones arrived during the write. Only taking the
+    // snapshot holds push_mutex; `self` keeps the session alive. The applied
+    // count goes with the model taken under it, which holds all those updates.
+    // A model is pushed again when only that count has grown.
+    awaitable<void> push([[maybe_unused]] std::shared_ptr<FramedSession> self) {
+        for (;;) {
+            boost::system::error_code ec;
+            co_await wake_.async_wait(boost::asio::redirect_error(use_awaitable, ec));  // Cancelled to wake
+            for (;;) {
+                int count;
+                uint32_t applied;
+                {
+                    std::lock_guard<std::mutex> lock(context_.push_mutex);
+                    if (closed_) co_return;
+                    push_pending_ = false;
+                    if (pushed_version_ == context_.latest_version && pushed_applied_ == applied_) break;
+                    pushed_version_ = context_.latest_version;
+                    pushed_applied_ = applied_;
+                    push_model_ = context_.latest;
+                    count = context_.latest_count;
+                    applied = applied_;
+                }
+                auto buffers = protocol_.build_reply(*push_model_, count, push_encoding_, push_flags_, 0, push_client_, push_);
+                push_.header.applied = applied;
+                co_await boost::asio::async_write(socket_, buffers, boost::asio::redirect_error(use_awaitable, ec));
+                if (ec) {
+                    std::lock_guard<std::mutex> lock(context_.push_mutex);
+                    if (!closed_) std::cerr << "[ERROR] Push failed: " << ec.message() << std::endl;
+                    closed_ = true;
+                    co_return;
+                }
+            }
+        }
+    }
+
+    // The client has stopped sending; finish the push in flight, if any, and stop
+    void close_subscription() {
+        if (!subscribed_) return;
+        std::lock_guard<std::mutex> lock(context_.push_mutex);
+        closed_ = true;
+        wake_.cancel();  // On the strand, as serve() runs there
+    }
+
+    FramedSocket socket_;
+    // Runs serve() and push(), so neither needs a lock to start I/O on the socket
+    boost::asio::strand<boost::asio::any_io_executor> strand_;
+    boost::asio::steady_timer wake_;  // Never expires; push() waits on it
+    ServerContext<Payload>& context_;
+    SessionProtocol<Payload> protocol_;
+    AllocationStats allocations_;   // Reported on close with -DFED_COUNT_ALLOCS
+
+    std::shared_ptr<const Payload> reply_model_;  // Published model the reply in flight points into
+
+    // Subscription; closed_, push_pending_, pushed_version_, pushed_applied_
+    // and applied_ are guarded by context_.push_mutex, the rest belong to
+    // serve() or push()
+    bool subscribed_ = false;
+    bool closed_ = false;
+    bool push_pending_ = false;    // A wake is posted and push() has not yet looked
+    uint64_t pushed_version_ = 0;  // context_.latest_version of the last push
+    uint32_t pushed_applied_ = 0;  // applied_ sent with the last push
+    uint32_t applied_ = 0;         // Subscribed updates handled, all held by context_.latest
+    WireDtype push_encoding_ = wire_dtype<T>();
+    uint8_t push_flags_ = 0;
+    LogicalClient push_client_;  // Delta base of the pushes
+    std::shared_ptr<const Payload> push_model_;  // Snapshot the push in flight points into
+    Reply push_;
+};
+
+// Accepts until the acceptor is closed
+template <typename Payload>
+awaitable<void> accept_clients(FramedAcceptor& acceptor, ServerContext<Payload>& context) {
+    for (;;) {
+        boost::system::error_code ec;
+        auto socket = co_await acceptor.async_accept(boost::asio::redirect_error(use_awaitable, ec));
+        if (ec == boost::asio::error::operation_aborted) co_return;  // Shutting down
+        if (ec) {
+            std::cerr << "[ERROR] Accept failed: " << ec.message() << std::endl;
+            continue;
+        }
+        std::cout << "[DEBUG] New client connected." << std::endl;
+        std::make_shared<FramedSession<Payload>>(FramedSocket(std::move(socket)), context)->start();
+    }
+}
+
+// Serves handler until SIGINT/SIGTERM, then stops accepting, lets the workers
+// return and joins them. max_rounds > 0 allows each logical client that many
+// updates and closes a connection once all of its clients have had them.
+template <typename Payload>
+void run_framed_server(const ServerOptions& options, ModelId model_id, const UpdateHandler<Payload>& handler,
+                       int max_rounds = 0) {
+    if (options.backend == "uring") return run_uring_server(options, model_id, handler, max_rounds);
+    boost::asio::io_context io_context(options.workers);
+    std::vector<std::unique_ptr<FramedAcceptor>> acceptors;
+    acceptors.push_back(std::make_unique<FramedAcceptor>(io_context,
+        FramedAcceptor::endpoint_type(boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), options.port))));
+    if (!options.socket_path.empty()) {
+        ::unlink(options.socket_path.c_str());  // Left over from a server that did not exit cleanly
+        acceptors.push_back(std::make_unique<FramedAcceptor>(io_context,
+            FramedAcceptor::endpoint_type(boost::asio::local::stream_protocol::endpoint(options.socket_path))));
+    }
+
+    boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
+    signals.async_wait([&](const boost::system::error_code&, int signal_number) {
+        std::cout << "[INFO] Signal " << signal_number << " received, shutting down." << std::endl;
+        for (auto& acceptor : acceptors) acceptor->close();
+        io_context.stop();
+    });
+
+    ServerContext<Payload> context(model_id, handler, max_rounds, options);
+    for (auto& acceptor : acceptors)
+        boost::asio::co_spawn(io_context, accept_clients(*acceptor, context), boost::asio::detached);
+    std::cout << "[DEBUG] Server started on port " << options.port;
+    if (!options.socket_path.empty()) std::cout << " and " << options.socket_path;
+    if (!options.shm_name.empty()) std::cout << ", shared model ring " << options.shm_name;
+    if (options.compression_level) std::cout << ", compression level " << options.compression_level;
+    std::cout << " with " << options.workers << " worker threads." << std::endl;
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < options.workers; ++i) workers.emplace_back([&io_context]() { io_context.run(); });
+    for (auto& worker : workers) worker.join();
+    if (!options.socket_path.empty()) ::unlink(options.socket_path.c_str());
+}
@@ -0,0 +1,82 @@
+// Coroutine forms of send_message and receive_message, for clients that keep
+// many connections or rounds in flight on one thread: co_await them from a
+// boost::asio::awaitable started with co_spawn. The blocking calls encode,
+// compress and receive through per-thread buffers; a coroutine may be
+// suspended mid-message while another on its thread sends, so each connection
+// brings its own MessageBuffers here. Needs C++20 (g++ -std=c++20).
+#pragma once
+#include <vector>
+#include <array>
+#include <utility>  // Boost 1.74's awaitable.hpp uses std::exchange without it
+#include <boost/asio.hpp>
+#if !defined(BOOST_ASIO_HAS_CO_AWAIT)
+#error "awaitable_protocol.cpp needs C++20 coroutines (-std=c++20)"
+#endif
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include "wire_protocol.cpp"
+
+using boost::asio::awaitable;
+using boost::asio::use_awaitable;
+
+// One connection's scratch space for the messages it has in flight
+struct MessageBuffers {
+    std::vector<uint8_t> encoded;     // Quantized update
+    std::vector<uint8_t> compressed;  // Compressed update
+    ReceiveBuffers received;
+};
+
+template <typename T>
+awaitable<void> async_send_message(FramedSocket& socket, MessageBuffers& buffers, MessageType type, ModelId model_id,
+                                   int count, const T* data, Eigen::Index rows, Eigen::Index cols,
+                                   WireDtype encoding = wire_dtype<T>(), uint8_t flags = 0, uint32_t client_id = 0) {
+    MessageHeader header = make_header<T>(type, model_id, count, rows, cols, encoding, flags, client_id);
+    std::array<boost::asio::const_buffer, 1> payload = {
+        encode_message(header, data, static_cast<size_t>(rows) * cols, buffers.encoded)};
+    co_await boost::asio::async_write(socket, frame_message(socket, header, payload, buffers.compressed),
+                                      use_awaitable);
+}
+
+template <typename Derived>
+awaitable<void> async_send_message(FramedSocket& socket, MessageBuffers& buffers, MessageType type, ModelId model_id,
+                                   int count, const Eigen::PlainObjectBase<Derived>& payload,
+                                   WireDtype encoding = wire_dtype<typename Derived::Scalar>(), uint8_t flags = 0,
+                                   uint32_t client_id = 0) {
+    return async_send_message(socket, buffers, type, model_id, count, payload.data(), payload.rows(), payload.cols(),
+                              encoding, flags, client_id);
+}
+
+// Reads and checks a header; false when the peer closed the connection cleanly instead
+inline awaitable<bool> async_receive_header(FramedSocket& socket, MessageType type, ModelId model_id, WireDtype dtype,
+                                            MessageHeader& header) {
+    boost::system::error_code ec;
+    co_await boost::asio::async_read(socket, boost::asio::buffer(&header, sizeof(header)),
+                                     boost::asio::redirect_error(use_awaitable, ec));
+    if (ec == boost::asio::error::eof) co_return false;
+    if (ec) throw boost::system::system_error(ec);
+    check_header(header, type, model_id, dtype);
+    co_return true;
+}
+
+// As receive_message
+template <typename Payload>
+awaitable<bool> async_receive_message(FramedSocket& socket, MessageBuffers& buffers, MessageType type,
+                                      ModelId model_id, Payload& payload, MessageHeader* header = nullptr) {
+    using T = typename Payload::value_type;
+    MessageHeader received;
+    if (!co_await async_receive_header(socket, type, model_id, wire_dtype<T>(), received)) co_return false;
+    co_await boost::asio::async_read(socket, payload_buffer(socket, received, payload, buffers.received),
+                                     use_awaitable);
+    finish_payload(socket, received, payload, buffers.received);
+    if (header) *header = received;
+    co_return true;
+}
+
+// Rethrows what a coroutine started with co_spawn ended with, so a failed
+// connection surfaces where io_context.run() was called
+inline void rethrow_if_failed(std::exception_ptr error) {
+    if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,142 @@
+// Gradient aggregation benchmark: update throughput of the gradient-descent
+// servers' apply_gradient_update over a long run, with every batch size kept
+// in a vector summed per update (as before) against GradientAggregator's
+// running totals and per-thread shards, for 1 to N server threads.
+// Throughput is reported for the first and last window of updates; the
+// one-thread models of the two are checked to match.
+// g++ -O2 -std=c++17 bench_aggregator.cpp -o bench_aggregator -I /usr/include/eigen3 -lpthread
+// ./bench_aggregator [updates] [features] [vector_updates] [max_threads]
+//     (defaults: 1000000 updates, 30 features, one thread per core; the vector
+//      version stops at 100000 updates, as it slows quadratically)
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <numeric>
+#include <algorithm>
+#include <Eigen/Dense>
+#include "scalar.cpp"
+#include "gradient_aggregator.cpp"
+
+using namespace Eigen;
+using Clock = std::chrono::steady_clock;
+
+const int BATCH_SIZE = 32;
+const int WINDOWS = 10;  // Throughput is timed over updates / WINDOWS at a time
+
+// Logistic Regression's update before GradientAggregator
+struct VectorAggregation {
+    std::mutex model_mutex;
+    VectorXa global_weights;
+    VectorXa total_gradients;
+    VectorXs wire_weights;
+    std::vector<int> client_data_sizes;
+
+    void update(const VectorXs& batch_gradient, int batch_size, VectorXs& reply) {
+        std::lock_guard<std::mutex> lock(model_mutex);
+        if (global_weights.size() == 0) {
+            total_gradients = VectorXa::Zero(batch_gradient.size());
+            global_weights = VectorXa::Zero(batch_gradient.size());
+        }
+        total_gradients += batch_gradient.cast<Accumulator>() * batch_size;
+        client_data_sizes.push_back(batch_size);
+        int total_data_points = std::accumulate(client_data_sizes.begin(), client_data_sizes.end(), 0);
+        global_weights -= (total_gradients / total_data_points);
+        wire_weights = global_weights.cast<Scalar>();
+        total_gradients.setZero();
+        reply = wire_weights;
+    }
+};
+
+// And with it, as Logistic_Regression/server.cpp now does
+struct ShardedAggregation {
+    std::mutex model_mutex;
+    VectorXa global_weights;
+    VectorXa total_gradients;
+    VectorXs wire_weights;
+    GradientAggregator<Accumulator> aggregator;
+
+    void update(const VectorXs& batch_gradient, int batch_size, VectorXs& reply) {
+        aggregator.add_averaged(batch_gradient, batch_size);
+        std::lock_guard<std::mutex> lock(model_mutex);
+        if (aggregator.drain(total_gradients)) {
+            if (global_weights.size() == 0) global_weights = VectorXa::Zero(total_gradients.size());
+            global_weights -= total_gradients;
+            wire_weights = global_weights.cast<Scalar>();
+        }
+        reply = wire_weights;
+    }
+};
+
+struct Outcome {
+    double first_rate;  // Updates per second over the first window
+    double last_rate;   // And over the last
+    double rate;        // Over the whole run
+    VectorXa weights;
+};
+
+// threads workers share `updates` updates, each replying with the model as handle_update does
+template <typename Aggregation>
+Outcome run(int updates, int threads, const std::vector<VectorXs>& gradients) {
+    Aggregation aggregation;
+    std::atomic<int> next{0};
+    int window = std::max(1, updates / WINDOWS);
+    std::vector<Clock::time_point> marks(WINDOWS + 1);
+    auto start = Clock::now();
+    marks[0] = start;
+
+    auto worker = [&]() {
+        VectorXs reply;
+        for (int i; (i = next.fetch_add(1)) < updates;) {
+            aggregation.update(gradients[i % gradients.size()], BATCH_SIZE, reply);
+            if ((i + 1) % window == 0 && (i + 1) / window <= WINDOWS) marks[(i + 1) / window] = Clock::now();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) pool.emplace_back(worker);
+    for (auto& thread : pool) thread.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    auto rate = [&](int w) { return window / std::chrono::duration<double>(marks[w + 1] - marks[w]).count(); };
+    return {rate(0), rate(WINDOWS - 1), updates / seconds, aggregation.global_weights};
+}
+
+template <typename Aggregation>
+Outcome report(const char* name, int updates, int threads, const std::vector<VectorXs>& gradients) {
+    Outcome outcome = run<Aggregation>(updates, threads, gradients);
+    std::cout << name << ", " << threads << " thread(s), " << updates << " updates: " << outcome.rate
+              << " updates/s (first " << updates / WINDOWS << ": " << outcome.first_rate << ", last: "
+              << outcome.last_rate << ")" << std::endl;
+    return outcome;
+}
+
+int main(int argc, char* argv[]) {
+    int updates = argc > 1 ? std::stoi(argv[1]) : 1000000;
+    int features = argc > 2 ? std::stoi(argv[2]) : 30;
+    int vector_updates = argc > 3 ? std::stoi(argv[3]) : std::min(updates, 100000);
+    int max_threads = argc > 4 ? std::stoi(argv[4]) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::mt19937 gen(42);
+    std::normal_distribution<Scalar> normal(0, 1);
+    std::vector<VectorXs> gradients(64);
+    for (auto& gradient : gradients) gradient = VectorXs::NullaryExpr(features, [&]() { return normal(gen); });
+
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    Outcome vector_one = report<VectorAggregation>("vector", vector_updates, 1, gradients);
+    Outcome sharded_one = report<ShardedAggregation>("sharded", vector_updates, 1, gradients);
+    std::cout << "One-thread models " << (vector_one.weights.isApprox(sharded_one.weights) ? "match" : "DIFFER")
+              << " after " << vector_updates << " updates" << std::endl;
+
+    for (int threads : thread_counts) {
+        if (threads > 1) report<VectorAggregation>("vector", vector_updates, threads, gradients);
+        report<ShardedAggregation>("sharded", updates, threads, gradients);
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+// Payload compression benchmark: ratio and speed of each codec built in, on
+// the payloads the clients send, and what they make of one transfer over a
+// 10 Mbit/s, 100 Mbit/s and 1 Gbit/s link (compress + wire + decompress,
+// against the raw bytes on the wire).
+// g++ -O2 -std=c++17 bench_compression.cpp -o bench_compression -I /usr/include/eigen3 -DFED_HAVE_ZLIB -lz
+//     (add -DFED_HAVE_LZ4 -llz4 and -DFED_HAVE_ZSTD -lzstd for those codecs)
+// ./bench_compression [scale]      (default 1: 2000 trees/stumps, 75000 kernel weights, 2000 features)
+#include <iostream>
+#include <vector>
+#include <string>
+#include <array>
+#include <random>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <boost/asio.hpp>
+#include "wire_compression.cpp"
+#include "ensemble_records.cpp"
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchPayload {
+    std::string name;
+    std::vector<uint8_t> bytes;
+};
+
+template <typename T>
+void append(std::vector<uint8_t>& out, const std::vector<T>& values) {
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(values.data());
+    out.insert(out.end(), begin, begin + values.size() * sizeof(T));
+}
+
+// CSV values with four decimals, as in the datasets
+double csv_value(std::mt19937_64& gen) {
+    std::normal_distribution<double> d(10, 5);
+    return std::round(d(gen) * 1e4) / 1e4;
+}
+
+// What the clients put on the wire, shaped as they serialize it
+std::vector<BenchPayload> make_payloads(int scale) {
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<int> feature(0, 199);
+    std::uniform_int_distribution<int> label(0, 1);
+    std::vector<BenchPayload> payloads;
+
+    // RF: one TreeRecord per tree
+    std::vector<TreeRecord> forest;
+    for (int t = 0; t < 2000 * scale; ++t)
+        forest.push_back({feature(gen), static_cast<float>(csv_value(gen)), static_cast<uint8_t>(label(gen))});
+    payloads.push_back({"RF forest, " + std::to_string(2000 * scale) + " trees", {}});
+    append(payloads.back().bytes, forest);
+
+    // Adaboost: one StumpRecord per learner
+    std::vector<StumpRecord> stumps;
+    std::uniform_real_distribution<double> alpha(0.05, 1.5);
+    for (int s = 0; s < 2000 * scale; ++s)
+        stumps.push_back({feature(gen), record_threshold(csv_value(gen)), static_cast<float>(alpha(gen))});
+    payloads.push_back({"Adaboost ensemble, " + std::to_string(2000 * scale) + " stumps", {}});
+    append(payloads.back().bytes, stumps);
+
+    // KernelSVM: one dual weight per training sample, initialised uniform
+    std::vector<double> weights(75000 * scale);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    for (double& w : weights) w = uniform(gen);
+    payloads.push_back({"KernelSVM weights, " + std::to_string(weights.size()), {}});
+    append(payloads.back().bytes, weights);
+
+    // LR: a dense gradient, then its top 5% as sparse (index, value) pairs
+    std::vector<double> gradient(2000 * scale);
+    std::normal_distribution<double> normal(0, 0.01);
+    for (double& g : gradient) g = normal(gen);
+    payloads.push_back({"LR gradient, " + std::to_string(gradient.size()) + " features", {}});
+    append(payloads.back().bytes, gradient);
+
+    std::vector<uint32_t> indices(gradient.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    size_t k = gradient.size() / 20;
+    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(),
+                      [&](uint32_t a, uint32_t b) { return std::abs(gradient[a]) > std::abs(gradient[b]); });
+    indices.resize(k);
+    std::vector<double> values;
+    for (uint32_t i : indices) values.push_back(gradient[i]);
+    payloads.push_back({"LR top-k gradient, " + std::to_string(k) + " of " + std::to_string(gradient.size()), {}});
+    append(payloads.back().bytes, indices);
+    append(payloads.back().bytes, values);
+    return payloads;
+}
+
+// Runs f until a quarter second has passed; returns seconds per run
+template <typename F>
+double time_per_run(F f) {
+    int runs = 0;
+    auto start = Clock::now();
+    double seconds;
+    do {
+        f();
+        ++runs;
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < 0.25);
+    return seconds / runs;
+}
+
+int main(int argc, char* argv[]) {
+    int scale = argc > 1 ? std::stoi(argv[1]) : 1;
+    struct Setting {
+        WireCodec codec;
+        int level;
+    };
+    std::vector<Setting> settings;
+    for (Setting setting : {Setting{CODEC_LZ4, 1}, Setting{CODEC_LZ4, 9}, Setting{CODEC_ZSTD, 1},
+                            Setting{CODEC_ZSTD, 3}, Setting{CODEC_ZSTD, 9}, Setting{CODEC_DEFLATE, 1},
+                            Setting{CODEC_DEFLATE, 6}})
+        if (codec_available(setting.codec)) settings.push_back(setting);
+    if (settings.empty()) {
+        std::cerr << "No codec built in; add -DFED_HAVE_ZLIB -lz, -DFED_HAVE_LZ4 -llz4 or -DFED_HAVE_ZSTD -lzstd" << std::endl;
+        return 1;
+    }
+    const double links[] = {10e6, 100e6, 1e9};  // bits per second
+
+    for (const BenchPayload& payload : make_payloads(scale)) {
+        uint64_t raw = payload.bytes.size();
+        std::cout << payload.name << " (" << raw << " bytes); raw transfer";
+        for (double link : links) std::cout << " " << raw * 8 / link * 1e3;
+        std::cout << " ms at 10M/100M/1G" << std::endl;
+
+        std::array<boost::asio::const_buffer, 1> parts = {boost::asio::buffer(payload.bytes)};
+        std::vector<uint8_t> compressed, restored(raw);
+        for (const Setting& setting : settings) {
+            WireCompression compression;
+            compression.codec = setting.codec;
+            compression.level = setting.level;
+            CompressionStats stats;
+            bool smaller = false;
+            double compress_seconds = time_per_run([&]() {
+                smaller = compress_payload(compression, parts, raw, compressed, stats);
+            });
+            if (!smaller) {
+                std::cout << "  " << codec_name(setting.codec) << " " << setting.level
+                          << ": not smaller, sent raw after " << compress_seconds * 1e3 << " ms" << std::endl;
+                continue;
+            }
+            double decompress_seconds = time_per_run([&]() {
+                decompress_payload(compression, compressed, restored.data(), stats);
+            });
+            bool match = restored == payload.bytes;
+
+            std::cout << "  " << codec_name(setting.codec) << " " << setting.level << ": "
+                      << static_cast<double>(raw) / compressed.size() << "x, compress "
+                      << raw / compress_seconds / 1e6 << " MB/s, decompress " << raw / decompress_seconds / 1e6
+                      << " MB/s; transfer";
+            for (double link : links)
+                std::cout << " " << (compress_seconds + compressed.size() * 8 / link + decompress_seconds) * 1e3;
+            std::cout << " ms" << (match ? "" : " (ROUND TRIP DIFFERS)") << std::endl;
+        }
+    }
+    return 0;
+}
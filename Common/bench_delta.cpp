@@ -0,0 +1,127 @@
+// Delta model broadcast benchmark: downstream bytes per round when each reply
+// carries only the coordinates changed since that client's previous reply,
+// against the full model, as the number of clients grows (simulated in process).
+// Every client's model is rebuilt from its replies and checked against the server's.
+// g++ -O2 -std=c++17 bench_delta.cpp -o bench_delta -I /usr/include/eigen3 -lpthread
+// ./bench_delta [features] [rounds]      (defaults: 2000 features, 20000 rounds)
+// Add -DFED_FLOAT32 to measure the float32 build.
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <Eigen/Dense>
+#include "scalar.cpp"
+#include "sparsify.cpp"
+#include "model_versions.cpp"
+
+using namespace Eigen;
+
+const Scalar LEARNING_RATE = 0.05;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Outcome {
+    double downstream_bytes;  // Mean per reply, header included
+    double delta_fraction;    // Replies sent as deltas
+    double publish_seconds;   // Mean time in ModelVersions::publish
+    bool consistent;          // Every client ended with the server's model
+};
+
+// Clients take turns sending one update each; k == 0 sends dense gradients
+Outcome simulate(int features, int rounds, int clients, size_t k) {
+    std::mt19937 gen(42);
+    std::normal_distribution<Scalar> normal(0, 1);
+    VectorXa global_weights = VectorXa::Zero(features);
+    std::vector<VectorXs> client_weights(clients, VectorXs::Zero(features));
+    std::vector<uint64_t> client_versions(clients, 0);
+    std::vector<TopKSparsifier> sparsifiers(clients, TopKSparsifier(k));
+    ModelVersions<Scalar> versions;
+    std::vector<uint32_t> indices, delta_indices;
+    std::vector<Scalar> values, delta_values;
+    std::vector<uint8_t> wire;
+    uint64_t bytes = 0, deltas = 0;
+    double publish_seconds = 0;
+
+    for (int round = 0; round < rounds; ++round) {
+        int client = round % clients;
+        VectorXs gradient = VectorXs::NullaryExpr(features, [&]() { return normal(gen); });
+        if (k > 0) {
+            sparsifiers[client].select(gradient, indices, values);
+            for (size_t i = 0; i < indices.size(); ++i)
+                global_weights(indices[i]) -= LEARNING_RATE * static_cast<Accumulator>(values[i]);
+        } else {
+            global_weights -= LEARNING_RATE * gradient.cast<Accumulator>();
+        }
+
+        // The reply, as FramedSession builds it
+        VectorXs reply = global_weights.cast<Scalar>();
+        bool full;
+        auto start = std::chrono::steady_clock::now();
+        client_versions[client] = versions.publish(reply.data(), features, 1, client_versions[client],
+                                                   delta_indices, delta_values, full);
+        publish_seconds += seconds_since(start);
+
+        if (full) {
+            bytes += sizeof(MessageHeader) + payload_bytes(wire_dtype<Scalar>(), features);
+            client_weights[client] = reply;
+            continue;
+        }
+        // Through the same byte layout and decoder the client uses
+        WireDtype dtype = delta_dtype<Scalar>();
+        wire.resize(delta_indices.size() * sparse_entry_bytes(dtype));
+        std::memcpy(wire.data(), delta_indices.data(), delta_indices.size() * sizeof(uint32_t));
+        std::memcpy(wire.data() + delta_indices.size() * sizeof(uint32_t), delta_values.data(),
+                    delta_values.size() * sizeof(Scalar));
+        decode_payload(dtype, wire.data(), wire.size(), features, client_weights[client].data());
+        bytes += sizeof(MessageHeader) + wire.size();
+        deltas++;
+    }
+
+    // A client's model is the reply it last received; bring each up to date with one more delta
+    bool consistent = true;
+    VectorXs reply = global_weights.cast<Scalar>();
+    for (int client = 0; client < clients; ++client) {
+        bool full;
+        client_versions[client] = versions.publish(reply.data(), features, 1, client_versions[client],
+                                                   delta_indices, delta_values, full);
+        if (full) {
+            client_weights[client] = reply;
+        } else {
+            for (size_t i = 0; i < delta_indices.size(); ++i) client_weights[client](delta_indices[i]) = delta_values[i];
+        }
+        consistent &= client_weights[client] == reply;
+    }
+    return {static_cast<double>(bytes) / rounds, static_cast<double>(deltas) / rounds, publish_seconds / rounds,
+            consistent};
+}
+
+int main(int argc, char* argv[]) {
+    int features = argc > 1 ? std::stoi(argv[1]) : 2000;
+    int rounds = argc > 2 ? std::stoi(argv[2]) : 20000;
+
+    std::cout << "[INFO] " << features << " features " << (sizeof(Scalar) == 4 ? "float32" : "float64") << ", "
+              << rounds << " rounds" << std::endl;
+
+    uint64_t full_bytes = sizeof(MessageHeader) + payload_bytes(wire_dtype<Scalar>(), features);
+    struct Run { std::string name; size_t k; };
+    const std::vector<Run> runs = {
+        {"top 1% updates", static_cast<size_t>(features) / 100},
+        {"top 10% updates", static_cast<size_t>(features) / 10},
+        {"dense updates", 0},
+    };
+    for (const Run& run : runs) {
+        for (int clients : {1, 4, 16, 64}) {
+            Outcome outcome = simulate(features, rounds, clients, run.k);
+            std::cout << run.name << ", " << clients << " clients: " << outcome.downstream_bytes << " B/reply vs "
+                      << full_bytes << " full (" << full_bytes / outcome.downstream_bytes << "x smaller), "
+                      << outcome.delta_fraction * 100 << "% deltas, publish " << outcome.publish_seconds * 1e6
+                      << " us/reply, " << (outcome.consistent ? "clients match server" : "CLIENTS DIVERGED")
+                      << std::endl;
+        }
+    }
+    return 0;
+}
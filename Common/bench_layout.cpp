@@ -0,0 +1,121 @@
+// Sample layout benchmark: per-sample SGD and per-feature stump scans over
+// column-major, row-major and padded row-major storage
+// g++ -O2 -std=c++17 bench_layout.cpp -o bench_layout -I /usr/include/eigen3
+// ./bench_layout [rows] [features]      (defaults: HIGGS shape, 200000 x 28)
+// Add -DFED_FLOAT32 to measure the float32 build.
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <numeric>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <cstdlib>
+#include <Eigen/Dense>
+#include "scalar.cpp"
+
+using namespace Eigen;
+
+const int TRAIN_BATCH_SIZE = 100;
+const size_t CACHE_LINE = 64;
+
+using PaddedRows = Map<RowMatrixXs, Aligned64, OuterStride<>>;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const std::string& name, size_t samples, double seconds, Scalar checksum) {
+    std::cout << name << ": " << static_cast<size_t>(samples / seconds) << " samples/s"
+              << " (checksum " << checksum << ")" << std::endl;
+}
+
+Scalar sigmoid(Scalar z) {
+    return Scalar(1) / (Scalar(1) + std::exp(-z));
+}
+
+// The logistic regression client loop, minus the network round trip
+template <typename Data, typename Step>
+Scalar sgd_epoch(const Data& data, const VectorXs& labels, const std::vector<int>& indices, Step step) {
+    VectorXs weights = VectorXs::Zero(data.cols());
+    for (size_t i = 0; i < indices.size(); i += TRAIN_BATCH_SIZE) {
+        int batch_size = std::min<int>(TRAIN_BATCH_SIZE, indices.size() - i);
+        VectorXs gradient = VectorXs::Zero(data.cols());
+        for (int j = 0; j < batch_size; ++j) step(data, labels(indices[i + j]), indices[i + j], weights, gradient);
+        weights -= Scalar(0.01) * gradient / batch_size;
+    }
+    return weights.sum();
+}
+
+// Adaboost's weak learner: one pass over data.col(f) per candidate feature
+template <typename Data>
+Scalar stump_scan(const Data& data, const VectorXs& labels) {
+    Scalar best = 0;
+    for (int f = 0; f < data.cols(); ++f) {
+        Scalar threshold = data.col(f).mean();
+        Scalar error = 0;
+        for (int i = 0; i < data.rows(); ++i)
+            error += ((data(i, f) > threshold) != (labels(i) > 0)) ? 1 : 0;
+        best = std::max(best, error);
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    int rows = argc > 1 ? std::stoi(argv[1]) : 200000;
+    int cols = argc > 2 ? std::stoi(argv[2]) : 28;
+
+    MatrixXs column_major = MatrixXs::Random(rows, cols);
+    RowMatrixXs row_major = column_major;
+    VectorXs labels = (VectorXs::Random(rows).array() > 0).cast<Scalar>();
+
+    // Rows padded to a whole number of cache lines, each starting on a line boundary
+    Index stride = (cols * sizeof(Scalar) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE / sizeof(Scalar);
+    std::unique_ptr<Scalar, decltype(&std::free)> padded_storage(
+        static_cast<Scalar*>(std::aligned_alloc(CACHE_LINE, rows * stride * sizeof(Scalar))), &std::free);
+    PaddedRows padded(padded_storage.get(), rows, cols, OuterStride<>(stride));
+    padded = row_major;
+
+    std::vector<int> indices(rows);
+    std::iota(indices.begin(), indices.end(), 0);
+    std::mt19937 gen(42);
+    std::shuffle(indices.begin(), indices.end(), gen);
+
+    std::cout << "[INFO] " << rows << " x " << cols << " " << (sizeof(Scalar) == 4 ? "float32" : "float64")
+              << ", padded row stride " << stride << std::endl;
+
+    auto copy_row = [](const auto& data, Scalar yi, int row, const VectorXs& weights, VectorXs& gradient) {
+        VectorXs xi = data.row(row);
+        gradient += xi * (sigmoid(xi.dot(weights)) - yi);
+    };
+    auto view_row = [](const auto& data, Scalar yi, int row, const VectorXs& weights, VectorXs& gradient) {
+        auto xi = data.row(row);
+        gradient += xi.transpose() * (sigmoid(xi.dot(weights)) - yi);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    Scalar checksum = sgd_epoch(column_major, labels, indices, copy_row);
+    report("SGD, column-major, row copied (old clients)", rows, seconds_since(start), checksum);
+
+    start = std::chrono::steady_clock::now();
+    checksum = sgd_epoch(column_major, labels, indices, view_row);
+    report("SGD, column-major, row view", rows, seconds_since(start), checksum);
+
+    start = std::chrono::steady_clock::now();
+    checksum = sgd_epoch(row_major, labels, indices, view_row);
+    report("SGD, row-major, row view", rows, seconds_since(start), checksum);
+
+    start = std::chrono::steady_clock::now();
+    checksum = sgd_epoch(padded, labels, indices, view_row);
+    report("SGD, padded row-major, row view", rows, seconds_since(start), checksum);
+
+    start = std::chrono::steady_clock::now();
+    checksum = stump_scan(column_major, labels);
+    report("Stump scan, column-major", static_cast<size_t>(rows) * cols, seconds_since(start), checksum);
+
+    start = std::chrono::steady_clock::now();
+    checksum = stump_scan(row_major, labels);
+    report("Stump scan, row-major", static_cast<size_t>(rows) * cols, seconds_since(start), checksum);
+    return 0;
+}
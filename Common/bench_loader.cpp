@@ -0,0 +1,101 @@
+// Loader benchmark: getline/stringstream baseline vs the mmap parallel parser
+// g++ -O2 -std=c++17 bench_loader.cpp -o bench_loader -pthread
+// ./bench_loader ../Datasets/HIGGS.csv 0 1
+// ./bench_loader ../Datasets/santander-customer-transaction-prediction.csv 1 2 2,3,4,5
+// (the optional last argument projects a subset of the feature columns)
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "csv_loader.cpp"
+
+// The original per-directory load_data, kept here as the baseline
+void load_data_getline(const std::string& filename, int label_column, int first_feature_column,
+                       std::vector<std::vector<float>>& features, std::vector<int>& labels) {
+    std::ifstream file(filename);
+    std::string line;
+    std::getline(file, line);
+
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        std::string value;
+        std::vector<float> feature_row;
+        int label = 0;
+
+        int column_index = 0;
+        while (std::getline(ss, value, ',')) {
+            if (column_index == label_column) {
+                label = std::stoi(value);
+            } else if (column_index >= first_feature_column) {
+                feature_row.push_back(std::stof(value));
+            }
+            column_index++;
+        }
+        features.push_back(feature_row);
+        labels.push_back(label);
+    }
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const std::string& name, size_t rows, size_t bytes, double seconds) {
+    std::cout << name << ": " << rows << " rows in " << seconds << " s, "
+              << static_cast<size_t>(rows / seconds) << " rows/s, "
+              << (bytes / seconds) / (1 << 20) << " MB/s" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <file.csv> [label_column] [first_feature_column] [column,column,...]" << std::endl;
+        return 1;
+    }
+    std::string filename = argv[1];
+    DatasetSchema schema;
+    schema.label_column = argc > 2 ? std::stoi(argv[2]) : 0;
+    schema.first_feature_column = argc > 3 ? std::stoi(argv[3]) : 1;
+    if (argc > 4) {
+        std::stringstream columns(argv[4]);
+        std::string column;
+        while (std::getline(columns, column, ',')) schema.feature_columns.push_back(std::stoi(column));
+        if (!projection_is_valid(schema)) return 1;
+    }
+
+    size_t bytes = 0;
+    {
+        MappedFile file(filename);
+        if (!file.is_open()) {
+            std::cerr << "[ERROR] Could not open file: " << filename << std::endl;
+            return 1;
+        }
+        bytes = file.size();
+    }
+
+    {
+        std::vector<std::vector<float>> features;
+        std::vector<int> labels;
+        auto start = std::chrono::steady_clock::now();
+        load_data_getline(filename, schema.label_column, schema.first_feature_column, features, labels);
+        report("getline + stringstream", labels.size(), bytes, seconds_since(start));
+    }
+
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < loader_thread_count(); threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(loader_thread_count());
+
+    for (int threads : thread_counts) {
+        auto start = std::chrono::steady_clock::now();
+        MappedFile file(filename);
+        CsvScan scan = scan_csv(file.data(), file.end(), schema, threads);
+        std::vector<float> features(scan.rows * scan.feature_cols);
+        std::vector<int> labels(scan.rows);
+        size_t kept = parse_csv_chunks<float>(scan,
+            [&](size_t r) { return features.data() + r * scan.feature_cols; }, 1, labels.data());
+        report("mmap + from_chars, " + std::to_string(threads) + " threads", kept, bytes, seconds_since(start));
+    }
+    return 0;
+}
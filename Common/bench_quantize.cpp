@@ -0,0 +1,127 @@
+// Quantized wire encodings benchmark: bytes per round, codec speed, and the
+// accuracy of federated logistic regression when every gradient and every
+// model broadcast goes through the codec (clients and server simulated in process)
+// g++ -O2 -std=c++17 bench_quantize.cpp -o bench_quantize -I /usr/include/eigen3 -lpthread
+// ./bench_quantize [rows] [features] [clients]      (defaults: HIGGS shape, 200000 x 28, 4 clients)
+// Add -DFED_FLOAT32 to measure the float32 build.
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <Eigen/Dense>
+#include "scalar.cpp"
+#include "wire_protocol.cpp"
+
+using namespace Eigen;
+
+const int TRAIN_BATCH_SIZE = 100;
+const Scalar LEARNING_RATE = 0.05;
+const Index KERNEL_SVM_WEIGHTS = 200000;  // KernelSVM sends one weight per Santander training sample
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// What the receiver sees after one trip through the wire in `encoding`
+VectorXs round_trip(const VectorXs& values, WireDtype encoding) {
+    if (!is_quantized(encoding)) return values;
+    std::vector<uint8_t> encoded(payload_bytes(encoding, values.size()));
+    VectorXs decoded(values.size());
+    encode_payload(encoding, values.data(), values.size(), encoded.data());
+    decode_payload(encoding, encoded.data(), encoded.size(), values.size(), decoded.data());
+    return decoded;
+}
+
+struct Outcome {
+    double accuracy;
+    double log_loss;
+    VectorXa weights;
+};
+
+// One epoch of minibatch SGD; client c takes batches c, c + clients, ...
+Outcome train(const RowMatrixXs& data, const VectorXs& labels, const RowMatrixXs& test_data,
+              const VectorXs& test_labels, int clients, WireDtype encoding) {
+    VectorXa global_weights = VectorXa::Zero(data.cols());  // Full precision on the server, as in server.cpp
+    std::vector<VectorXs> client_weights(clients, VectorXs::Zero(data.cols()));
+
+    for (Index start = 0, batch = 0; start < data.rows(); start += TRAIN_BATCH_SIZE, ++batch) {
+        Index batch_size = std::min<Index>(TRAIN_BATCH_SIZE, data.rows() - start);
+        VectorXs& weights = client_weights[batch % clients];
+        auto X = data.middleRows(start, batch_size);
+        VectorXs p = (-(X * weights).array()).exp().unaryExpr([](Scalar e) { return Scalar(1) / (Scalar(1) + e); });
+        VectorXs gradient = X.transpose() * (p - labels.segment(start, batch_size)) / Scalar(batch_size);
+
+        global_weights -= LEARNING_RATE * round_trip(gradient, encoding).cast<Accumulator>();
+        weights = round_trip(global_weights.cast<Scalar>(), encoding);
+    }
+
+    VectorXd w = global_weights.cast<double>();
+    VectorXd z = test_data.cast<double>() * w;
+    double correct = 0, loss = 0;
+    for (Index i = 0; i < z.size(); ++i) {
+        double p = 1 / (1 + std::exp(-z(i)));
+        double y = test_labels(i);
+        correct += ((p > 0.5) == (y > 0.5));
+        loss -= y * std::log(std::max(p, 1e-12)) + (1 - y) * std::log(std::max(1 - p, 1e-12));
+    }
+    return {correct / z.size(), loss / z.size(), global_weights};
+}
+
+int main(int argc, char* argv[]) {
+    int rows = argc > 1 ? std::stoi(argv[1]) : 200000;
+    int cols = argc > 2 ? std::stoi(argv[2]) : 28;
+    int clients = argc > 3 ? std::stoi(argv[3]) : 4;
+
+    // Labels drawn from a logistic model, so accuracy has a known ceiling
+    std::mt19937 gen(42);
+    std::normal_distribution<double> normal(0, 1);
+    auto draw = [&](Index n, RowMatrixXs& X, VectorXs& y, const VectorXd& truth) {
+        X.resize(n, cols);
+        y.resize(n);
+        for (Index i = 0; i < n; ++i) {
+            for (int j = 0; j < cols; ++j) X(i, j) = static_cast<Scalar>(normal(gen));
+            double z = X.row(i).cast<double>().dot(truth);
+            y(i) = std::uniform_real_distribution<double>(0, 1)(gen) < 1 / (1 + std::exp(-z)) ? 1 : 0;
+        }
+    };
+    VectorXd truth = VectorXd::NullaryExpr(cols, [&]() { return normal(gen) * 0.5; });
+    RowMatrixXs data, test_data;
+    VectorXs labels, test_labels;
+    draw(rows, data, labels, truth);
+    draw(rows / 4, test_data, test_labels, truth);
+
+    std::cout << "[INFO] " << rows << " x " << cols << " " << (sizeof(Scalar) == 4 ? "float32" : "float64")
+              << ", " << clients << " clients, batch " << TRAIN_BATCH_SIZE << std::endl;
+
+    const std::vector<std::pair<std::string, WireDtype>> encodings = {
+        {"native", wire_dtype<Scalar>()}, {"fp16", WIRE_FLOAT16}, {"bf16", WIRE_BFLOAT16}, {"int8", WIRE_INT8_BLOCK}};
+
+    VectorXa reference;
+    uint64_t native_bytes = 0;
+    for (const auto& [name, encoding] : encodings) {
+        // One update plus one reply per round, headers included
+        uint64_t round_bytes = 2 * (sizeof(MessageHeader) + payload_bytes(encoding, cols));
+        uint64_t kernel_bytes = 2 * (sizeof(MessageHeader) + payload_bytes(encoding, KERNEL_SVM_WEIGHTS));
+        if (name == "native") native_bytes = kernel_bytes;
+
+        VectorXs vector = VectorXs::Random(KERNEL_SVM_WEIGHTS);
+        auto start = std::chrono::steady_clock::now();
+        int repeats = 20;
+        Scalar checksum = 0;
+        for (int r = 0; r < repeats; ++r) checksum += round_trip(vector, encoding)(r);
+        double codec_seconds = seconds_since(start);
+
+        Outcome outcome = train(data, labels, test_data, test_labels, clients, encoding);
+        if (name == "native") reference = outcome.weights;  // The native run comes first
+
+        std::cout << name << ": " << round_bytes << " B/round (" << cols << " features), "
+                  << kernel_bytes << " B/round KernelSVM (" << static_cast<double>(native_bytes) / kernel_bytes
+                  << "x smaller), encode+decode " << repeats * KERNEL_SVM_WEIGHTS / codec_seconds / 1e6
+                  << " M values/s, accuracy " << outcome.accuracy << ", log loss " << outcome.log_loss;
+        if (name != "native") std::cout << ", max |w - w_native| " << (outcome.weights - reference).cwiseAbs().maxCoeff();
+        std::cout << " (checksum " << checksum << ")" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Ensemble payload benchmark: the RF and Adaboost servers' per-update work and
+// bytes on the wire with each tree/stump as three doubles (cast in and out of
+// the server's structs) against the fixed-layout records used in place.
+// g++ -O2 -std=c++17 bench_records.cpp -o bench_records -I /usr/include/eigen3
+// ./bench_records [updates] [per_update]      (defaults: 2000 updates of 2 trees/stumps, as the clients send)
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <array>
+#include <Eigen/Dense>
+#include "ensemble_records.cpp"
+
+using Clock = std::chrono::steady_clock;
+const int TOP_LEARNERS = 20;
+
+// The servers' structs before records
+struct DecisionTree {
+    int feature_index;
+    float threshold;
+    int class_label;
+};
+
+struct WeakLearner {
+    int feature_index;
+    double threshold;
+    double alpha;
+};
+
+using Records = Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>>;
+using ConstRecords = Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>>;
+
+// RF server step with double triples: append the update, reply the whole forest
+void forest_as_doubles(std::vector<double>& payload, int count, std::vector<DecisionTree>& forest) {
+    ConstRecords in(payload.data(), count, 3);
+    for (int i = 0; i < count; ++i)
+        forest.push_back({static_cast<int>(in(i, 0)), static_cast<float>(in(i, 1)), static_cast<int>(in(i, 2))});
+    payload.resize(forest.size() * 3);
+    Records out(payload.data(), forest.size(), 3);
+    for (size_t i = 0; i < forest.size(); ++i) out.row(i) << forest[i].feature_index, forest[i].threshold, forest[i].class_label;
+}
+
+void forest_as_records(std::vector<TreeRecord>& payload, std::vector<TreeRecord>& forest) {
+    forest.insert(forest.end(), payload.begin(), payload.end());
+    payload = forest;
+}
+
+// Adaboost server step with double triples: append the update, reply the top learners
+void stumps_as_doubles(std::vector<double>& payload, int count, std::vector<WeakLearner>& pool) {
+    ConstRecords in(payload.data(), count, 3);
+    for (int i = 0; i < count; ++i) pool.push_back({static_cast<int>(in(i, 0)), in(i, 1), in(i, 2)});
+    std::array<WeakLearner, TOP_LEARNERS> top;
+    int n = std::min<int>(TOP_LEARNERS, pool.size());
+    std::partial_sort_copy(pool.begin(), pool.end(), top.begin(), top.begin() + n,
+                           [](const WeakLearner& a, const WeakLearner& b) { return a.alpha > b.alpha; });
+    payload.resize(n * 3);
+    Records out(payload.data(), n, 3);
+    for (int i = 0; i < n; ++i) out.row(i) << top[i].feature_index, top[i].threshold, top[i].alpha;
+}
+
+// As Adaboost/server.cpp now does: the new top learners are among the old top and the update
+void stumps_as_records(std::vector<StumpRecord>& payload, std::vector<StumpRecord>& pool,
+                       std::vector<StumpRecord>& top) {
+    pool.insert(pool.end(), payload.begin(), payload.end());
+    payload.insert(payload.end(), top.begin(), top.end());
+    size_t n = std::min<size_t>(TOP_LEARNERS, payload.size());
+    std::partial_sort(payload.begin(), payload.begin() + n, payload.end(),
+                      [](const StumpRecord& a, const StumpRecord& b) { return a.alpha > b.alpha; });
+    payload.resize(n);
+    top.assign(payload.begin(), payload.end());
+}
+
+struct Result {
+    double seconds = 0;      // Server steps only
+    uint64_t update_bytes = 0;
+    uint64_t reply_bytes = 0;
+};
+
+void report(const char* name, const Result& doubles, const Result& records, int updates) {
+    std::cout << name << ": doubles " << doubles.seconds / updates * 1e9 << " ns/update, "
+              << doubles.update_bytes / updates << " B/update, " << doubles.reply_bytes / updates << " B/reply; records "
+              << records.seconds / updates * 1e9 << " ns/update, " << records.update_bytes / updates << " B/update, "
+              << records.reply_bytes / updates << " B/reply ("
+              << static_cast<double>(doubles.update_bytes + doubles.reply_bytes) /
+                     (records.update_bytes + records.reply_bytes)
+              << "x fewer bytes, " << doubles.seconds / records.seconds << "x faster)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int updates = argc > 1 ? std::stoi(argv[1]) : 2000;
+    int per_update = argc > 2 ? std::stoi(argv[2]) : 2;
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> feature(0, 199);
+    std::uniform_real_distribution<double> value(-20, 20);
+    std::uniform_real_distribution<double> alpha(0.05, 1.5);
+
+    std::vector<TreeRecord> trees;
+    std::vector<StumpRecord> stumps;
+    for (int i = 0; i < updates * per_update; ++i) {
+        double threshold = std::round(value(gen) * 1e4) / 1e4;
+        trees.push_back({feature(gen), static_cast<float>(threshold), static_cast<uint8_t>(gen() % 2)});
+        stumps.push_back({feature(gen), record_threshold(threshold), static_cast<float>(alpha(gen))});
+    }
+
+    // Each update is received into the payload buffer, as the session does, then handled
+    Result doubles, records;
+    {
+        std::vector<DecisionTree> forest;
+        std::vector<double> payload;
+        for (int u = 0; u < updates; ++u) {
+            payload.resize(per_update * 3);
+            for (int i = 0; i < per_update; ++i) {
+                const TreeRecord& tree = trees[u * per_update + i];
+                payload[i * 3] = tree.feature_index;
+                payload[i * 3 + 1] = tree.threshold;
+                payload[i * 3 + 2] = tree.class_label;
+            }
+            doubles.update_bytes += payload.size() * sizeof(double);
+            auto start = Clock::now();
+            forest_as_doubles(payload, per_update, forest);
+            doubles.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            doubles.reply_bytes += payload.size() * sizeof(double);
+        }
+    }
+    {
+        std::vector<TreeRecord> forest, payload;
+        for (int u = 0; u < updates; ++u) {
+            payload.assign(trees.begin() + u * per_update, trees.begin() + (u + 1) * per_update);
+            records.update_bytes += payload.size() * sizeof(TreeRecord);
+            auto start = Clock::now();
+            forest_as_records(payload, forest);
+            records.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            records.reply_bytes += payload.size() * sizeof(TreeRecord);
+        }
+    }
+    report("RF forest", doubles, records, updates);
+
+    doubles = records = Result();
+    {
+        std::vector<WeakLearner> pool;
+        std::vector<double> payload;
+        for (int u = 0; u < updates; ++u) {
+            payload.resize(per_update * 3);
+            for (int i = 0; i < per_update; ++i) {
+                const StumpRecord& stump = stumps[u * per_update + i];
+                payload[i * 3] = stump.feature_index;
+                payload[i * 3 + 1] = stump.threshold;
+                payload[i * 3 + 2] = stump.alpha;
+            }
+            doubles.update_bytes += payload.size() * sizeof(double);
+            auto start = Clock::now();
+            stumps_as_doubles(payload, per_update, pool);
+            doubles.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            doubles.reply_bytes += payload.size() * sizeof(double);
+        }
+    }
+    {
+        std::vector<StumpRecord> pool, top, payload;
+        for (int u = 0; u < updates; ++u) {
+            payload.assign(stumps.begin() + u * per_update, stumps.begin() + (u + 1) * per_update);
+            records.update_bytes += payload.size() * sizeof(StumpRecord);
+            auto start = Clock::now();
+            stumps_as_records(payload, pool, top);
+            records.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            records.reply_bytes += payload.size() * sizeof(StumpRecord);
+        }
+    }
+    report("Adaboost top learners", doubles, records, updates);
+
+    // The float thresholds split every value in the range as the doubles did
+    int flipped = 0;
+    for (int i = 0; i < 100000; ++i) {
+        double threshold = std::round(value(gen) * 1e4) / 1e4;
+        double x = threshold + (static_cast<int>(gen() % 3) - 1) * 1e-4;
+        flipped += (x <= threshold) != (x <= record_threshold(threshold));
+    }
+    std::cout << "Stump thresholds: " << flipped << " of 100000 neighbouring values split differently" << std::endl;
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Model subscription benchmark: time per training batch when each update waits
+// for its reply, against sending updates fire-and-forget while the server
+// pushes models (--subscribe), as the round-trip time grows. A relay between
+// client and server holds every chunk back half the RTT in each direction, and
+// a sleep stands in for the client's gradient computation.
+// g++ -O2 -std=c++20 bench_subscribe.cpp -o bench_subscribe -I /usr/include/eigen3 -lpthread
+// ./bench_subscribe [features] [batches] [compute_us]      (defaults: 2000 features, 500 batches, 200 us)
+// Add -DFED_FLOAT32 to measure the float32 build.
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <csignal>
+#include <utility>
+#include <boost/asio.hpp>
+#include <Eigen/Dense>
+#include "scalar.cpp"
+#include "async_server.cpp"
+#include "subscription.cpp"
+
+using namespace Eigen;
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+const unsigned short BENCH_PORT = 8097;
+const int TRAIN_BATCH_SIZE = 100;
+const Scalar LEARNING_RATE = 0.01;
+
+std::mutex model_mutex;
+VectorXs global_weights;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// The logistic regression server's step, without the logging
+int handle_update(const MessageHeader&, VectorXs& payload, ModelStamp& stamp) {
+    std::lock_guard<std::mutex> lock(model_mutex);
+    if (global_weights.size() != payload.size()) global_weights = VectorXs::Zero(payload.size());
+    global_weights -= LEARNING_RATE * payload;
+    payload = global_weights;
+    stamp.stamp();
+    return 0;
+}
+
+// Copies bytes from `from` to `to`, writing each chunk `delay` after it was read
+void relay(tcp::socket& from, tcp::socket& to, std::chrono::microseconds delay) {
+    struct Chunk {
+        Clock::time_point due;
+        std::vector<char> bytes;
+    };
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Chunk> queue;
+    bool done = false;
+
+    std::thread writer([&]() {
+        boost::system::error_code ec;
+        for (;;) {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&]() { return !queue.empty() || done; });
+            if (queue.empty()) break;
+            Chunk chunk = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            std::this_thread::sleep_until(chunk.due);
+            boost::asio::write(to, boost::asio::buffer(chunk.bytes), ec);
+        }
+        to.shutdown(tcp::socket::shutdown_send, ec);
+    });
+
+    std::vector<char> buffer(1 << 16);
+    boost::system::error_code ec;
+    for (;;) {
+        size_t n = from.read_some(boost::asio::buffer(buffer), ec);
+        if (ec) break;
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back({Clock::now() + delay, std::vector<char>(buffer.begin(), buffer.begin() + n)});
+        ready.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    ready.notify_one();
+    writer.join();
+}
+
+struct Outcome {
+    double batch_seconds;  // Mean per batch, the final wait included
+    VectorXs weights;      // Model the client ends with
+};
+
+// One client training `batches` batches through a relay with round trip `rtt`
+Outcome train(boost::asio::io_context& io_context, int features, int batches, std::chrono::microseconds compute,
+              std::chrono::microseconds rtt, bool subscribe) {
+    tcp::acceptor relay_acceptor(io_context, tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+    tcp::socket client_side(io_context), server_side(io_context);
+    std::thread relays([&]() {
+        relay_acceptor.accept(client_side);
+        server_side.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), BENCH_PORT));
+        client_side.set_option(tcp::no_delay(true));
+        server_side.set_option(tcp::no_delay(true));
+        std::thread upstream([&]() { relay(client_side, server_side, rtt / 2); });
+        relay(server_side, client_side, rtt / 2);
+        upstream.join();
+    });
+
+    FramedSocket socket(io_context);
+    socket.connect(relay_acceptor.local_endpoint());
+    set_no_delay(socket);
+    std::unique_ptr<ModelSubscription<VectorXs>> subscription;
+    if (subscribe) subscription = std::make_unique<ModelSubscription<VectorXs>>(socket, MODEL_LOGISTIC_REGRESSION);
+
+    VectorXs weights = VectorXs::Zero(features);
+    VectorXs gradient = VectorXs::Constant(features, Scalar(0.001));
+    auto start = Clock::now();
+    for (int b = 0; b < batches; ++b) {
+        std::this_thread::sleep_for(compute);
+        if (subscribe) {
+            send_message(socket, MSG_UPDATE, MODEL_LOGISTIC_REGRESSION, TRAIN_BATCH_SIZE, gradient,
+                         wire_dtype<Scalar>(), FLAG_SUBSCRIBE);
+            subscription->sent_update();
+            subscription->latest(weights);
+        } else {
+            send_message(socket, MSG_UPDATE, MODEL_LOGISTIC_REGRESSION, TRAIN_BATCH_SIZE, gradient);
+            receive_message(socket, MSG_MODEL, MODEL_LOGISTIC_REGRESSION, weights);
+        }
+    }
+    if (subscribe) subscription->finish(weights);
+    double seconds = seconds_since(start);
+    subscription.reset();
+    socket.close();
+    relays.join();
+    return {seconds / batches, weights};
+}
+
+int main(int argc, char* argv[]) {
+    int features = argc > 1 ? std::stoi(argv[1]) : 2000;
+    int batches = argc > 2 ? std::stoi(argv[2]) : 500;
+    std::chrono::microseconds compute(argc > 3 ? std::stoi(argv[3]) : 200);
+
+    ServerOptions options;
+    options.port = BENCH_PORT;
+    options.workers = 1;
+    std::thread server([&]() { run_framed_server<VectorXs>(options, MODEL_LOGISTIC_REGRESSION, handle_update); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    auto start = Clock::now();
+    for (int b = 0; b < batches; ++b) std::this_thread::sleep_for(compute);
+    double compute_seconds = seconds_since(start) / batches;
+    std::cout << "[INFO] " << features << " features " << (sizeof(Scalar) == 4 ? "float32" : "float64") << ", "
+              << batches << " batches, compute " << compute_seconds * 1e6 << " us/batch (measured sleep)"
+              << std::endl;
+
+    boost::asio::io_context io_context;
+    for (int rtt_us : {0, 200, 1000, 5000}) {
+        std::chrono::microseconds rtt(rtt_us);
+        for (bool subscribe : {false, true}) {
+            {
+                std::lock_guard<std::mutex> lock(model_mutex);
+                global_weights.resize(0);  // Each run starts from a zero model
+            }
+            Outcome outcome = train(io_context, features, batches, compute, rtt, subscribe);
+            VectorXs expected = VectorXs::Constant(features, -LEARNING_RATE * Scalar(0.001) * batches);
+            bool match = (outcome.weights - expected).cwiseAbs().maxCoeff() <= 1e-5;
+            std::cout << "RTT " << rtt_us << " us, " << (subscribe ? "subscribed" : "request/reply") << ": "
+                      << outcome.batch_seconds * 1e6 << " us/batch ("
+                      << compute_seconds / outcome.batch_seconds * 100 << "% compute), "
+                      << (match ? "final model matches" : "FINAL MODEL DIFFERS") << std::endl;
+        }
+    }
+
+    std::raise(SIGINT);
+    server.join();
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Top-k sparsification benchmark: upstream bytes per round and the accuracy of
+// federated logistic regression when each client sends only its k largest
+// gradient coordinates, with and without error feedback (simulated in process)
+// g++ -O2 -std=c++17 bench_topk.cpp -o bench_topk -I /usr/include/eigen3 -lpthread
+// ./bench_topk [rows] [features] [clients]      (defaults: 100000 x 2000, 4 clients)
+// Add -DFED_FLOAT32 to measure the float32 build.
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <Eigen/Dense>
+#include "scalar.cpp"
+#include "sparsify.cpp"
+
+using namespace Eigen;
+
+const int TRAIN_BATCH_SIZE = 100;
+const Scalar LEARNING_RATE = 0.05;
+const int INFORMATIVE_FEATURES = 50;  // The rest only add noise to the gradient
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Outcome {
+    double accuracy;
+    double log_loss;
+    uint64_t upstream_bytes;  // Per round, header included
+    double seconds;           // Spent selecting coordinates
+};
+
+// One epoch; client c takes batches c, c + clients, ... k == 0 sends dense gradients
+Outcome train(const RowMatrixXs& data, const VectorXs& labels, const RowMatrixXs& test_data,
+              const VectorXs& test_labels, int clients, size_t k, bool error_feedback) {
+    VectorXa global_weights = VectorXa::Zero(data.cols());
+    std::vector<VectorXs> client_weights(clients, VectorXs::Zero(data.cols()));
+    std::vector<TopKSparsifier> sparsifiers(clients, TopKSparsifier(k));
+    std::vector<uint32_t> indices;
+    std::vector<Scalar> values;
+    double select_seconds = 0;
+
+    for (Index start = 0, batch = 0; start < data.rows(); start += TRAIN_BATCH_SIZE, ++batch) {
+        Index batch_size = std::min<Index>(TRAIN_BATCH_SIZE, data.rows() - start);
+        int client = batch % clients;
+        VectorXs& weights = client_weights[client];
+        auto X = data.middleRows(start, batch_size);
+        VectorXs p = (-(X * weights).array()).exp().unaryExpr([](Scalar e) { return Scalar(1) / (Scalar(1) + e); });
+        VectorXs gradient = X.transpose() * (p - labels.segment(start, batch_size)) / Scalar(batch_size);
+
+        if (k > 0) {
+            if (!error_feedback) sparsifiers[client] = TopKSparsifier(k);  // Drop the residual every batch
+            auto select_start = std::chrono::steady_clock::now();
+            sparsifiers[client].select(gradient, indices, values);
+            select_seconds += seconds_since(select_start);
+            for (size_t i = 0; i < indices.size(); ++i)
+                global_weights(indices[i]) -= LEARNING_RATE * static_cast<Accumulator>(values[i]);
+        } else {
+            global_weights -= LEARNING_RATE * gradient.cast<Accumulator>();
+        }
+        weights = global_weights.cast<Scalar>();
+    }
+
+    VectorXd z = test_data.cast<double>() * global_weights.cast<double>();
+    double correct = 0, loss = 0;
+    for (Index i = 0; i < z.size(); ++i) {
+        double p = 1 / (1 + std::exp(-z(i)));
+        double y = test_labels(i);
+        correct += ((p > 0.5) == (y > 0.5));
+        loss -= y * std::log(std::max(p, 1e-12)) + (1 - y) * std::log(std::max(1 - p, 1e-12));
+    }
+    uint64_t bytes = sizeof(MessageHeader) + (k > 0 ? std::min<size_t>(k, data.cols()) * sparse_entry_bytes(sparse_dtype<Scalar>())
+                                                    : payload_bytes(wire_dtype<Scalar>(), data.cols()));
+    return {correct / z.size(), loss / z.size(), bytes, select_seconds};
+}
+
+int main(int argc, char* argv[]) {
+    int rows = argc > 1 ? std::stoi(argv[1]) : 100000;
+    int cols = argc > 2 ? std::stoi(argv[2]) : 2000;
+    int clients = argc > 3 ? std::stoi(argv[3]) : 4;
+
+    // Labels from a logistic model on the first INFORMATIVE_FEATURES columns
+    std::mt19937 gen(42);
+    std::normal_distribution<double> normal(0, 1);
+    VectorXd truth = VectorXd::Zero(cols);
+    for (int j = 0; j < std::min(cols, INFORMATIVE_FEATURES); ++j) truth(j) = normal(gen);
+    auto draw = [&](Index n, RowMatrixXs& X, VectorXs& y) {
+        X.resize(n, cols);
+        y.resize(n);
+        for (Index i = 0; i < n; ++i) {
+            for (int j = 0; j < cols; ++j) X(i, j) = static_cast<Scalar>(normal(gen));
+            double z = X.row(i).cast<double>().dot(truth);
+            y(i) = std::uniform_real_distribution<double>(0, 1)(gen) < 1 / (1 + std::exp(-z)) ? 1 : 0;
+        }
+    };
+    RowMatrixXs data, test_data;
+    VectorXs labels, test_labels;
+    draw(rows, data, labels);
+    draw(rows / 4, test_data, test_labels);
+
+    std::cout << "[INFO] " << rows << " x " << cols << " " << (sizeof(Scalar) == 4 ? "float32" : "float64")
+              << ", " << INFORMATIVE_FEATURES << " informative features, " << clients << " clients, batch "
+              << TRAIN_BATCH_SIZE << std::endl;
+
+    struct Run { std::string name; size_t k; bool error_feedback; };
+    const std::vector<Run> runs = {
+        {"dense", 0, false},
+        {"top 10%, error feedback", static_cast<size_t>(cols) / 10, true},
+        {"top 1%, error feedback", static_cast<size_t>(cols) / 100, true},
+        {"top 1%, no error feedback", static_cast<size_t>(cols) / 100, false},
+    };
+
+    uint64_t dense_bytes = 0;
+    for (const Run& run : runs) {
+        Outcome outcome = train(data, labels, test_data, test_labels, clients, run.k, run.error_feedback);
+        if (run.k == 0) dense_bytes = outcome.upstream_bytes;
+        std::cout << run.name << ": " << outcome.upstream_bytes << " B/update ("
+                  << static_cast<double>(dense_bytes) / outcome.upstream_bytes << "x smaller), accuracy "
+                  << outcome.accuracy << ", log loss " << outcome.log_loss << ", selection "
+                  << outcome.seconds * 1e6 / ((rows + TRAIN_BATCH_SIZE - 1) / TRAIN_BATCH_SIZE) << " us/update"
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,273 @@
+// Server backend benchmark: system calls per update and round-trip latency of
+// the Asio (epoll) and io_uring backends under many clients. Each backend runs
+// the framed server in a child process, whose socket and wait system calls are
+// counted by wrapping their libc entry points; the parent drives 100 and 1000
+// clients in closed loop (send an update, wait for the model) from one thread.
+// g++ -O2 -std=c++20 bench_uring.cpp -o bench_uring -I /usr/include/eigen3 -lpthread -ldl
+// ./bench_uring [rounds] [values] [workers]      (defaults: 100 rounds per client, 28 values, 1 worker)
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstdarg>
+#include <csignal>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <utility>
+#include <boost/asio.hpp>
+#include "async_server.cpp"
+
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+const unsigned short BENCH_PORT = 8098;
+const double LEARNING_RATE = 0.01;
+
+// System calls made by the server process, once counting is on
+struct SyscallCounts {
+    uint64_t transfers = 0;  // recv/send, read/write and their vector forms
+    uint64_t waits = 0;      // epoll_wait
+    uint64_t rings = 0;      // io_uring_enter: submits and waits at once
+    uint64_t other = 0;      // accept, epoll_ctl
+};
+
+std::atomic<bool> counting{false};
+std::atomic<uint64_t> transfer_calls{0}, wait_calls{0}, ring_calls{0}, other_calls{0};
+
+inline void count(std::atomic<uint64_t>& calls) {
+    if (counting.load(std::memory_order_relaxed)) calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename F>
+F next_symbol(const char* name) {
+    return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+// The wrappers see the calls Asio and the io_uring backend make; libc's own
+// (stdout included) bypass them
+extern "C" {
+ssize_t recvmsg(int fd, msghdr* message, int flags) {
+    static auto real = next_symbol<ssize_t (*)(int, msghdr*, int)>("recvmsg");
+    count(transfer_calls);
+    return real(fd, message, flags);
+}
+
+ssize_t sendmsg(int fd, const msghdr* message, int flags) {
+    static auto real = next_symbol<ssize_t (*)(int, const msghdr*, int)>("sendmsg");
+    count(transfer_calls);
+    return real(fd, message, flags);
+}
+
+ssize_t recv(int fd, void* data, size_t size, int flags) {
+    static auto real = next_symbol<ssize_t (*)(int, void*, size_t, int)>("recv");
+    count(transfer_calls);
+    return real(fd, data, size, flags);
+}
+
+ssize_t send(int fd, const void* data, size_t size, int flags) {
+    static auto real = next_symbol<ssize_t (*)(int, const void*, size_t, int)>("send");
+    count(transfer_calls);
+    return real(fd, data, size, flags);
+}
+
+ssize_t read(int fd, void* data, size_t size) {
+    static auto real = next_symbol<ssize_t (*)(int, void*, size_t)>("read");
+    count(transfer_calls);
+    return real(fd, data, size);
+}
+
+ssize_t write(int fd, const void* data, size_t size) {
+    static auto real = next_symbol<ssize_t (*)(int, const void*, size_t)>("write");
+    count(transfer_calls);
+    return real(fd, data, size);
+}
+
+ssize_t readv(int fd, const iovec* parts, int count_parts) {
+    static auto real = next_symbol<ssize_t (*)(int, const iovec*, int)>("readv");
+    count(transfer_calls);
+    return real(fd, parts, count_parts);
+}
+
+ssize_t writev(int fd, const iovec* parts, int count_parts) {
+    static auto real = next_symbol<ssize_t (*)(int, const iovec*, int)>("writev");
+    count(transfer_calls);
+    return real(fd, parts, count_parts);
+}
+
+int epoll_wait(int fd, epoll_event* events, int max_events, int timeout) {
+    static auto real = next_symbol<int (*)(int, epoll_event*, int, int)>("epoll_wait");
+    count(wait_calls);
+    return real(fd, events, max_events, timeout);
+}
+
+int epoll_ctl(int fd, int op, int target, epoll_event* event) {
+    static auto real = next_symbol<int (*)(int, int, int, epoll_event*)>("epoll_ctl");
+    count(other_calls);
+    return real(fd, op, target, event);
+}
+
+int accept(int fd, sockaddr* address, socklen_t* length) {
+    static auto real = next_symbol<int (*)(int, sockaddr*, socklen_t*)>("accept");
+    count(other_calls);
+    return real(fd, address, length);
+}
+
+int accept4(int fd, sockaddr* address, socklen_t* length, int flags) {
+    static auto real = next_symbol<int (*)(int, sockaddr*, socklen_t*, int)>("accept4");
+    count(other_calls);
+    return real(fd, address, length, flags);
+}
+
+long syscall(long number, ...) {
+    static auto real = next_symbol<long (*)(long, ...)>("syscall");
+    va_list args;
+    va_start(args, number);
+    long a[6];
+    for (long& arg : a) arg = va_arg(args, long);
+    va_end(args);
+    if (number == __NR_io_uring_enter) count(ring_calls);
+    return real(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+}
+
+std::mutex model_mutex;
+std::vector<double> global_weights;
+
+// A linear regression step: apply the gradient, reply the model
+int handle_update(const MessageHeader&, std::vector<double>& payload, ModelStamp& stamp) {
+    std::lock_guard<std::mutex> lock(model_mutex);
+    global_weights.resize(payload.size());
+    for (size_t i = 0; i < payload.size(); ++i) global_weights[i] -= LEARNING_RATE * payload[i];
+    payload = global_weights;
+    stamp.stamp();
+    return 0;
+}
+
+// Forks the server for backend; it reports its counts down report_fd once SIGINT stops it
+pid_t start_server(const std::string& backend, int workers, int report_fd) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    freopen("/dev/null", "w", stdout);
+    ServerOptions options;
+    options.port = BENCH_PORT;
+    options.workers = workers;
+    options.backend = backend;
+    counting = true;
+    run_framed_server<std::vector<double>>(options, MODEL_LINEAR_REGRESSION, handle_update);
+    counting = false;
+    SyscallCounts counts{transfer_calls.load(), wait_calls.load(), ring_calls.load(), other_calls.load()};
+    if (::write(report_fd, &counts, sizeof(counts)) != sizeof(counts)) _exit(1);
+    _exit(0);
+}
+
+// One client in closed loop: an update out, the model back, again
+struct SimulatedClient {
+    explicit SimulatedClient(boost::asio::io_context& io_context) : socket(io_context) {}
+
+    tcp::socket socket;
+    MessageHeader header;
+    std::vector<double> gradient;
+    MessageHeader reply_header;
+    std::vector<double> model;
+    Clock::time_point sent;
+    int rounds_left = 0;
+};
+
+void exchange(SimulatedClient& c, std::vector<double>& latencies) {
+    c.sent = Clock::now();
+    std::array<boost::asio::const_buffer, 2> update = {boost::asio::buffer(&c.header, sizeof(c.header)),
+                                                       boost::asio::buffer(c.gradient)};
+    boost::asio::async_write(c.socket, update, [&c, &latencies](const boost::system::error_code& ec, size_t) {
+        if (ec) throw std::runtime_error("update: " + ec.message());
+        boost::asio::async_read(c.socket, boost::asio::buffer(&c.reply_header, sizeof(c.reply_header)),
+            [&c, &latencies](const boost::system::error_code& ec, size_t) {
+                if (ec) throw std::runtime_error("reply header: " + ec.message());
+                c.model.resize(c.reply_header.length / sizeof(double));
+                boost::asio::async_read(c.socket, boost::asio::buffer(c.model),
+                    [&c, &latencies](const boost::system::error_code& ec, size_t) {
+                        if (ec) throw std::runtime_error("reply: " + ec.message());
+                        latencies.push_back(std::chrono::duration<double>(Clock::now() - c.sent).count());
+                        if (--c.rounds_left > 0) exchange(c, latencies);
+                    });
+            });
+    });
+}
+
+// Connects clients to the server and runs them to the end; returns the round trips
+std::vector<double> drive(int clients, int rounds, int values) {
+    boost::asio::io_context io_context;
+    tcp::endpoint server(boost::asio::ip::address::from_string("127.0.0.1"), BENCH_PORT);
+    std::vector<std::unique_ptr<SimulatedClient>> simulated;
+    for (int i = 0; i < clients; ++i) {
+        auto c = std::make_unique<SimulatedClient>(io_context);
+        for (int attempt = 0;; ++attempt) {  // The first ones wait for the server to listen
+            boost::system::error_code ec;
+            c->socket.connect(server, ec);
+            if (!ec) break;
+            if (attempt == 100) throw std::runtime_error("connect: " + ec.message());
+            c->socket.close();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        c->socket.set_option(tcp::no_delay(true));
+        c->gradient.assign(values, 0.001);
+        c->header = make_header<double>(MSG_UPDATE, MODEL_LINEAR_REGRESSION, 1, values, 1);
+        c->rounds_left = rounds;
+        simulated.push_back(std::move(c));
+    }
+    std::vector<double> latencies;
+    latencies.reserve(static_cast<size_t>(clients) * rounds);
+    for (auto& c : simulated) exchange(*c, latencies);
+    io_context.run();
+    return latencies;
+}
+
+double percentile(std::vector<double>& values, double p) {
+    size_t k = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = argc > 1 ? std::stoi(argv[1]) : 100;
+    int values = argc > 2 ? std::stoi(argv[2]) : 28;
+    int workers = argc > 3 ? std::stoi(argv[3]) : 1;
+    std::cout << "[INFO] " << rounds << " rounds per client, " << values << " values per update, " << workers
+              << " server worker(s)" << std::endl;
+
+    for (int clients : {100, 1000}) {
+        for (const char* backend : {"asio", "uring"}) {
+            int report[2];
+            if (pipe(report) < 0) throw std::runtime_error("pipe");
+            pid_t server = start_server(backend, workers, report[1]);
+            auto start = Clock::now();
+            std::vector<double> latencies = drive(clients, rounds, values);
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            kill(server, SIGINT);
+            SyscallCounts counts;
+            bool reported = ::read(report[0], &counts, sizeof(counts)) == sizeof(counts);
+            waitpid(server, nullptr, 0);
+            close(report[0]);
+            close(report[1]);
+            if (!reported) throw std::runtime_error(std::string(backend) + " server did not report");
+
+            double updates = static_cast<double>(clients) * rounds;
+            std::cout << clients << " clients, " << backend << ": "
+                      << (counts.transfers + counts.waits + counts.rings + counts.other) / updates
+                      << " syscalls/update (" << counts.transfers / updates << " transfers, "
+                      << counts.waits / updates << " epoll_wait, " << counts.rings / updates << " io_uring_enter, "
+                      << counts.other / updates << " other), " << updates / seconds << " updates/s, round trip p50 "
+                      << percentile(latencies, 0.5) * 1e6 << " us, p99 " << percentile(latencies, 0.99) * 1e6
+                      << " us" << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Wire protocol benchmark: one gradient/model round trip over loopback with
+// the old chunked writes (Nagle on), with framed messages on NODELAY sockets,
+// and framed over an AF_UNIX socket with and without the shared model ring
+// g++ -O2 -std=c++17 bench_wire.cpp -o bench_wire -I /usr/include/eigen3 -lpthread
+// ./bench_wire [features] [round_trips]      (defaults: HIGGS shape, 28 features, 200 round trips)
+// Add -DFED_FLOAT32 to measure the float32 build.
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <unistd.h>
+#include <boost/asio.hpp>
+#include <Eigen/Dense>
+#include "scalar.cpp"
+#include "wire_protocol.cpp"
+
+using namespace Eigen;
+using boost::asio::ip::tcp;
+
+const int NETWORK_BATCH_SIZE = 100;  // Chunk size of the old send_in_batches
+const int TRAIN_BATCH_SIZE = 100;
+const char* const BENCH_SOCKET_PATH = "/tmp/bench_wire.sock";
+const char* const BENCH_SHARED_MODEL = "bench_wire_model";
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const std::string& name, int round_trips, double seconds) {
+    std::cout << name << ": " << seconds / round_trips * 1e6 << " us/round trip, "
+              << static_cast<size_t>(2 * round_trips / seconds) << " messages/s" << std::endl;
+}
+
+// The pre-framing client: batch size, vector size, then the gradient in chunks
+void old_client_round_trip(tcp::socket& socket, const VectorXs& gradient, VectorXs& weights) {
+    int batch_size = TRAIN_BATCH_SIZE;
+    int n_features = gradient.size();
+    boost::asio::write(socket, boost::asio::buffer(&batch_size, sizeof(int)));
+    boost::asio::write(socket, boost::asio::buffer(&n_features, sizeof(int)));
+    for (int sent = 0; sent < gradient.size(); sent += NETWORK_BATCH_SIZE) {
+        int chunk = std::min<int>(NETWORK_BATCH_SIZE, gradient.size() - sent);
+        boost::asio::write(socket, boost::asio::buffer(gradient.data() + sent, chunk * sizeof(Scalar)));
+    }
+    boost::asio::read(socket, boost::asio::buffer(weights.data(), weights.size() * sizeof(Scalar)));
+}
+
+// The pre-framing server: reads the header fields and chunks, replies with the model
+void old_server(tcp::socket socket, int round_trips) {
+    VectorXs model;
+    for (int r = 0; r < round_trips; ++r) {
+        int batch_size = 0, vector_size = 0;
+        boost::asio::read(socket, boost::asio::buffer(&batch_size, sizeof(int)));
+        boost::asio::read(socket, boost::asio::buffer(&vector_size, sizeof(int)));
+        VectorXs gradient(vector_size);
+        for (int received = 0; received < vector_size; received += NETWORK_BATCH_SIZE) {
+            int chunk = std::min(NETWORK_BATCH_SIZE, vector_size - received);
+            boost::asio::read(socket, boost::asio::buffer(gradient.data() + received, chunk * sizeof(Scalar)));
+        }
+        if (model.size() != vector_size) model = VectorXs::Zero(vector_size);
+        model -= gradient / batch_size;
+        boost::asio::write(socket, boost::asio::buffer(model.data(), model.size() * sizeof(Scalar)));
+    }
+}
+
+// Replies through shared when the update asks for it, as FramedSession does
+void framed_server(FramedSocket socket, SharedModelWriter* shared) {
+    set_no_delay(socket);
+    VectorXs gradient, model;
+    MessageHeader header;
+    while (receive_message(socket, MSG_UPDATE, MODEL_LOGISTIC_REGRESSION, gradient, &header)) {
+        if (model.size() != gradient.size()) model = VectorXs::Zero(gradient.size());
+        model -= gradient / header.count;
+        MessageHeader reply = make_header<Scalar>(MSG_MODEL, MODEL_LOGISTIC_REGRESSION, 0, model.size(), 1);
+        uint64_t sequence;
+        if ((header.flags & FLAG_SHARED_MODEL) && shared && shared->publish(model.data(), reply.length, sequence)) {
+            reply.dtype = WIRE_SHARED;
+            reply.length = sizeof(sequence);
+            std::array<boost::asio::const_buffer, 2> buffers = {
+                boost::asio::buffer(&reply, sizeof(reply)), boost::asio::buffer(&sequence, sizeof(sequence))};
+            boost::asio::write(socket, buffers);
+        } else {
+            send_message(socket, MSG_MODEL, MODEL_LOGISTIC_REGRESSION, 0, model);
+        }
+    }
+}
+
+void framed_round_trips(const std::string& name, FramedSocket& socket, FramedSocket server_socket,
+                        SharedModelWriter* shared, const VectorXs& gradient, VectorXs& weights, int round_trips) {
+    std::thread server(framed_server, std::move(server_socket), shared);
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < round_trips; ++r) {
+        send_message(socket, MSG_UPDATE, MODEL_LOGISTIC_REGRESSION, TRAIN_BATCH_SIZE, gradient);
+        receive_message(socket, MSG_MODEL, MODEL_LOGISTIC_REGRESSION, weights);
+    }
+    report(name, round_trips, seconds_since(start));
+    socket.shutdown(FramedSocket::shutdown_send);
+    server.join();
+}
+
+int main(int argc, char* argv[]) {
+    int features = argc > 1 ? std::stoi(argv[1]) : 28;
+    int round_trips = argc > 2 ? std::stoi(argv[2]) : 200;
+
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+    tcp::endpoint endpoint = acceptor.local_endpoint();
+
+    VectorXs gradient = VectorXs::Random(features);
+    VectorXs weights = VectorXs::Zero(features);
+
+    std::cout << "[INFO] " << features << " features " << (sizeof(Scalar) == 4 ? "float32" : "float64")
+              << ", " << round_trips << " round trips over loopback" << std::endl;
+
+    // Chunked writes with and without Nagle, to separate the stall from the syscall count
+    for (bool no_delay : {false, true}) {
+        tcp::socket socket(io_context);
+        socket.connect(endpoint);
+        tcp::socket server_socket = acceptor.accept();
+        if (no_delay) {
+            socket.set_option(tcp::no_delay(true));
+            server_socket.set_option(tcp::no_delay(true));
+        }
+        std::thread server(old_server, std::move(server_socket), round_trips);
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < round_trips; ++r) old_client_round_trip(socket, gradient, weights);
+        report(no_delay ? "Chunked writes, NODELAY" : "Chunked writes, Nagle on (old clients)",
+               round_trips, seconds_since(start));
+        server.join();
+    }
+
+    {
+        FramedSocket socket(io_context);
+        socket.connect(endpoint);
+        set_no_delay(socket);
+        framed_round_trips("Framed gather write, NODELAY", socket, acceptor.accept(), nullptr, gradient, weights,
+                           round_trips);
+    }
+
+    ::unlink(BENCH_SOCKET_PATH);
+    boost::asio::local::stream_protocol::acceptor local_acceptor(io_context,
+        boost::asio::local::stream_protocol::endpoint(BENCH_SOCKET_PATH));
+    {
+        FramedSocket socket(io_context);
+        socket.connect(boost::asio::local::stream_protocol::endpoint(BENCH_SOCKET_PATH));
+        framed_round_trips("Framed, AF_UNIX", socket, local_acceptor.accept(), nullptr, gradient, weights,
+                           round_trips);
+    }
+    {
+        SharedModelWriter shared(BENCH_SHARED_MODEL);
+        shared_model_name() = BENCH_SHARED_MODEL;  // Updates now ask for shared replies
+        FramedSocket socket(io_context);
+        socket.connect(boost::asio::local::stream_protocol::endpoint(BENCH_SOCKET_PATH));
+        framed_round_trips("Framed, AF_UNIX + shared model ring", socket, local_acceptor.accept(), &shared,
+                           gradient, weights, round_trips);
+    }
+    ::unlink(BENCH_SOCKET_PATH);
+
+    std::cout << "[INFO] Checksum " << weights.sum() << std::endl;
+    return 0;
+}
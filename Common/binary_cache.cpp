@@ -0,0 +1,228 @@
+// Binary columnar dataset cache written next to the CSV and mmapped on reload
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstdio>
+#include <Eigen/Dense>
+#include "csv_loader.cpp"
+#include "compressed_csv.cpp"
+
+const char BINARY_CACHE_MAGIC[8] = {'F', 'E', 'D', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t BINARY_CACHE_VERSION = 1;
+const size_t BINARY_CACHE_ALIGNMENT = 64;
+
+template <typename Scalar> constexpr uint32_t cache_dtype();
+template <> constexpr uint32_t cache_dtype<float>() { return DTYPE_FLOAT32; }
+template <> constexpr uint32_t cache_dtype<double>() { return DTYPE_FLOAT64; }
+
+// File layout: header | labels[col_stride] | feature column 0 | column 1 | ...
+// Every block starts on a 64-byte boundary; col_stride is rows rounded up so
+// that each column stays aligned.
+struct BinaryCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint64_t rows;
+    uint64_t col_stride;
+    uint32_t cols;
+    int32_t label_column;
+    int32_t first_feature_column;
+    int32_t num_feature_columns;
+    uint64_t source_size;
+    int64_t source_mtime;
+};
+static_assert(sizeof(BinaryCacheHeader) == BINARY_CACHE_ALIGNMENT, "cache header must fill one cache line");
+
+inline size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+inline std::string binary_cache_path(const std::string& csv_filename) {
+    return csv_filename + ".bin";
+}
+
+template <typename Scalar>
+size_t cache_features_offset(uint64_t col_stride) {
+    return BINARY_CACHE_ALIGNMENT + align_up(col_stride * sizeof(Scalar), BINARY_CACHE_ALIGNMENT);
+}
+
+// Read-only view of rows [first_row, first_row + rows) of a cache file; the
+// Eigen maps point into the shared mapping
+template <typename Scalar>
+class BinaryDataset {
+public:
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+    using Vector = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+    using FeatureMap = Eigen::Map<const Matrix, 0, Eigen::OuterStride<>>;
+    using LabelMap = Eigen::Map<const Vector>;
+
+    BinaryDataset(std::unique_ptr<MappedFile> file, size_t first_row, size_t rows)
+        : file_(std::move(file)), first_row_(first_row), rows_(rows) {}
+
+    const BinaryCacheHeader& header() const {
+        return *reinterpret_cast<const BinaryCacheHeader*>(file_->data());
+    }
+    size_t rows() const { return rows_; }
+    size_t cols() const { return header().cols; }
+
+    FeatureMap features() const {
+        const Scalar* base = reinterpret_cast<const Scalar*>(
+            file_->data() + cache_features_offset<Scalar>(header().col_stride));
+        return FeatureMap(base + first_row_, rows_, cols(), Eigen::OuterStride<>(header().col_stride));
+    }
+    LabelMap labels() const {
+        return LabelMap(reinterpret_cast<const Scalar*>(file_->data() + BINARY_CACHE_ALIGNMENT) + first_row_, rows_);
+    }
+
+private:
+    std::unique_ptr<MappedFile> file_;
+    size_t first_row_;
+    size_t rows_;
+};
+
+inline bool stat_source(const std::string& filename, uint64_t& size, int64_t& mtime) {
+    struct stat st;
+    if (::stat(filename.c_str(), &st) != 0) return false;
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+// Writes a cache of up to rows x cols; fill(labels, features, col_stride)
+// stores the data and returns the rows it kept. The file is built under a
+// temporary name and renamed so concurrent clients never see a partial cache.
+template <typename Scalar, typename Fill>
+bool write_cache_file(const std::string& csv_filename, const DatasetSchema& schema, size_t rows, int cols, Fill fill) {
+    uint64_t col_stride = align_up(std::max<size_t>(rows, 1), BINARY_CACHE_ALIGNMENT / sizeof(Scalar));
+    size_t features_offset = cache_features_offset<Scalar>(col_stride);
+    size_t total_size = features_offset + col_stride * cols * sizeof(Scalar);
+
+    std::string path = binary_cache_path(csv_filename);
+    std::string tmp_path = path + ".tmp." + std::to_string(::getpid());
+    int fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ::ftruncate(fd, total_size) != 0) {
+        std::cerr << "[ERROR] Could not create cache file: " << tmp_path << std::endl;
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    void* mapped = ::mmap(nullptr, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "[ERROR] Could not map cache file: " << tmp_path << std::endl;
+        ::unlink(tmp_path.c_str());
+        return false;
+    }
+
+    char* base = static_cast<char*>(mapped);
+    Scalar* labels = reinterpret_cast<Scalar*>(base + BINARY_CACHE_ALIGNMENT);
+    Scalar* features = reinterpret_cast<Scalar*>(base + features_offset);
+    size_t kept = fill(labels, features, col_stride);
+
+    BinaryCacheHeader header = {};
+    std::copy(BINARY_CACHE_MAGIC, BINARY_CACHE_MAGIC + 8, header.magic);
+    header.version = BINARY_CACHE_VERSION;
+    header.dtype = cache_dtype<Scalar>();
+    header.rows = kept;
+    header.col_stride = col_stride;
+    header.cols = cols;
+    header.label_column = schema.label_column;
+    header.first_feature_column = schema.first_feature_column;
+    header.num_feature_columns = schema.num_feature_columns;
+    stat_source(csv_filename, header.source_size, header.source_mtime);
+    std::memcpy(base, &header, sizeof(header));
+
+    ::msync(mapped, total_size, MS_SYNC);
+    ::munmap(mapped, total_size);
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "[ERROR] Could not move cache into place: " << path << std::endl;
+        ::unlink(tmp_path.c_str());
+        return false;
+    }
+
+    std::cout << "[INFO] Wrote " << kept << " x " << cols << " cache to " << path << std::endl;
+    return true;
+}
+
+// Parses the CSV once and writes the cache. A compressed CSV is decompressed
+// into memory first, since its row count is only known at the end.
+template <typename Scalar>
+bool write_binary_cache(const std::string& csv_filename, const DatasetSchema& schema) {
+    // The cache holds the whole feature range; projections are applied on load
+    DatasetSchema full = schema;
+    full.feature_columns.clear();
+    full.max_rows = 0;
+    full.shard_index = 0;
+    full.shard_count = 1;
+
+    if (compression_of(csv_filename) != COMPRESSION_NONE) {
+        Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> data;
+        Eigen::Matrix<Scalar, Eigen::Dynamic, 1> targets;
+        if (!load_compressed_csv(csv_filename, full, data, targets)) return false;
+        return write_cache_file<Scalar>(csv_filename, schema, data.rows(), data.cols(),
+            [&](Scalar* labels, Scalar* features, size_t col_stride) {
+                Eigen::Map<Eigen::Matrix<Scalar, Eigen::Dynamic, 1>>(labels, data.rows()) = targets;
+                Eigen::Map<Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>, 0, Eigen::OuterStride<>>(
+                    features, data.rows(), data.cols(), Eigen::OuterStride<>(col_stride)) = data;
+                return static_cast<size_t>(data.rows());
+            });
+    }
+
+    MappedFile csv(csv_filename);
+    if (!csv.is_open()) {
+        std::cerr << "[ERROR] Could not open file: " << csv_filename << std::endl;
+        return false;
+    }
+    CsvScan scan = scan_csv(csv.data(), csv.end(), full, loader_thread_count());
+    return write_cache_file<Scalar>(csv_filename, schema, scan.rows, scan.feature_cols,
+        [&](Scalar* labels, Scalar* features, size_t col_stride) {
+            return parse_csv_chunks<Scalar>(scan, [&](size_t r) { return features + r; }, col_stride, labels);
+        });
+}
+
+// Checks a cache header against the feature range of the schema, the file size and the CSV it came from
+template <typename Scalar>
+bool cache_header_matches(const BinaryCacheHeader& header, size_t file_size,
+                          const std::string& csv_filename, const DatasetSchema& schema) {
+    if (!std::equal(header.magic, header.magic + 8, BINARY_CACHE_MAGIC) ||
+        header.version != BINARY_CACHE_VERSION || header.dtype != cache_dtype<Scalar>() ||
+        header.label_column != schema.label_column ||
+        header.first_feature_column != schema.first_feature_column ||
+        header.num_feature_columns != schema.num_feature_columns ||
+        file_size < cache_features_offset<Scalar>(header.col_stride) +
+                        header.col_stride * header.cols * sizeof(Scalar)) {
+        return false;
+    }
+    for (int column : schema.feature_columns) {
+        if (range_feature_index(column, schema) >= static_cast<int>(header.cols)) return false;
+    }
+
+    // A missing CSV is fine (it may have been deleted to save space); a changed one is not
+    uint64_t source_size;
+    int64_t source_mtime;
+    if (stat_source(csv_filename, source_size, source_mtime) &&
+        (source_size != header.source_size || source_mtime != header.source_mtime)) {
+        std::cerr << "[WARNING] Ignoring stale cache " << binary_cache_path(csv_filename) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Maps the cache next to csv_filename; returns nullptr when it is missing,
+// built for another feature range or dtype, or older than the CSV
+template <typename Scalar>
+std::unique_ptr<BinaryDataset<Scalar>> open_binary_cache(const std::string& csv_filename, const DatasetSchema& schema) {
+    auto file = std::make_unique<MappedFile>(binary_cache_path(csv_filename));
+    if (!file->is_open() || file->size() < sizeof(BinaryCacheHeader)) return nullptr;
+
+    BinaryCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (!cache_header_matches<Scalar>(header, file->size(), csv_filename, schema)) return nullptr;
+
+    size_t first_row, rows;
+    shard_row_range(header.rows, schema, first_row, rows);
+    if (schema.shard_count <= 1) ::madvise(const_cast<char*>(file->data()), file->size(), MADV_WILLNEED);
+    return std::make_unique<BinaryDataset<Scalar>>(std::move(file), first_row, rows);
+}
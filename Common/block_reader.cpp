@@ -0,0 +1,296 @@
+// Out-of-core reader: yields a dataset in fixed-size row blocks with bounded memory
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <Eigen/Dense>
+#include "binary_cache.cpp"
+#include "compressed_csv.cpp"
+
+const size_t MIN_BLOCK_ROWS = 1024;
+const size_t MIN_BUFFER_BYTES = 64 << 10;  // Of the CSV reader's buffer, so each pread is worth its call
+
+// Streams row blocks from a binary cache (pread per column) or from the CSV
+// (read into a fixed buffer, parsing whole lines only). Memory held by the
+// reader is the CSV buffer plus whatever block the caller passes in. The
+// budget covers the buffer at its largest (half of it; a row that does not
+// fit even then is an error) and two blocks; when the minimum buffer and
+// block sizes exceed it, the reader says so and uses those minimums.
+class BlockReader {
+public:
+    BlockReader(const std::string& filename, const DatasetSchema& schema, size_t memory_bytes)
+        : filename_(filename), schema_(schema) {
+        if (!projection_is_valid(schema_)) return;
+        bool cached = schema_.dtype == DTYPE_FLOAT64 ? open_cache<double>() || open_cache<float>()
+                                                      : open_cache<float>() || open_cache<double>();
+        if (!cached) open_csv(memory_bytes / 4, memory_bytes / 2);
+        if (cols_ > 0) {
+            // Two blocks of doubles fit in what the buffer can never take (one training, one loading)
+            size_t row_bytes = (cols_ + 1) * sizeof(double);
+            size_t budget = memory_bytes > max_buffer_ ? memory_bytes - max_buffer_ : 0;
+            block_rows_ = std::max(MIN_BLOCK_ROWS, budget / (2 * row_bytes));
+            size_t needed = max_buffer_ + 2 * block_rows_ * row_bytes;
+            if (needed > memory_bytes)
+                std::cerr << "[WARNING] Streaming " << filename_ << " needs at least " << needed << " bytes ("
+                          << MIN_BLOCK_ROWS << "-row blocks), more than the " << memory_bytes
+                          << "-byte memory budget; using " << needed << "." << std::endl;
+        }
+    }
+
+    ~BlockReader() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+
+    bool is_open() const { return fd_ >= 0 && cols_ > 0; }
+    int cols() const { return cols_; }
+    size_t block_rows() const { return block_rows_; }
+
+    // Starts the next pass over the file (or over this reader's shard)
+    void rewind() {
+        next_row_ = cache_first_row_;
+        rows_read_ = 0;
+        rows_seen_ = 0;
+        dropped_ = 0;
+        first_malformed_ = MalformedRow();
+        begin_ = end_ = 0;
+        eof_ = false;
+        offset_ = data_start_;
+    }
+
+    // Fills up to block_rows() rows of a row- or column-major block of any
+    // scalar type; returns false once the file is exhausted
+    template <typename Features, typename Labels>
+    bool next_block(Eigen::PlainObjectBase<Features>& features, Eigen::PlainObjectBase<Labels>& labels) {
+        if (!is_open()) return false;
+        if (features.rows() != static_cast<Eigen::Index>(block_rows_) || features.cols() != cols_) {
+            features.resize(block_rows_, cols_);
+            labels.resize(block_rows_);
+        }
+
+        size_t rows = cache_dtype_ == DTYPE_FLOAT32 ? read_cache_rows<float>(features, labels)
+                    : cache_dtype_ == DTYPE_FLOAT64 ? read_cache_rows<double>(features, labels)
+                    : read_csv_rows(features, labels);
+        if (rows == 0) {
+            if (dropped_ > 0) report_malformed_rows(dropped_, first_malformed_);  // Once per pass
+            dropped_ = 0;
+            return false;
+        }
+        if (rows < block_rows_) {
+            features.conservativeResize(rows, cols_);
+            labels.conservativeResize(rows);
+        }
+        return true;
+    }
+
+private:
+    template <typename Scalar>
+    bool open_cache() {
+        std::string path = binary_cache_path(filename_);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        BinaryCacheHeader header;
+        if (::fstat(fd, &st) != 0 || ::pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+            !cache_header_matches<Scalar>(header, st.st_size, filename_, schema_)) {
+            ::close(fd);
+            return false;
+        }
+
+        fd_ = fd;
+        cache_dtype_ = header.dtype;
+        size_t rows;
+        shard_row_range(header.rows, schema_, cache_first_row_, rows);
+        cache_end_row_ = cache_first_row_ + rows;
+        next_row_ = cache_first_row_;
+        col_stride_ = header.col_stride;
+        if (schema_.feature_columns.empty()) {
+            for (uint32_t j = 0; j < header.cols; ++j) cache_columns_.push_back(j);
+        } else {
+            for (int column : schema_.feature_columns) cache_columns_.push_back(range_feature_index(column, schema_));
+        }
+        cols_ = cache_columns_.size();
+        ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        std::cout << "[INFO] Streaming from binary cache " << path << std::endl;
+        return true;
+    }
+
+    void open_csv(size_t buffer_bytes, size_t max_buffer_bytes) {
+        // Blocks are read by offset, which a compressed stream cannot do
+        if (compression_of(filename_) != COMPRESSION_NONE) {
+            std::cerr << "[ERROR] Streaming needs a binary cache or an uncompressed CSV; run convert_dataset on "
+                      << filename_ << " first." << std::endl;
+            return;
+        }
+        fd_ = ::open(filename_.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            std::cerr << "[ERROR] Could not open file: " << filename_ << std::endl;
+            return;
+        }
+        ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        buffer_.resize(std::max(buffer_bytes, MIN_BUFFER_BYTES));
+        max_buffer_ = std::max(max_buffer_bytes, buffer_.size());
+
+        // Skip the header and learn the column count from the first row
+        rewind();
+        if (schema_.has_header) {
+            const char* line = next_complete_line();
+            if (line) begin_ = line - buffer_.data();
+        }
+        data_start_ = offset_ - (end_ - begin_);
+        const char* line_end = next_complete_line();
+        if (line_end) {
+            plan_ = make_column_plan(buffer_.data() + begin_, line_end, schema_);
+            cols_ = plan_.feature_cols;
+        }
+
+        // Same newline-aligned byte range as shard_byte_range over the mapped file
+        struct stat st;
+        if (::fstat(fd_, &st) == 0) data_end_ = st.st_size;
+        if (schema_.shard_count > 1) {
+            off_t length = data_end_ - data_start_;
+            off_t body = data_start_;
+            data_end_ = align_to_line(body, body + length * (schema_.shard_index + 1) / schema_.shard_count);
+            data_start_ = align_to_line(body, body + length * schema_.shard_index / schema_.shard_count);
+        }
+        rewind();
+    }
+
+    // File offset of the first line start at or after offset
+    off_t align_to_line(off_t begin, off_t offset) {
+        if (offset <= begin) return offset;
+        char probe[4096];
+        off_t position = offset - 1;  // a line starts at offset when the byte before it is '\n'
+        while (true) {
+            ssize_t n = ::pread(fd_, probe, sizeof(probe), position);
+            if (n <= 0) return position;
+            const char* nl = static_cast<const char*>(std::memchr(probe, '\n', n));
+            if (nl) return position + (nl - probe) + 1;
+            position += n;
+        }
+    }
+
+    // Returns the end of the line starting at begin_, refilling the buffer as
+    // needed. Throws when the line would not fit in max_buffer_.
+    const char* next_complete_line() {
+        while (true) {
+            const char* begin = buffer_.data() + begin_;
+            const char* end = buffer_.data() + end_;
+            const char* nl = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+            if (nl) return nl + 1;
+            if (eof_) return end > begin ? end : nullptr;
+
+            // Slide the partial line to the front and read more
+            std::memmove(buffer_.data(), begin, end - begin);
+            end_ -= begin_;
+            begin_ = 0;
+            if (end_ == buffer_.size()) {  // a line longer than the buffer
+                if (buffer_.size() == max_buffer_)
+                    throw std::runtime_error("row at byte " + std::to_string(offset_ - static_cast<off_t>(end_)) +
+                                             " of " + filename_ + " is longer than the " +
+                                             std::to_string(max_buffer_) + "-byte line buffer, half the streaming memory budget"
+                                             " (no newline, or raise --memory-mb)");
+                buffer_.resize(std::min(buffer_.size() * 2, max_buffer_));
+            }
+            ssize_t n = ::pread(fd_, buffer_.data() + end_, buffer_.size() - end_, offset_);
+            if (n <= 0) eof_ = true;
+            else {
+                end_ += n;
+                offset_ += n;
+            }
+        }
+    }
+
+    template <typename Features, typename Labels>
+    size_t read_csv_rows(Eigen::PlainObjectBase<Features>& features, Eigen::PlainObjectBase<Labels>& labels) {
+        size_t rows = 0;
+        auto* base = features.data();
+        while (rows < block_rows_ && (schema_.max_rows == 0 || rows_read_ < schema_.max_rows)) {
+            off_t line_offset = offset_ - static_cast<off_t>(end_ - begin_);
+            if (line_offset >= data_end_) break;  // the next shard's first line
+            const char* line = buffer_.data() + begin_;
+            const char* line_end = next_complete_line();
+            if (!line_end) break;
+            line = buffer_.data() + begin_;  // the buffer may have moved
+            begin_ = line_end - buffer_.data();
+            if (is_blank_line(line, line_end)) continue;
+            rows_seen_++;
+            auto* row = Features::IsRowMajor ? base + rows * cols_ : base + rows;
+            size_t col_stride = Features::IsRowMajor ? 1 : block_rows_;
+            int bad_column = 0;
+            if (parse_row(line, line_end, plan_, row, col_stride, labels.data() + rows, &bad_column)) {
+                rows++;
+                rows_read_++;
+            } else if (dropped_++ == 0) {
+                first_malformed_ = {rows_seen_, bad_column};
+            }
+        }
+        return rows;
+    }
+
+    template <typename CacheScalar, typename Features, typename Labels>
+    size_t read_cache_rows(Eigen::PlainObjectBase<Features>& features, Eigen::PlainObjectBase<Labels>& labels) {
+        size_t rows = std::min(block_rows_, cache_end_row_ - std::min(cache_end_row_, next_row_));
+        if (rows == 0) return 0;
+
+        staging_.resize(rows * sizeof(CacheScalar));
+        const CacheScalar* values = reinterpret_cast<const CacheScalar*>(staging_.data());
+        auto read_column = [&](size_t offset) {
+            return ::pread(fd_, staging_.data(), rows * sizeof(CacheScalar), offset) ==
+                   static_cast<ssize_t>(rows * sizeof(CacheScalar));
+        };
+
+        size_t features_offset = cache_features_offset<CacheScalar>(col_stride_);
+        if (!read_column(BINARY_CACHE_ALIGNMENT + next_row_ * sizeof(CacheScalar))) return 0;
+        for (size_t i = 0; i < rows; ++i) labels(i) = values[i];
+        for (int j = 0; j < cols_; ++j) {
+            size_t column = cache_columns_[j];
+            if (!read_column(features_offset + (column * col_stride_ + next_row_) * sizeof(CacheScalar))) return 0;
+            for (size_t i = 0; i < rows; ++i) features(i, j) = values[i];
+        }
+        next_row_ += rows;
+        return rows;
+    }
+
+    std::string filename_;
+    DatasetSchema schema_;
+    int fd_ = -1;
+    int cols_ = 0;
+    size_t block_rows_ = MIN_BLOCK_ROWS;
+
+    // Binary cache source
+    uint32_t cache_dtype_ = 0;
+    size_t cache_first_row_ = 0, cache_end_row_ = 0;  // this reader's shard
+    size_t next_row_ = 0;
+    size_t col_stride_ = 0;
+    std::vector<int> cache_columns_;  // cache column behind each output column
+    std::vector<char> staging_;
+
+    // CSV source
+    ColumnPlan plan_;
+    std::vector<char> buffer_;
+    size_t max_buffer_ = 0;  // Half the memory budget; buffer_ never grows past it
+    size_t begin_ = 0, end_ = 0;
+    off_t offset_ = 0, data_start_ = 0, data_end_ = 0;  // data_* bound this reader's shard
+    size_t rows_read_ = 0;
+    size_t rows_seen_ = 0;  // Data rows of this pass, malformed ones included
+    size_t dropped_ = 0;    // Malformed rows of this pass, reported when it ends
+    MalformedRow first_malformed_;
+    bool eof_ = false;
+};
+
+// Row order for one block: shuffled within the block only, so no global
+// permutation over the whole dataset is needed
+inline std::vector<int> shuffled_window(int rows, std::mt19937& gen) {
+    std::vector<int> indices(rows);
+    std::iota(indices.begin(), indices.end(), 0);
+    std::shuffle(indices.begin(), indices.end(), gen);
+    return indices;
+}
@@ -0,0 +1,173 @@
+// Command-line options shared by the federated clients
+#pragma once
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <boost/asio.hpp>
+#include "csv_loader.cpp"
+#include "wire_protocol.cpp"
+
+const char* const DEFAULT_SERVER_HOST = "127.0.0.1";
+const unsigned short DEFAULT_SERVER_PORT = 8080;
+const char* const DEFAULT_SOCKET_PATH = "/tmp/federated.sock";  // Server --socket PATH
+const char* const DEFAULT_SHARED_MODEL = "federated_model";     // Server --shm NAME
+
+struct ClientOptions {
+    bool stream = false;      // --stream: train out-of-core from fixed-size row blocks (LR, LSVM, Linear Regression)
+    size_t memory_mb = 256;   // --memory-mb N: memory budget for streaming (CSV buffer and two blocks)
+    int shard_index = 0;      // --shard i/N (1-based on the command line): train on
+    int shard_count = 1;      // the i-th of N disjoint partitions of the dataset
+    std::string wire = "native";  // --wire native|fp16|bf16|int8: gradient/model encoding
+                                  // on the wire (LR, LSVM, Linear Regression, KernelSVM)
+    size_t top_k = 0;         // --top-k K: send only the K largest gradient coordinates, carrying the
+                              // rest to the next batch (LR, LSVM, Linear Regression; not with --wire)
+    std::string transport = "tcp";  // --transport tcp|unix|shm: TCP to 127.0.0.1:8080, the server's AF_UNIX
+                                    // socket, or that socket plus model replies through shared memory
+    std::string socket_path = DEFAULT_SOCKET_PATH;  // --socket PATH (unix, shm)
+    std::string shm_name = DEFAULT_SHARED_MODEL;    // --shm NAME (shm)
+    int virtual_clients = 1;  // --virtual-clients N: run N logical clients in this process, each on its own
+                              // 1/N of the rows, multiplexed over the connections (Naive Bayes)
+    int connections = 1;      // --connections C: spread the virtual clients over C connections
+    bool subscribe = false;   // --subscribe: send updates without waiting for replies; the server pushes
+                              // new models as they change (LR, LSVM, Linear Regression)
+    std::string compress = "none";  // --compress none|lz4|zstd|deflate: compress large payloads both ways,
+                                    // if the server has the codec too
+    int compression_level = 0;      // --compression-level N: 0 for the codec's default
+    uint64_t compress_above = DEFAULT_COMPRESS_ABOVE;  // --compress-above BYTES: leave smaller payloads as they are
+};
+
+inline ClientOptions parse_client_options(int argc, char* argv[]) {
+    ClientOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--stream") {
+            options.stream = true;
+        } else if (arg == "--memory-mb") {
+            options.memory_mb = std::stoul(value());
+        } else if (arg == "--shard") {
+            std::string shard = value();
+            size_t slash = shard.find('/');
+            if (slash == std::string::npos) throw std::invalid_argument("--shard expects i/N, got " + shard);
+            int index = std::stoi(shard.substr(0, slash));
+            int count = std::stoi(shard.substr(slash + 1));
+            if (count < 1 || index < 1 || index > count)
+                throw std::invalid_argument("--shard expects 1 <= i <= N, got " + shard);
+            options.shard_index = index - 1;
+            options.shard_count = count;
+        } else if (arg == "--wire") {
+            options.wire = value();
+            if (options.wire != "native" && options.wire != "fp16" && options.wire != "bf16" && options.wire != "int8")
+                throw std::invalid_argument("--wire expects native, fp16, bf16 or int8, got " + options.wire);
+        } else if (arg == "--top-k") {
+            options.top_k = std::stoul(value());
+        } else if (arg == "--transport") {
+            options.transport = value();
+            if (options.transport != "tcp" && options.transport != "unix" && options.transport != "shm")
+                throw std::invalid_argument("--transport expects tcp, unix or shm, got " + options.transport);
+        } else if (arg == "--socket") {
+            options.socket_path = value();
+        } else if (arg == "--shm") {
+            options.shm_name = value();
+        } else if (arg == "--subscribe") {
+            options.subscribe = true;
+        } else if (arg == "--virtual-clients") {
+            options.virtual_clients = std::stoi(value());
+            if (options.virtual_clients < 1) throw std::invalid_argument("--virtual-clients expects N >= 1");
+        } else if (arg == "--connections") {
+            options.connections = std::stoi(value());
+            if (options.connections < 1) throw std::invalid_argument("--connections expects C >= 1");
+        } else if (arg == "--compress") {
+            options.compress = value();
+            WireCodec codec = codec_from_name(options.compress);
+            if (!codec_available(codec))
+                throw std::invalid_argument("--compress " + options.compress + " needs a build with " +
+                                            codec_build_flags(codec));
+        } else if (arg == "--compression-level") {
+            options.compression_level = std::stoi(value());
+            if (options.compression_level < INT16_MIN || options.compression_level > INT16_MAX)
+                throw std::invalid_argument("--compression-level out of range: " + std::to_string(options.compression_level));
+        } else if (arg == "--compress-above") {
+            options.compress_above = std::stoull(value());
+            if (options.compress_above > UINT32_MAX)  // The handshake carries it in 32 bits
+                throw std::invalid_argument("--compress-above expects at most " + std::to_string(UINT32_MAX) + " bytes");
+        } else {
+            throw std::invalid_argument("unknown option " + arg +
+                                        " (expected --stream, --memory-mb N, --shard i/N, --wire ENCODING, --top-k K,"
+                                        " --transport tcp|unix|shm, --socket PATH, --shm NAME, --virtual-clients N,"
+                                        " --connections C, --subscribe, --compress CODEC, --compression-level N,"
+                                        " --compress-above BYTES)");
+        }
+    }
+    if (options.top_k > 0 && options.wire != "native")  // Sparse updates carry exact values
+        throw std::invalid_argument("--top-k cannot be combined with --wire " + options.wire);
+    if (options.connections > options.virtual_clients)
+        throw std::invalid_argument("--connections expects at most one connection per virtual client");
+    return options;
+}
+
+// Options only some clients implement, for reject_unsupported; the transport
+// and compression options work in every client
+enum ClientOption : unsigned {
+    OPTION_STREAM = 1 << 0,            // --stream, --memory-mb
+    OPTION_SHARD = 1 << 1,             // --shard
+    OPTION_WIRE = 1 << 2,              // --wire
+    OPTION_TOP_K = 1 << 3,             // --top-k
+    OPTION_SUBSCRIBE = 1 << 4,         // --subscribe
+    OPTION_VIRTUAL_CLIENTS = 1 << 5,   // --virtual-clients, --connections
+};
+
+// Stops a client given an option it does not implement (not in `supported`)
+// instead of letting it run as if the option were absent
+inline void reject_unsupported(const ClientOptions& options, unsigned supported, const std::string& client) {
+    auto check = [&](bool given, ClientOption option, const char* name) {
+        if (given && !(supported & option))
+            throw std::invalid_argument(std::string(name) + " is not supported by " + client);
+    };
+    check(options.stream, OPTION_STREAM, "--stream");
+    check(options.shard_count > 1, OPTION_SHARD, "--shard");
+    check(options.wire != "native", OPTION_WIRE, "--wire");
+    check(options.top_k > 0, OPTION_TOP_K, "--top-k");
+    check(options.subscribe, OPTION_SUBSCRIBE, "--subscribe");
+    check(options.virtual_clients > 1 || options.connections > 1, OPTION_VIRTUAL_CLIENTS, "--virtual-clients");
+}
+
+// The schema restricted to this client's shard
+inline DatasetSchema shard_of(DatasetSchema schema, const ClientOptions& options) {
+    schema.shard_index = options.shard_index;
+    schema.shard_count = options.shard_count;
+    if (options.shard_count > 1)
+        std::cout << "[INFO] Loading shard " << options.shard_index + 1 << "/" << options.shard_count << std::endl;
+    return schema;
+}
+
+// Connects to the server over the configured transport. Over shm, later
+// updates ask for model replies through the server's shared model ring. With
+// --compress, the connection opens with the codec handshake.
+inline FramedSocket connect_to_server(boost::asio::io_context& io_context, const ClientOptions& options) {
+    FramedSocket socket(io_context);
+    if (options.transport == "tcp") {
+        socket.connect(boost::asio::ip::tcp::endpoint(
+            boost::asio::ip::address::from_string(DEFAULT_SERVER_HOST), DEFAULT_SERVER_PORT));
+        set_no_delay(socket);
+    } else {
+        socket.connect(boost::asio::local::stream_protocol::endpoint(options.socket_path));
+        if (options.transport == "shm") shared_model_name() = options.shm_name;
+    }
+    WireCodec codec = codec_from_name(options.compress);
+    if (codec != CODEC_NONE) {
+        CompressionSettings agreed =
+            negotiate_compression(socket, codec, options.compression_level, options.compress_above);
+        if (agreed.codec == CODEC_NONE)
+            std::cout << "[INFO] Server has no " << options.compress << "; sending uncompressed." << std::endl;
+        else
+            std::cout << "[INFO] Compressing payloads of " << agreed.threshold << " bytes or more with "
+                      << codec_name(agreed.codec) << " (server level " << agreed.level << ")." << std::endl;
+    }
+    return socket;
+}
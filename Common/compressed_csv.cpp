@@ -0,0 +1,300 @@
+// Loads .csv.gz / .csv.zst files without a decompressed copy on disk: one
+// thread inflates fixed-size chunks while the caller parses the previous ones.
+// Build with -DFED_HAVE_ZLIB -lz for gzip and -DFED_HAVE_ZSTD -lzstd for zstd.
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <stdexcept>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <Eigen/Dense>
+#ifdef FED_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FED_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "csv_loader.cpp"
+#include "prefetcher.cpp"
+
+const size_t DECOMPRESS_INPUT_BYTES = 1 << 20;
+const size_t DECOMPRESS_CHUNK_BYTES = 4 << 20;
+const size_t DECOMPRESS_QUEUE_DEPTH = 4;
+
+enum Compression { COMPRESSION_NONE, COMPRESSION_GZIP, COMPRESSION_ZSTD };
+
+inline bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+inline Compression compression_of(const std::string& filename) {
+    if (ends_with(filename, ".gz")) return COMPRESSION_GZIP;
+    if (ends_with(filename, ".zst")) return COMPRESSION_ZSTD;
+    return COMPRESSION_NONE;
+}
+
+// Compressed bytes read with plain read() into a fixed buffer
+class CompressedFile {
+public:
+    explicit CompressedFile(const std::string& filename)
+        : filename_(filename), fd_(::open(filename.c_str(), O_RDONLY)), buffer_(DECOMPRESS_INPUT_BYTES) {}
+    ~CompressedFile() { if (fd_ >= 0) ::close(fd_); }
+
+    CompressedFile(const CompressedFile&) = delete;
+    CompressedFile& operator=(const CompressedFile&) = delete;
+
+    bool is_open() const { return fd_ >= 0; }
+    const std::string& filename() const { return filename_; }
+
+    // Next block of compressed input; empty at end of file
+    size_t read(const char*& data) {
+        ssize_t n = ::read(fd_, buffer_.data(), buffer_.size());
+        if (n < 0) throw std::runtime_error("read failed on " + filename_);
+        data = buffer_.data();
+        return static_cast<size_t>(n);
+    }
+
+private:
+    std::string filename_;
+    int fd_;
+    std::vector<char> buffer_;
+};
+
+#ifdef FED_HAVE_ZLIB
+// Inflates gzip (or zlib) input; concatenated members, as written by pigz
+// and bgzip, are read back to back
+class GzipSource {
+public:
+    explicit GzipSource(const std::string& filename) : file_(filename) {
+        std::memset(&stream_, 0, sizeof(stream_));
+        initialized_ = inflateInit2(&stream_, 15 + 32) == Z_OK;  // +32: detect the gzip/zlib header
+    }
+    ~GzipSource() { if (initialized_) inflateEnd(&stream_); }
+
+    bool is_open() const { return file_.is_open() && initialized_; }
+
+    // Fills chunk with up to DECOMPRESS_CHUNK_BYTES; false at the end of the stream
+    bool fill(std::string& chunk) {
+        chunk.resize(DECOMPRESS_CHUNK_BYTES);
+        size_t produced = 0;
+        while (produced < chunk.size()) {
+            if (stream_.avail_in == 0 && !eof_) {
+                const char* data;
+                size_t n = file_.read(data);
+                eof_ = n == 0;
+                stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+                stream_.avail_in = static_cast<uInt>(n);
+            }
+            if (stream_.avail_in == 0 && eof_) break;
+
+            stream_.next_out = reinterpret_cast<Bytef*>(&chunk[produced]);
+            stream_.avail_out = static_cast<uInt>(chunk.size() - produced);
+            int ret = inflate(&stream_, Z_NO_FLUSH);
+            produced = chunk.size() - stream_.avail_out;
+            in_member_ = true;
+            if (ret == Z_STREAM_END) {
+                inflateReset(&stream_);
+                in_member_ = false;
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                throw std::runtime_error("corrupt gzip data in " + file_.filename());
+            }
+        }
+        if (eof_ && in_member_ && produced == 0)
+            throw std::runtime_error("truncated gzip file " + file_.filename());
+        chunk.resize(produced);
+        return produced > 0;
+    }
+
+private:
+    CompressedFile file_;
+    z_stream stream_;
+    bool initialized_ = false;
+    bool eof_ = false;
+    bool in_member_ = false;
+};
+#endif
+
+#ifdef FED_HAVE_ZSTD
+// Decompresses zstd frames, one after another
+class ZstdSource {
+public:
+    explicit ZstdSource(const std::string& filename) : file_(filename), context_(ZSTD_createDCtx()) {}
+    ~ZstdSource() { ZSTD_freeDCtx(context_); }
+
+    bool is_open() const { return file_.is_open() && context_ != nullptr; }
+
+    // Fills chunk with up to DECOMPRESS_CHUNK_BYTES; false at the end of the stream
+    bool fill(std::string& chunk) {
+        chunk.resize(DECOMPRESS_CHUNK_BYTES);
+        ZSTD_outBuffer out = {&chunk[0], chunk.size(), 0};
+        while (out.pos < out.size) {
+            if (input_.pos == input_.size && !eof_) {
+                const char* data;
+                size_t n = file_.read(data);
+                eof_ = n == 0;
+                input_ = {data, n, 0};
+            }
+            if (input_.pos == input_.size && eof_) break;
+
+            size_t ret = ZSTD_decompressStream(context_, &out, &input_);
+            if (ZSTD_isError(ret))
+                throw std::runtime_error("corrupt zstd data in " + file_.filename() + ": " + ZSTD_getErrorName(ret));
+            in_frame_ = ret != 0;
+        }
+        if (eof_ && in_frame_ && out.pos == 0)
+            throw std::runtime_error("truncated zstd file " + file_.filename());
+        chunk.resize(out.pos);
+        return out.pos > 0;
+    }
+
+private:
+    CompressedFile file_;
+    ZSTD_DCtx* context_;
+    ZSTD_inBuffer input_ = {nullptr, 0, 0};
+    bool eof_ = false;
+    bool in_frame_ = false;
+};
+#endif
+
+// Fill function producing decompressed chunks of filename, or an empty
+// function (with the reason on stderr) when it cannot be read
+inline std::function<bool(std::string&)> open_decompressor(const std::string& filename) {
+    Compression compression = compression_of(filename);
+#ifdef FED_HAVE_ZLIB
+    if (compression == COMPRESSION_GZIP) {
+        auto source = std::make_shared<GzipSource>(filename);
+        if (!source->is_open()) {
+            std::cerr << "[ERROR] Could not open file: " << filename << std::endl;
+            return nullptr;
+        }
+        return [source](std::string& chunk) { return source->fill(chunk); };
+    }
+#endif
+#ifdef FED_HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD) {
+        auto source = std::make_shared<ZstdSource>(filename);
+        if (!source->is_open()) {
+            std::cerr << "[ERROR] Could not open file: " << filename << std::endl;
+            return nullptr;
+        }
+        return [source](std::string& chunk) { return source->fill(chunk); };
+    }
+#endif
+    std::cerr << "[ERROR] " << filename << " is " << (compression == COMPRESSION_GZIP ? "gzip" : "zstd")
+              << "-compressed; rebuild with " << (compression == COMPRESSION_GZIP ? "-DFED_HAVE_ZLIB -lz" : "-DFED_HAVE_ZSTD -lzstd")
+              << " or decompress it first." << std::endl;
+    return nullptr;
+}
+
+// Calls visit(line, line_end) for each line of a compressed CSV, in order, while
+// the next chunks are decompressed on the prefetch thread, until visit returns
+// false. Returns the number of decompressed bytes read, or -1 on error.
+template <typename Visit>
+long long for_each_compressed_line(const std::string& filename, Visit visit) {
+    auto decompress = open_decompressor(filename);
+    if (!decompress) return -1;
+
+    long long text_bytes = 0;
+    try {
+        Prefetcher<std::string> chunks("decompress", decompress, DECOMPRESS_QUEUE_DEPTH);
+        std::string chunk, partial;
+        bool more = true;
+        while (more && chunks.next(chunk)) {
+            text_bytes += chunk.size();
+            const char* p = chunk.data();
+            const char* end = p + chunk.size();
+
+            // Finish the line split across the previous chunk boundary
+            if (!partial.empty()) {
+                const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+                partial.append(p, nl ? nl + 1 : end);
+                if (!nl) continue;
+                more = visit(partial.data(), partial.data() + partial.size());
+                partial.clear();
+                p = nl + 1;
+            }
+            while (more && p < end) {
+                const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+                if (!nl) {
+                    partial.assign(p, end);
+                    break;
+                }
+                more = visit(p, nl + 1);
+                p = nl + 1;
+            }
+        }
+        if (more && !partial.empty()) visit(partial.data(), partial.data() + partial.size());
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        return -1;
+    }
+    return text_bytes;
+}
+
+// Loads a compressed CSV in two streaming passes, as scan_csv does for a plain
+// one: the first counts the data rows, the second parses the shard's rows
+// [i*rows/N, (i+1)*rows/N) straight into the destination, sized once, and
+// stops decompressing after the last of them.
+template <typename Features, typename Labels>
+bool load_compressed_csv(const std::string& filename, const DatasetSchema& schema,
+                         Eigen::PlainObjectBase<Features>& features, Eigen::PlainObjectBase<Labels>& labels) {
+    using Scalar = typename Features::Scalar;
+
+    // Pass 1: count the rows and take the column plan from the first one
+    ColumnPlan plan;
+    bool skip_header = schema.has_header;
+    size_t total = 0;
+    size_t row_limit = schema.shard_count <= 1 ? schema.max_rows : 0;
+    long long text_bytes = for_each_compressed_line(filename, [&](const char* line, const char* line_end) {
+        if (skip_header) {
+            skip_header = false;
+            return true;
+        }
+        if (is_blank_line(line, line_end)) return true;
+        if (total++ == 0) plan = make_column_plan(line, line_end, schema);
+        return row_limit == 0 || total < row_limit;
+    });
+    if (text_bytes < 0) return false;
+
+    size_t first, count;
+    shard_row_range(total, schema, first, count);
+    features.resize(count, plan.feature_cols);
+    labels.resize(count);
+
+    // Pass 2: parse rows [first, first + count); malformed ones are not kept
+    Scalar* base = features.data();
+    size_t cols = plan.feature_cols;
+    size_t rows_seen = 0, kept = 0, dropped = 0;
+    MalformedRow first_malformed;
+    skip_header = schema.has_header;
+    if (count > 0 && for_each_compressed_line(filename, [&](const char* line, const char* line_end) {
+            if (skip_header) {
+                skip_header = false;
+                return true;
+            }
+            if (is_blank_line(line, line_end)) return true;
+            if (rows_seen++ < first) return true;
+
+            Scalar* out = Features::IsRowMajor ? base + kept * cols : base + kept;
+            int bad_column = 0;
+            if (parse_row(line, line_end, plan, out, Features::IsRowMajor ? 1 : count,
+                          labels.data() + kept, &bad_column))
+                kept++;
+            else if (dropped++ == 0)
+                first_malformed = {rows_seen, bad_column};
+            return rows_seen < first + count;
+        }) < 0)
+        return false;
+
+    if (dropped > 0) report_malformed_rows(dropped, first_malformed);
+    std::cout << "[INFO] Decompressed " << (text_bytes >> 20) << " MB of CSV from " << filename << std::endl;
+    if (kept < count) {
+        features.conservativeResize(kept, cols);
+        labels.conservativeResize(kept);
+    }
+    return kept > 0;
+}
@@ -0,0 +1,65 @@
+// One-time CSV -> binary cache conversion; clients pick up <file>.bin automatically
+// g++ -O2 -std=c++17 convert_dataset.cpp -o convert_dataset -I /usr/include/eigen3 -pthread
+//
+//   ./convert_dataset ../Datasets/HIGGS.csv higgs
+//   ./convert_dataset ../Datasets/SUSY.csv susy
+//   ./convert_dataset ../Datasets/santander-customer-transaction-prediction.csv santander
+//   ./convert_dataset ../Datasets/Regression_1m_v3.csv regression
+//   ./convert_dataset ../Datasets/circles.csv circles
+//   ./convert_dataset ../Datasets/HIGGS.csv.gz higgs    (build with -DFED_HAVE_ZLIB -lz)
+// The cache precision follows the schema's dtype unless --float32/--float64 is given.
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <stdexcept>
+#include "datasets.cpp"
+
+const char* USAGE = " <file.csv[.gz|.zst]> <santander|higgs|susy|regression|circles> [--float32|--float64]";
+
+// Throws std::invalid_argument, with the usage line, on anything else
+DatasetSchema parse_convert_options(int argc, char* argv[]) {
+    DatasetSchema schema;
+    std::string usage = std::string("usage: ") + argv[0] + USAGE;
+    if (argc < 3) throw std::invalid_argument(usage);
+    if (!schema_by_name(argv[2], schema))
+        throw std::invalid_argument("unknown dataset " + std::string(argv[2]) + "; " + usage);
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--float32") schema.dtype = DTYPE_FLOAT32;
+        else if (arg == "--float64") schema.dtype = DTYPE_FLOAT64;
+        else throw std::invalid_argument("unknown option " + arg + "; " + usage);
+    }
+    return schema;
+}
+
+int main(int argc, char* argv[]) {
+    DatasetSchema schema;
+    try {
+        schema = parse_convert_options(argc, argv);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::string filename = argv[1];
+    bool float64 = schema.dtype == DTYPE_FLOAT64;
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = float64 ? write_binary_cache<double>(filename, schema)
+                      : write_binary_cache<float>(filename, schema);
+    if (!ok) return 1;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[INFO] Conversion took " << seconds << " s" << std::endl;
+
+    // Reopen to make sure clients will accept the file
+    start = std::chrono::steady_clock::now();
+    bool valid = float64 ? open_binary_cache<double>(filename, schema) != nullptr
+                         : open_binary_cache<float>(filename, schema) != nullptr;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!valid) {
+        std::cerr << "[ERROR] Written cache failed validation." << std::endl;
+        return 1;
+    }
+    std::cout << "[INFO] Cache reopens in " << seconds * 1000 << " ms" << std::endl;
+    return 0;
+}
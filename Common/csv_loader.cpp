@@ -0,0 +1,391 @@
+// Memory-mapped, multi-threaded CSV parser behind the schema-driven loader
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only mapping of a whole file, released on destruction
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename) {
+        fd_ = ::open(filename.c_str(), O_RDONLY);
+        if (fd_ < 0) return;
+
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 || st.st_size == 0) {
+            release();
+            return;
+        }
+
+        void* mapped = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+        if (mapped == MAP_FAILED) {
+            release();
+            return;
+        }
+        ::madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(mapped);
+        size_ = st.st_size;
+    }
+
+    ~MappedFile() { release(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const { return data_ != nullptr; }
+    const char* data() const { return data_; }
+    const char* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+
+private:
+    void release() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+        if (fd_ >= 0) ::close(fd_);
+        data_ = nullptr;
+        size_ = 0;
+        fd_ = -1;
+    }
+
+    int fd_ = -1;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+enum CacheDtype : uint32_t { DTYPE_FLOAT32 = 1, DTYPE_FLOAT64 = 2 };
+
+// Which columns of a row hold the label and the features.
+// The feature range (first_feature_column, num_feature_columns) is what the
+// binary cache stores; feature_columns optionally projects a subset of it, in
+// the given order, and every other column is skipped without being converted.
+struct DatasetSchema {
+    int label_column = 0;            // -1 when the file has no label
+    int first_feature_column = 1;    // features start here (the label column is skipped)
+    int num_feature_columns = -1;    // -1 keeps every column to the end of the row
+    std::vector<int> feature_columns;  // empty keeps the whole range
+    bool has_header = true;
+    CacheDtype dtype = DTYPE_FLOAT32;  // precision of the binary cache built for this file
+    size_t max_rows = 0;             // 0 loads the whole file (or the whole shard)
+    int shard_index = 0;             // load only partition shard_index of shard_count:
+    int shard_count = 1;             // a newline-aligned byte range, or a row range of the cache or a .gz/.zst CSV
+};
+
+// Per-column action for one row, built once from the schema and the field count
+const int COLUMN_SKIP = -1;
+const int COLUMN_LABEL = -2;
+
+struct ColumnPlan {
+    std::vector<int> slot;   // feature index, COLUMN_SKIP or COLUMN_LABEL
+    int last_column = -1;    // nothing past this column is looked at
+    int feature_cols = 0;
+    bool has_label = false;
+};
+
+// Result of the first pass: newline-aligned chunks and the rows in each
+struct CsvScan {
+    std::vector<const char*> chunk_begin;  // one extra entry marks the end
+    std::vector<size_t> chunk_first_row;   // prefix sum of rows per chunk
+    size_t rows = 0;
+    ColumnPlan plan;
+    int feature_cols = 0;
+};
+
+inline int loader_thread_count() {
+    int n = static_cast<int>(std::thread::hardware_concurrency());
+    return n > 0 ? n : 1;
+}
+
+inline const char* next_line(const char* p, const char* end) {
+    const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return nl ? nl + 1 : end;
+}
+
+// Moves p forward to the start of a line (p itself when it already is one)
+inline const char* align_to_line(const char* begin, const char* p, const char* end) {
+    if (p <= begin || p[-1] == '\n') return p;
+    return next_line(p, end);
+}
+
+// Cuts [begin, end) down to the schema's shard. Both ends are aligned the
+// same way, so every line belongs to exactly one shard.
+inline void shard_byte_range(const char*& begin, const char*& end, const DatasetSchema& schema) {
+    if (schema.shard_count <= 1) return;
+    size_t length = end - begin;
+    const char* shard_end = align_to_line(begin, begin + length * (schema.shard_index + 1) / schema.shard_count, end);
+    begin = align_to_line(begin, begin + length * schema.shard_index / schema.shard_count, end);
+    end = shard_end;
+}
+
+// Rows [first, first + count) of a table with total rows that fall in the
+// schema's shard, capped at max_rows
+inline void shard_row_range(size_t total, const DatasetSchema& schema, size_t& first, size_t& count) {
+    int shards = std::max(schema.shard_count, 1);
+    first = total * schema.shard_index / shards;
+    count = total * (schema.shard_index + 1) / shards - first;
+    if (schema.max_rows > 0) count = std::min(count, schema.max_rows);
+}
+
+// Lines holding only "\r" or nothing are not rows
+inline bool is_blank_line(const char* begin, const char* end) {
+    return end == begin || (end - begin == 1 && (*begin == '\n' || *begin == '\r')) ||
+           (end - begin == 2 && begin[0] == '\r' && begin[1] == '\n');
+}
+
+inline bool is_feature_column(int column, const DatasetSchema& schema) {
+    if (column == schema.label_column || column < schema.first_feature_column) return false;
+    return schema.num_feature_columns < 0 ||
+           column < schema.first_feature_column + schema.num_feature_columns;
+}
+
+// Position of a CSV column among the columns of the feature range (the binary
+// cache column index), or -1 when it is outside the range
+inline int range_feature_index(int column, const DatasetSchema& schema) {
+    if (!is_feature_column(column, schema)) return -1;
+    int index = column - schema.first_feature_column;
+    if (schema.label_column >= schema.first_feature_column && schema.label_column < column) index--;
+    return index;
+}
+
+// Checks that a projection lies inside the range and names each column once
+inline bool projection_is_valid(const DatasetSchema& schema) {
+    for (size_t k = 0; k < schema.feature_columns.size(); ++k) {
+        int column = schema.feature_columns[k];
+        if (range_feature_index(column, schema) < 0) {
+            std::cerr << "[ERROR] Column " << column << " is not in the feature range of the schema." << std::endl;
+            return false;
+        }
+        if (std::find(schema.feature_columns.begin(), schema.feature_columns.begin() + k, column) !=
+            schema.feature_columns.begin() + k) {
+            std::cerr << "[ERROR] Column " << column << " is projected twice." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+inline ColumnPlan make_column_plan(const DatasetSchema& schema, int fields) {
+    ColumnPlan plan;
+    plan.slot.assign(fields, COLUMN_SKIP);
+    if (schema.label_column >= 0 && schema.label_column < fields) {
+        plan.slot[schema.label_column] = COLUMN_LABEL;
+        plan.last_column = schema.label_column;
+    }
+    plan.has_label = schema.label_column >= 0;
+    if (schema.feature_columns.empty()) {
+        for (int c = 0; c < fields; ++c) {
+            if (!is_feature_column(c, schema)) continue;
+            plan.slot[c] = plan.feature_cols++;
+            plan.last_column = std::max(plan.last_column, c);
+        }
+    } else {
+        for (size_t k = 0; k < schema.feature_columns.size(); ++k) {
+            int c = schema.feature_columns[k];
+            if (c >= fields) continue;  // left missing, so every row is rejected as short
+            plan.slot[c] = static_cast<int>(k);
+            plan.last_column = std::max(plan.last_column, c);
+        }
+        plan.feature_cols = static_cast<int>(schema.feature_columns.size());
+    }
+    return plan;
+}
+
+// Builds the plan from the field count of the given (first data) line
+inline ColumnPlan make_column_plan(const char* line, const char* end, const DatasetSchema& schema) {
+    const char* line_end = next_line(line, end);
+    int fields = 1 + static_cast<int>(std::count(line, line_end, ','));
+    return make_column_plan(schema, fields);
+}
+
+// Pass 1: split the body into newline-aligned chunks and count rows per chunk
+inline CsvScan scan_csv(const char* begin, const char* end, const DatasetSchema& schema, int threads) {
+    CsvScan scan;
+    if (schema.has_header) begin = next_line(begin, end);
+    const char* first = begin;
+    while (first < end && is_blank_line(first, next_line(first, end))) first = next_line(first, end);
+    if (first >= end) return scan;
+
+    // The column plan always comes from the first row of the file, so every shard agrees on it
+    scan.plan = make_column_plan(first, end, schema);
+    scan.feature_cols = scan.plan.feature_cols;
+    shard_byte_range(begin, end, schema);
+    if (begin >= end) return scan;
+
+    // Tiny files are not worth a thread each
+    size_t length = end - begin;
+    threads = static_cast<int>(std::max<size_t>(1, std::min<size_t>(threads, length / (1 << 20) + 1)));
+
+    scan.chunk_begin.push_back(begin);
+    for (int t = 1; t < threads; ++t) {
+        const char* split = std::max(begin + length * t / threads, scan.chunk_begin.back());
+        scan.chunk_begin.push_back(next_line(split, end));
+    }
+    scan.chunk_begin.push_back(end);
+
+    std::vector<size_t> counts(threads, 0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            size_t rows = 0;
+            const char* p = scan.chunk_begin[t];
+            const char* chunk_end = scan.chunk_begin[t + 1];
+            while (p < chunk_end) {
+                const char* line_end = next_line(p, chunk_end);
+                if (!is_blank_line(p, line_end)) rows++;
+                p = line_end;
+            }
+            counts[t] = rows;
+        });
+    }
+    for (auto& w : workers) w.join();
+
+    scan.chunk_first_row.resize(threads + 1, 0);
+    for (int t = 0; t < threads; ++t)
+        scan.chunk_first_row[t + 1] = scan.chunk_first_row[t] + counts[t];
+    scan.rows = scan.chunk_first_row[threads];
+    if (schema.max_rows > 0) scan.rows = std::min(scan.rows, schema.max_rows);
+    return scan;
+}
+
+// Parses the whole field as a number; only spaces, tabs and quotes may
+// surround it, so "1.5abc" is rejected rather than read as 1.5
+template <typename T>
+inline bool parse_field(const char* begin, const char* end, T& value) {
+    while (begin < end && (*begin == ' ' || *begin == '\t' || *begin == '"')) ++begin;
+    if (begin < end && *begin == '+') ++begin;
+    auto result = std::from_chars(begin, end, value);
+    if (result.ec != std::errc()) return false;
+    const char* rest = result.ptr;
+    while (rest < end && (*rest == ' ' || *rest == '\t' || *rest == '"')) ++rest;
+    return rest == end;
+}
+
+// Parses one line into row[slot * col_stride]. Skipped columns are stepped
+// over with memchr and nothing after plan.last_column is read.
+// Returns false on a short or malformed row, setting *bad_column (if given)
+// to the 1-based column that is not a number, or 0 when columns are missing.
+template <typename Scalar, typename Label>
+inline bool parse_row(const char* p, const char* line_end, const ColumnPlan& plan,
+                      Scalar* row, size_t col_stride, Label* label, int* bad_column = nullptr) {
+    int column = 0;
+    int features = 0;
+    bool has_label = !plan.has_label;
+
+    while (p < line_end && column <= plan.last_column) {
+        int slot = column < static_cast<int>(plan.slot.size()) ? plan.slot[column] : COLUMN_SKIP;
+        const char* field_end;
+        if (slot == COLUMN_SKIP) {
+            field_end = static_cast<const char*>(std::memchr(p, ',', line_end - p));
+            if (!field_end) break;
+        } else {
+            field_end = p;
+            while (field_end < line_end && *field_end != ',' && *field_end != '\n' && *field_end != '\r') ++field_end;
+            if (slot == COLUMN_LABEL) {
+                double value;
+                if (!parse_field(p, field_end, value)) {
+                    if (bad_column) *bad_column = column + 1;
+                    return false;
+                }
+                *label = static_cast<Label>(value);
+                has_label = true;
+            } else {
+                Scalar value;
+                if (!parse_field(p, field_end, value)) {
+                    if (bad_column) *bad_column = column + 1;
+                    return false;
+                }
+                row[slot * col_stride] = value;
+                features++;
+            }
+        }
+
+        if (field_end >= line_end || *field_end != ',') break;
+        p = field_end + 1;
+        column++;
+    }
+    if (has_label && features == plan.feature_cols) return true;
+    if (bad_column) *bad_column = 0;
+    return false;
+}
+
+// Where the first malformed row of a load was: its 1-based data row (blank
+// lines and the header not counted) and parse_row's bad_column
+struct MalformedRow {
+    size_t row = 0;
+    int column = 0;
+};
+
+inline void report_malformed_rows(size_t dropped, const MalformedRow& first) {
+    std::cerr << "[WARNING] Skipped " << dropped << " malformed rows; the first is data row " << first.row;
+    if (first.column > 0) std::cerr << ", whose column " << first.column << " is not a number." << std::endl;
+    else std::cerr << ", which has too few columns." << std::endl;
+}
+
+// Pass 2: parse every chunk in parallel straight into the destination.
+// row_ptr(r) returns the address of feature 0 of row r; features of a row are
+// col_stride elements apart, so both row vectors and column-major matrices work.
+// Returns the number of rows kept after malformed rows are dropped.
+template <typename Scalar, typename Label, typename RowPtr>
+size_t parse_csv_chunks(const CsvScan& scan, RowPtr row_ptr,
+                        size_t col_stride, Label* labels) {
+    int threads = static_cast<int>(scan.chunk_begin.size()) - 1;
+    std::vector<size_t> kept(std::max(threads, 0), 0);
+    std::vector<MalformedRow> first_malformed(std::max(threads, 0));  // Per chunk; row 0 while none
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; ++t) {
+        if (scan.chunk_first_row[t] >= scan.rows) break;
+        workers.emplace_back([&, t]() {
+            size_t row = scan.chunk_first_row[t];
+            size_t limit = std::min(scan.chunk_first_row[t + 1], scan.rows) - row;
+            const char* p = scan.chunk_begin[t];
+            const char* chunk_end = scan.chunk_begin[t + 1];
+            size_t seen = 0, written = 0;
+            while (p < chunk_end && seen < limit) {
+                const char* line_end = next_line(p, chunk_end);
+                if (!is_blank_line(p, line_end)) {
+                    // A malformed row leaves its slot empty; compacted below
+                    Scalar* out = row_ptr(row + written);
+                    int bad_column = 0;
+                    if (parse_row(p, line_end, scan.plan, out, col_stride, labels + row + written, &bad_column))
+                        written++;
+                    else if (first_malformed[t].row == 0)
+                        first_malformed[t] = {row + seen + 1, bad_column};
+                    seen++;
+                }
+                p = line_end;
+            }
+            kept[t] = written;
+        });
+    }
+    for (auto& w : workers) w.join();
+
+    // Close the gaps left by malformed rows (rare, so done sequentially)
+    size_t dst = 0;
+    size_t dropped = 0;
+    MalformedRow first;
+    for (int t = 0; t < threads; ++t) {
+        size_t src = scan.chunk_first_row[t];
+        if (src >= scan.rows) break;
+        if (first.row == 0) first = first_malformed[t];
+        if (dst != src) {
+            for (size_t r = 0; r < kept[t]; ++r) {
+                Scalar* from = row_ptr(src + r);
+                Scalar* to = row_ptr(dst + r);
+                for (int c = 0; c < scan.feature_cols; ++c) to[c * col_stride] = from[c * col_stride];
+                labels[dst + r] = labels[src + r];
+            }
+        }
+        dropped += std::min(scan.chunk_first_row[t + 1], scan.rows) - src - kept[t];
+        dst += kept[t];
+    }
+    if (dropped > 0) report_malformed_rows(dropped, first);
+    return dst;
+}
@@ -0,0 +1,119 @@
+// Loads a dataset straight into contiguous Eigen storage, from the binary cache or the CSV
+#pragma once
+#include <iostream>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <Eigen/Dense>
+#include "binary_cache.cpp"
+#include "compressed_csv.cpp"
+
+// Copies a mapped cache into the destination with one vectorised cast per
+// column; a projection only touches the columns it names. Clients that can
+// train on the mapping itself use MappedDataset instead.
+template <typename CacheScalar, typename Features, typename Labels>
+bool load_matrix_from_cache(const std::string& filename, const DatasetSchema& schema,
+                            Eigen::PlainObjectBase<Features>& features, Eigen::PlainObjectBase<Labels>& labels) {
+    auto cache = open_binary_cache<CacheScalar>(filename, schema);
+    if (!cache) return false;
+
+    using Scalar = typename Features::Scalar;
+    if (schema.feature_columns.empty()) {
+        features = cache->features().template cast<Scalar>();
+    } else {
+        auto all = cache->features();
+        features.resize(cache->rows(), schema.feature_columns.size());
+        for (size_t k = 0; k < schema.feature_columns.size(); ++k)
+            features.col(k) = all.col(range_feature_index(schema.feature_columns[k], schema)).template cast<Scalar>();
+    }
+    labels = cache->labels().template cast<typename Labels::Scalar>();
+    std::cout << "[INFO] Using binary cache " << binary_cache_path(filename) << std::endl;
+    return true;
+}
+
+// Sizes the destination once and parses every row directly into it; works for
+// row- and column-major matrices of any scalar type. The cache in the schema's
+// dtype is tried first, then the other one, then the CSV (which may be .gz or .zst).
+template <typename Features, typename Labels>
+bool load_matrix(const std::string& filename, const DatasetSchema& schema,
+                 Eigen::PlainObjectBase<Features>& features, Eigen::PlainObjectBase<Labels>& labels) {
+    using Scalar = typename Features::Scalar;
+
+    if (!projection_is_valid(schema)) return false;
+    bool cached = schema.dtype == DTYPE_FLOAT64
+        ? load_matrix_from_cache<double>(filename, schema, features, labels) ||
+          load_matrix_from_cache<float>(filename, schema, features, labels)
+        : load_matrix_from_cache<float>(filename, schema, features, labels) ||
+          load_matrix_from_cache<double>(filename, schema, features, labels);
+    if (cached) return features.rows() > 0;
+    if (compression_of(filename) != COMPRESSION_NONE) return load_compressed_csv(filename, schema, features, labels);
+
+    MappedFile file(filename);
+    if (!file.is_open()) {
+        std::cerr << "[ERROR] Could not open file: " << filename << std::endl;
+        return false;
+    }
+
+    CsvScan scan = scan_csv(file.data(), file.end(), schema, loader_thread_count());
+    features.resize(scan.rows, scan.feature_cols);
+    labels.resize(scan.rows);
+
+    Scalar* base = features.data();
+    size_t rows = scan.rows;
+    size_t cols = scan.feature_cols;
+    size_t kept;
+    if (Features::IsRowMajor) {
+        kept = parse_csv_chunks<Scalar>(scan, [&](size_t r) { return base + r * cols; }, 1, labels.data());
+    } else {
+        kept = parse_csv_chunks<Scalar>(scan, [&](size_t r) { return base + r; }, rows, labels.data());
+    }
+
+    if (kept < rows) {
+        features.conservativeResize(kept, cols);
+        labels.conservativeResize(kept);
+    }
+    return kept > 0;
+}
+
+// Read-only views of training data that column-major clients train on in place
+template <typename Scalar>
+using FeaturesRef = Eigen::Ref<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>, 0, Eigen::OuterStride<>>;
+template <typename Scalar>
+using LabelsRef = Eigen::Ref<const Eigen::Matrix<Scalar, Eigen::Dynamic, 1>>;
+
+// A dataset trained on where it lies: when the binary cache holds Scalar and
+// no columns are projected, features() and labels() map the cache itself, so
+// every client on a host reads the one page-cache copy. Otherwise (another
+// dtype, a projection, or no cache) the data is loaded into matrices of its
+// own, as load_matrix does.
+template <typename Scalar>
+class MappedDataset {
+public:
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+    using Vector = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+    using FeatureMap = Eigen::Map<const Matrix, 0, Eigen::OuterStride<>>;
+    using LabelMap = Eigen::Map<const Vector>;
+
+    bool load(const std::string& filename, const DatasetSchema& schema) {
+        if (schema.feature_columns.empty()) cache_ = open_binary_cache<Scalar>(filename, schema);
+        if (cache_) {
+            std::cout << "[INFO] Training on binary cache " << binary_cache_path(filename) << " in place" << std::endl;
+            return cache_->rows() > 0;
+        }
+        return load_matrix(filename, schema, features_, labels_);
+    }
+
+    bool shared() const { return cache_ != nullptr; }
+
+    FeatureMap features() const {
+        if (cache_) return cache_->features();
+        return FeatureMap(features_.data(), features_.rows(), features_.cols(),
+                          Eigen::OuterStride<>(std::max<Eigen::Index>(features_.rows(), 1)));
+    }
+    LabelMap labels() const { return cache_ ? cache_->labels() : LabelMap(labels_.data(), labels_.size()); }
+
+private:
+    std::unique_ptr<BinaryDataset<Scalar>> cache_;  // Keeps the mapping alive
+    Matrix features_;
+    Vector labels_;
+};
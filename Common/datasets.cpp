@@ -0,0 +1,90 @@
+// Column schemas of the datasets under ../Datasets and the one load_data every client uses
+#pragma once
+#include <iostream>
+#include <string>
+#include <Eigen/Dense>
+#include "dataset_loader.cpp"
+
+// 'target' in column 1, var_0 .. var_199 in columns 2-201 (column 0 is ID_code)
+inline DatasetSchema santander_schema() {
+    DatasetSchema schema;
+    schema.label_column = 1;
+    schema.first_feature_column = 2;
+    return schema;
+}
+
+// Signal/background label in column 0, 28 features after it
+inline DatasetSchema higgs_schema() {
+    DatasetSchema schema;
+    schema.label_column = 0;
+    schema.first_feature_column = 1;
+    return schema;
+}
+
+// Same layout as HIGGS with 18 features
+inline DatasetSchema susy_schema() {
+    return higgs_schema();
+}
+
+// 30 features followed by the target in the last column; rows with too few
+// columns are skipped by the parser
+inline DatasetSchema regression_schema() {
+    DatasetSchema schema;
+    schema.label_column = 30;
+    schema.first_feature_column = 0;
+    schema.num_feature_columns = 30;
+    schema.dtype = DTYPE_FLOAT64;
+    return schema;
+}
+
+// 2-D points for KMeans: x is column 1 and y is column 0; no label
+inline DatasetSchema circles_schema() {
+    DatasetSchema schema;
+    schema.label_column = -1;
+    schema.first_feature_column = 0;
+    schema.num_feature_columns = 2;
+    schema.feature_columns = {1, 0};
+    return schema;
+}
+
+// Looks a schema up by name for the command-line tools
+inline bool schema_by_name(const std::string& name, DatasetSchema& schema) {
+    if (name == "santander") schema = santander_schema();
+    else if (name == "higgs") schema = higgs_schema();
+    else if (name == "susy") schema = susy_schema();
+    else if (name == "regression") schema = regression_schema();
+    else if (name == "circles") schema = circles_schema();
+    else return false;
+    return true;
+}
+
+// Function to load features and labels from the CSV file (or its binary cache);
+// .csv.gz and .csv.zst files are decompressed on the fly
+template <typename Features, typename Labels>
+void load_data(const std::string& filename, const DatasetSchema& schema,
+               Eigen::PlainObjectBase<Features>& features,
+               Eigen::PlainObjectBase<Labels>& labels) {
+    if (!load_matrix(filename, schema, features, labels)) return;
+
+    std::cout << "[INFO] Loaded " << features.rows()
+              << " samples with " << features.cols()
+              << " features each from " << filename << "." << std::endl;
+}
+
+// Into a MappedDataset, which maps a cache in the client's dtype rather than copying it
+template <typename Scalar>
+void load_data(const std::string& filename, const DatasetSchema& schema, MappedDataset<Scalar>& dataset) {
+    if (!dataset.load(filename, schema)) return;
+
+    std::cout << "[INFO] Loaded " << dataset.features().rows()
+              << " samples with " << dataset.features().cols()
+              << " features each from " << filename << "." << std::endl;
+}
+
+// Features only, for schemas without a label column
+template <typename Features>
+void load_data(const std::string& filename, const DatasetSchema& schema,
+               Eigen::PlainObjectBase<Features>& features) {
+    Eigen::Matrix<typename Features::Scalar, Eigen::Dynamic, 1> unused;
+    load_data(filename, schema, features, unused);
+}
@@ -0,0 +1,34 @@
+// Fixed-layout records for the tree and stump ensembles (RF, Adaboost). A
+// payload is an array of them sent as is (WIRE_TREE_RECORDS,
+// WIRE_STUMP_RECORDS), so the server appends and returns them in place,
+// without a conversion step. Every field is 4-byte aligned, so the receive
+// buffer can be used directly. A changed layout gets a new dtype, never an
+// edit to these.
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+// RF: one (feature, threshold, leaf label) split per tree
+struct TreeRecord {
+    int32_t feature_index;
+    float threshold;
+    uint8_t class_label;
+    uint8_t reserved[3] = {};
+};
+static_assert(sizeof(TreeRecord) == 12, "TreeRecord is sent as raw bytes");
+
+// Adaboost: one decision stump and its vote
+struct StumpRecord {
+    int32_t feature_index;
+    float threshold;  // See record_threshold
+    float alpha;
+};
+static_assert(sizeof(StumpRecord) == 12, "StumpRecord is sent as raw bytes");
+
+// The smallest float >= threshold. Float spacing stays under 1e-4 below
+// 1000 in magnitude, so for dataset values with four decimals `x <= threshold`
+// gives the same answer on every row as the double did.
+inline float record_threshold(double threshold) {
+    float rounded = static_cast<float>(threshold);
+    return rounded < threshold ? std::nextafter(rounded, INFINITY) : rounded;
+}
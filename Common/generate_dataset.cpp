@@ -0,0 +1,264 @@
+// Synthetic datasets with the column layouts of the files under ../Datasets,
+// so performance runs can be reproduced offline at any scale
+// g++ -O2 -std=c++17 generate_dataset.cpp -o generate_dataset -I /usr/include/eigen3 -pthread
+//
+//   ./generate_dataset higgs 1000000 ../Datasets/HIGGS.csv
+//   ./generate_dataset susy 1000000 ../Datasets/SUSY.csv
+//   ./generate_dataset santander 200000 ../Datasets/santander-customer-transaction-prediction.csv
+//   ./generate_dataset regression 1000000 ../Datasets/Regression_1m_v3.csv
+//   ./generate_dataset circles 10000 ../Datasets/circles.csv
+//   ./generate_dataset higgs 100000000 ../Datasets/HIGGS.csv --binary   (writes only HIGGS.csv.bin)
+//
+// Output depends only on the dataset, row count and --seed (default 42): every
+// chunk of rows has its own generator, so the thread count does not matter.
+// Values are rounded to float, so the CSV and the binary cache of one seed
+// hold the same float32 data.
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <charconv>
+#include "datasets.cpp"
+
+const size_t GENERATOR_CHUNK_ROWS = 65536;
+
+enum SyntheticKind { SYNTHETIC_HIGGS, SYNTHETIC_SUSY, SYNTHETIC_SANTANDER, SYNTHETIC_REGRESSION, SYNTHETIC_CIRCLES };
+
+struct SyntheticSpec {
+    SyntheticKind kind;
+    int features;
+    double positive_rate;  // P(label = 1) for the classification sets
+};
+
+bool spec_by_name(const std::string& name, SyntheticSpec& spec) {
+    if (name == "higgs") spec = {SYNTHETIC_HIGGS, 28, 0.53};
+    else if (name == "susy") spec = {SYNTHETIC_SUSY, 18, 0.46};
+    else if (name == "santander") spec = {SYNTHETIC_SANTANDER, 200, 0.10};
+    else if (name == "regression") spec = {SYNTHETIC_REGRESSION, 30, 0};
+    else if (name == "circles") spec = {SYNTHETIC_CIRCLES, 2, 0};
+    else return false;
+    return true;
+}
+
+// mt19937_64 plus our own uniform/normal transforms: the std:: distributions
+// are implementation-defined, and the output must not depend on the toolchain
+class SyntheticRng {
+public:
+    SyntheticRng(uint64_t seed, SyntheticKind kind, uint64_t chunk) {
+        std::seed_seq seq{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), static_cast<uint32_t>(kind),
+                          static_cast<uint32_t>(chunk), static_cast<uint32_t>(chunk >> 32)};
+        engine_.seed(seq);
+    }
+
+    double uniform() { return (engine_() >> 11) * 0x1.0p-53; }
+
+    double normal() {
+        if (has_spare_) {
+            has_spare_ = false;
+            return spare_;
+        }
+        double u1 = uniform(), u2 = uniform();
+        double r = std::sqrt(-2.0 * std::log(1.0 - u1));
+        spare_ = r * std::sin(2 * M_PI * u2);
+        has_spare_ = true;
+        return r * std::cos(2 * M_PI * u2);
+    }
+
+private:
+    std::mt19937_64 engine_;
+    double spare_ = 0;
+    bool has_spare_ = false;
+};
+
+// Fills one sample. Classes differ by a fixed per-feature shift, so the
+// classifiers have something to learn; the regression target is linear in
+// the features plus noise; circles are three noisy rings.
+void generate_sample(const SyntheticSpec& spec, SyntheticRng& rng, float& label, std::vector<float>& x) {
+    switch (spec.kind) {
+    case SYNTHETIC_HIGGS:
+    case SYNTHETIC_SUSY:
+    case SYNTHETIC_SANTANDER: {
+        label = rng.uniform() < spec.positive_rate ? 1.0f : 0.0f;
+        for (int j = 0; j < spec.features; ++j) {
+            double shift = label > 0 ? 0.5 * std::sin(j + 1.0) : 0.0;
+            x[j] = static_cast<float>(rng.normal() + shift);
+        }
+        break;
+    }
+    case SYNTHETIC_REGRESSION: {
+        double target = 0;
+        for (int j = 0; j < spec.features; ++j) {
+            x[j] = static_cast<float>(rng.normal() * (1 + j % 5));
+            target += x[j] / (j + 1.0);
+        }
+        label = static_cast<float>(target + 0.1 * rng.normal());
+        break;
+    }
+    case SYNTHETIC_CIRCLES: {
+        int ring = static_cast<int>(rng.uniform() * 3);
+        double radius = 1 + 2 * ring + 0.1 * rng.normal();
+        double angle = 2 * M_PI * rng.uniform();
+        x[0] = static_cast<float>(radius * std::sin(angle));  // column 0 is y
+        x[1] = static_cast<float>(radius * std::cos(angle));  // column 1 is x
+        label = 0;
+        break;
+    }
+    }
+}
+
+// Calls sink(row, label, x) for rows [first_row, first_row + rows) of chunk
+template <typename Sink>
+void generate_chunk(const SyntheticSpec& spec, uint64_t seed, size_t chunk, size_t first_row, size_t rows, Sink sink) {
+    SyntheticRng rng(seed, spec.kind, chunk);
+    std::vector<float> x(spec.features);
+    float label;
+    for (size_t r = 0; r < rows; ++r) {
+        generate_sample(spec, rng, label, x);
+        sink(first_row + r, label, x);
+    }
+}
+
+// Runs work(chunk, first_row, rows) for every chunk, `threads` chunks at a
+// time, and after(chunk) for each chunk of a round in order
+template <typename Work, typename After>
+void for_each_chunk(size_t total_rows, int threads, Work work, After after) {
+    size_t chunks = (total_rows + GENERATOR_CHUNK_ROWS - 1) / GENERATOR_CHUNK_ROWS;
+    for (size_t round = 0; round < chunks; round += threads) {
+        size_t end = std::min(chunks, round + threads);
+        std::vector<std::thread> workers;
+        for (size_t c = round; c < end; ++c) {
+            workers.emplace_back([&, c]() {
+                size_t first = c * GENERATOR_CHUNK_ROWS;
+                work(c, first, std::min(GENERATOR_CHUNK_ROWS, total_rows - first));
+            });
+        }
+        for (auto& w : workers) w.join();
+        for (size_t c = round; c < end; ++c) after(c);
+    }
+}
+
+void append_number(std::string& out, float value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+std::string csv_header(const SyntheticSpec& spec) {
+    std::string header;
+    auto features = [&](const std::string& prefix) {
+        for (int j = 0; j < spec.features; ++j) header += (j ? "," : "") + prefix + std::to_string(j);
+    };
+    switch (spec.kind) {
+    case SYNTHETIC_HIGGS:
+    case SYNTHETIC_SUSY: header = "label,"; features("f"); break;
+    case SYNTHETIC_SANTANDER: header = "ID_code,target,"; features("var_"); break;
+    case SYNTHETIC_REGRESSION: features("x"); header += ",target"; break;
+    case SYNTHETIC_CIRCLES: header = "y,x"; break;
+    }
+    return header + "\n";
+}
+
+// One CSV line in the column order of the matching schema in datasets.cpp
+void append_csv_row(const SyntheticSpec& spec, size_t row, float label, const std::vector<float>& x, std::string& out) {
+    if (spec.kind == SYNTHETIC_SANTANDER) out += "train_" + std::to_string(row) + ",";
+    bool label_first = spec.kind != SYNTHETIC_REGRESSION && spec.kind != SYNTHETIC_CIRCLES;
+    if (label_first) {
+        append_number(out, label);
+        out += ',';
+    }
+    for (int j = 0; j < spec.features; ++j) {
+        if (j) out += ',';
+        append_number(out, x[j]);
+    }
+    if (spec.kind == SYNTHETIC_REGRESSION) {
+        out += ',';
+        append_number(out, label);
+    }
+    out += '\n';
+}
+
+bool write_csv(const SyntheticSpec& spec, size_t rows, uint64_t seed, const std::string& filename) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "[ERROR] Could not create file: " << filename << std::endl;
+        return false;
+    }
+    file << csv_header(spec);
+
+    int threads = loader_thread_count();
+    std::vector<std::string> text(threads);
+    for_each_chunk(rows, threads,
+        [&](size_t chunk, size_t first, size_t count) {
+            std::string& out = text[chunk % threads];
+            out.clear();
+            generate_chunk(spec, seed, chunk, first, count, [&](size_t row, float label, const std::vector<float>& x) {
+                append_csv_row(spec, row, label, x, out);
+            });
+        },
+        [&](size_t chunk) { file.write(text[chunk % threads].data(), text[chunk % threads].size()); });
+
+    if (!file) {
+        std::cerr << "[ERROR] Write failed: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Writes <filename>.bin directly, in the cache layout load_data picks up
+template <typename Scalar>
+bool write_binary(const SyntheticSpec& spec, const DatasetSchema& schema, size_t rows, uint64_t seed,
+                  const std::string& filename) {
+    return write_cache_file<Scalar>(filename, schema, rows, spec.features,
+        [&](Scalar* labels, Scalar* features, size_t col_stride) {
+            for_each_chunk(rows, loader_thread_count(),
+                [&](size_t chunk, size_t first, size_t count) {
+                    generate_chunk(spec, seed, chunk, first, count, [&](size_t row, float label, const std::vector<float>& x) {
+                        labels[row] = label;
+                        for (int j = 0; j < spec.features; ++j) features[j * col_stride + row] = x[j];
+                    });
+                },
+                [](size_t) {});
+            return rows;
+        });
+}
+
+int main(int argc, char* argv[]) {
+    SyntheticSpec spec;
+    DatasetSchema schema;
+    if (argc < 4 || !spec_by_name(argv[1], spec) || !schema_by_name(argv[1], schema)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <santander|higgs|susy|regression|circles> <rows> <file.csv>"
+                  << " [--seed N] [--binary [--float32|--float64]]" << std::endl;
+        return 1;
+    }
+
+    size_t rows = std::stoull(argv[2]);
+    std::string filename = argv[3];
+    uint64_t seed = 42;
+    bool binary = false;
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) seed = std::stoull(argv[++i]);
+        else if (arg == "--binary") binary = true;
+        else if (arg == "--float32") schema.dtype = DTYPE_FLOAT32;
+        else if (arg == "--float64") schema.dtype = DTYPE_FLOAT64;
+        else {
+            std::cerr << "[ERROR] Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = !binary ? write_csv(spec, rows, seed, filename)
+            : schema.dtype == DTYPE_FLOAT64 ? write_binary<double>(spec, schema, rows, seed, filename)
+                                            : write_binary<float>(spec, schema, rows, seed, filename);
+    if (!ok) return 1;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[INFO] Generated " << rows << " " << argv[1] << " rows (seed " << seed << ") into "
+              << (binary ? binary_cache_path(filename) : filename) << " in " << seconds << " s" << std::endl;
+    return 0;
+}
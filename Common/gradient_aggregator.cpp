@@ -0,0 +1,112 @@
+// Running gradient totals for the gradient-descent servers (Linear and
+// Logistic Regression, LSVM). Each worker thread adds its batch gradients into
+// its own shard, behind that shard's lock, so concurrent updates scale and do
+// not wait on the model; drain() sums the shards when the model is published,
+// and skips the shards nothing was added to without locking them.
+// add_averaged() divides each gradient by a running count of data points as of
+// its own add, as the servers' per-update step did, so an update costs the same
+// on the millionth call as on the first and memory stays one vector per shard.
+// Those steps do not depend on the weights, so a drain that takes several
+// applies exactly the steps they would have taken one by one, in add order.
+#pragma once
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <cstdint>
+#include <Eigen/Dense>
+
+template <typename T>
+class GradientAggregator {
+public:
+    using Vector = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+
+    explicit GradientAggregator(size_t shards = std::max(1u, std::thread::hardware_concurrency()))
+        : shards_(new Shard[shards]), shard_count_(shards) {}
+
+    // Adds gradient, weighted by the batch_size points it was computed over, to
+    // the calling thread's shard. Throws if its size differs from the first gradient's.
+    template <typename Derived>
+    void add(const Eigen::MatrixBase<Derived>& gradient, int batch_size) {
+        check_size(gradient.size());
+        accumulate(gradient, static_cast<T>(batch_size));
+    }
+
+    // Adds gradient weighted by batch_size over the data points of every
+    // gradient added so far, this one included: the step the servers took
+    // for each update on its own
+    template <typename Derived>
+    void add_averaged(const Eigen::MatrixBase<Derived>& gradient, int batch_size) {
+        check_size(gradient.size());
+        int64_t points = points_.fetch_add(batch_size) + batch_size;
+        accumulate(gradient, static_cast<T>(batch_size) / static_cast<T>(points));
+    }
+
+    // Gradients were added since the last drain; a step has something to apply
+    bool pending() const { return pending_.load() != 0; }
+
+    // Sets sum to the weighted gradients added since the last drain and clears
+    // them. Returns false, with sum untouched, when there were none: a
+    // concurrent drain already took them. Callers serialize drains under the
+    // model's lock.
+    bool drain(Vector& sum) {
+        if (pending_.exchange(0) == 0) return false;  // Nothing added since the last drain
+        bool drained = false;
+        for (size_t i = 0; i < shard_count_; ++i) {
+            Shard& shard = shards_[i];
+            if (!shard.pending.load()) continue;
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (!shard.pending.load()) continue;
+            if (drained) {
+                sum += shard.sum;
+            } else {
+                sum = shard.sum;
+                drained = true;
+            }
+            shard.sum.setZero();
+            shard.pending.store(false);
+        }
+        return drained;
+    }
+
+private:
+    // Throws if size differs from the first gradient's
+    void check_size(Eigen::Index size) {
+        Eigen::Index expected = 0;
+        if (!size_.compare_exchange_strong(expected, size) && expected != size)
+            throw std::invalid_argument("gradient of " + std::to_string(size) + " values, expected " +
+                                        std::to_string(expected));
+    }
+
+    template <typename Derived>
+    void accumulate(const Eigen::MatrixBase<Derived>& gradient, T weight) {
+        Shard& shard = shards_[thread_slot() % shard_count_];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.sum.size() == 0) shard.sum = Vector::Zero(gradient.size());
+        shard.sum += gradient.template cast<T>() * weight;
+        shard.pending.store(true);
+        pending_.fetch_add(1);
+    }
+
+    // Threads take shards round robin on their first add
+    static size_t thread_slot() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t slot = next.fetch_add(1, std::memory_order_relaxed);
+        return slot;
+    }
+
+    struct alignas(64) Shard {  // A cache line apart, so neighbouring shards' locks do not share one
+        std::mutex mutex;
+        Vector sum;
+        std::atomic<bool> pending{false};  // Something was added since the last drain; set under mutex
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    size_t shard_count_;
+    std::atomic<Eigen::Index> size_{0};  // Of every gradient, fixed by the first
+    std::atomic<int64_t> pending_{0};    // Adds since the last drain
+    std::atomic<int64_t> points_{0};     // Data points of every gradient added
+};
@@ -0,0 +1,62 @@
+// Version stamps for the model a server broadcasts. Each published model gets
+// the next version number, and every coordinate records the version that last
+// changed it. A connection that remembers the version it last received can
+// then be sent only the coordinates stamped after it.
+// Memory is one snapshot plus one stamp per coordinate, shared by all connections.
+#pragma once
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <Eigen/Dense>
+#include "wire_protocol.cpp"
+
+template <typename T>
+class ModelVersions {
+public:
+    // Publishes model (rows x cols values) as the newest version and fills
+    // indices/values with the coordinates that changed after version `since`.
+    // Sets full when a whole snapshot is needed or is no larger than the delta:
+    // the first reply (since == 0), a reshaped model, or too many changes.
+    // Returns the new version, which the caller records for its connection.
+    uint64_t publish(const T* model, Eigen::Index rows, Eigen::Index cols, uint64_t since,
+                     std::vector<uint32_t>& indices, std::vector<T>& values, bool& full) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t n = static_cast<size_t>(rows) * cols;
+        ++version_;
+        if (rows != rows_ || cols != cols_) {
+            snapshot_.assign(model, model + n);
+            stamps_.assign(n, version_);
+            rows_ = rows;
+            cols_ = cols;
+            reshaped_at_ = version_;
+        }
+
+        indices.clear();
+        values.clear();
+        full = since == 0 || since < reshaped_at_;
+        size_t max_pairs = payload_bytes(wire_dtype<T>(), n) / sparse_entry_bytes(delta_dtype<T>());
+        for (size_t i = 0; i < n; ++i) {
+            if (snapshot_[i] != model[i]) {
+                snapshot_[i] = model[i];
+                stamps_[i] = version_;
+            }
+            if (!full && stamps_[i] > since) {
+                if (indices.size() == max_pairs) {
+                    full = true;
+                    continue;
+                }
+                indices.push_back(static_cast<uint32_t>(i));
+                values.push_back(snapshot_[i]);
+            }
+        }
+        return version_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<T> snapshot_;         // The newest model
+    std::vector<uint64_t> stamps_;    // Version that last changed each coordinate
+    Eigen::Index rows_ = -1, cols_ = -1;
+    uint64_t version_ = 0;
+    uint64_t reshaped_at_ = 0;        // Connections older than this have a base of the wrong shape
+};
@@ -0,0 +1,234 @@
+// Background batch prefetching: a producer thread prepares batch t+1 (reading a
+// block, gathering shuffled rows) while the caller computes on batch t
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <utility>
+#include <Eigen/Dense>
+#include "scalar.cpp"
+
+// Bounded single-producer/single-consumer ring; lock-free, one slot kept empty
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slots_(capacity + 1) {}
+
+    bool push(const T& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % slots_.size();
+        if (next == head_.load(std::memory_order_acquire)) return false;
+        slots_[tail] = value;
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return false;
+        value = slots_[head];
+        head_.store((head + 1) % slots_.size(), std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> slots_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// Spins briefly, then yields, then sleeps, so an idle side does not hold the core
+class Backoff {
+public:
+    void pause() {
+        ++spins_;
+        if (spins_ < 64) return;
+        if (spins_ < 128) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+private:
+    int spins_ = 0;
+};
+
+// Rows and labels of one minibatch or block
+template <typename Matrix, typename Vector>
+struct SampleBatch {
+    Matrix features;
+    Vector labels;
+};
+
+using RowBatch = SampleBatch<RowMatrixXs, VectorXs>;
+
+// Runs fill(batch) on its own thread into `depth` recycled slots; next() swaps
+// a ready slot with the caller's batch (no copy) and hands the old buffer back
+// to the producer. fill returns false when there is nothing left. On
+// destruction it logs how long the compute thread waited for data.
+template <typename Batch>
+class Prefetcher {
+public:
+    using Fill = std::function<bool(Batch&)>;
+    using Prepare = std::function<void(Batch&)>;  // For fill functions that transform what they read
+
+    Prefetcher(const std::string& name, Fill fill, size_t depth = 2)
+        : name_(name), fill_(std::move(fill)), slots_(depth), ready_(depth), free_(depth),
+          start_(std::chrono::steady_clock::now()) {
+        for (auto& slot : slots_) free_.push(&slot);
+        producer_ = std::thread([this] { run(); });
+    }
+
+    ~Prefetcher() {
+        stop_.store(true, std::memory_order_release);
+        producer_.join();
+        report();
+    }
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    // Blocks until the next batch is ready; false once fill is exhausted.
+    // An exception thrown by fill is rethrown here.
+    bool next(Batch& batch) {
+        Batch* slot = nullptr;
+        if (!ready_.pop(slot)) {
+            auto wait_start = std::chrono::steady_clock::now();
+            Backoff backoff;
+            bool ended = false;
+            while (!ready_.pop(slot)) {
+                if (done_.load(std::memory_order_acquire)) {
+                    // The producer pushes before it finishes, so one more pop settles it
+                    ended = !ready_.pop(slot);
+                    break;
+                }
+                backoff.pause();
+            }
+            wait_seconds_ += seconds_since(wait_start);
+            ++stalls_;
+            if (ended) {
+                if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+                return false;
+            }
+        }
+        std::swap(batch, *slot);
+        free_.push(slot);
+        ++batches_;
+        return true;
+    }
+
+    double wait_seconds() const { return wait_seconds_; }
+
+private:
+    static double seconds_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void run() {
+        try {
+            Batch* slot = nullptr;
+            while (!stop_.load(std::memory_order_acquire)) {
+                Backoff backoff;
+                while (!free_.pop(slot)) {
+                    if (stop_.load(std::memory_order_acquire)) return finish();
+                    backoff.pause();
+                }
+                auto fill_start = std::chrono::steady_clock::now();
+                bool more = fill_(*slot);
+                fill_seconds_ += seconds_since(fill_start);
+                if (!more) break;
+                ready_.push(slot);
+            }
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+        finish();
+    }
+
+    void finish() { done_.store(true, std::memory_order_release); }
+
+    void report() const {
+        if (batches_ == 0) return;
+        double total = seconds_since(start_);
+        std::cout << "[INFO] Prefetch (" << name_ << "): " << batches_ << " batches, compute thread waited "
+                  << wait_seconds_ << " s of " << total << " s (" << (total > 0 ? 100 * wait_seconds_ / total : 0)
+                  << "%) in " << stalls_ << " stalls; producer busy " << fill_seconds_ << " s" << std::endl;
+    }
+
+    std::string name_;
+    Fill fill_;
+    std::vector<Batch> slots_;
+    SpscQueue<Batch*> ready_;
+    SpscQueue<Batch*> free_;
+    std::thread producer_;
+    std::atomic<bool> stop_{false};
+    std::atomic<bool> done_{false};
+    std::exception_ptr error_;
+    std::chrono::steady_clock::time_point start_;
+    // Consumer side
+    double wait_seconds_ = 0;
+    size_t stalls_ = 0;
+    size_t batches_ = 0;
+    // Producer side, read after join
+    double fill_seconds_ = 0;
+};
+
+// Fill function gathering data.row(indices[i]) into consecutive batches of batch_size rows;
+// data may be a matrix or a view of one (a mapped cache), the batches hold their own copies
+template <typename Features, typename Labels, typename Batch = SampleBatch<typename Features::PlainObject,
+                                                                          typename Labels::PlainObject>>
+std::function<bool(Batch&)> gather_batches(const Features& data, const Labels& labels,
+                                           const std::vector<int>& indices, int batch_size) {
+    size_t next = 0;
+    return [&data, &labels, &indices, batch_size, next](Batch& batch) mutable {
+        if (next >= indices.size()) return false;
+        int rows = static_cast<int>(std::min<size_t>(batch_size, indices.size() - next));
+        batch.features.resize(rows, data.cols());
+        batch.labels.resize(rows);
+        for (int j = 0; j < rows; ++j) {
+            batch.features.row(j) = data.row(indices[next + j]);
+            batch.labels(j) = labels(indices[next + j]);
+        }
+        next += rows;
+        return true;
+    };
+}
+
+// Fill function reading successive blocks from a BlockReader. With depth 1 the
+// caller's block plus one slot is the two blocks BlockReader budgets for.
+template <typename Reader, typename Batch = RowBatch>
+std::function<bool(Batch&)> read_blocks(Reader& reader) {
+    return [&reader](Batch& batch) { return reader.next_block(batch.features, batch.labels); };
+}
+
+// Fill function gathering minibatches of batch_size rows from the blocks
+// another Prefetcher yields, each block visited in order(rows) order after
+// prepare(block), if given. The next block is taken when one runs out, so a
+// single minibatch Prefetcher serves a whole streamed epoch.
+template <typename Batch = RowBatch>
+std::function<bool(Batch&)> gather_block_batches(Prefetcher<Batch>& blocks,
+                                                 std::function<std::vector<int>(int rows)> order, int batch_size,
+                                                 typename Prefetcher<Batch>::Prepare prepare = nullptr) {
+    return [&blocks, order = std::move(order), prepare = std::move(prepare), batch_size, block = Batch(),
+            indices = std::vector<int>(), next = size_t(0)](Batch& batch) mutable {
+        while (next >= indices.size()) {
+            if (!blocks.next(block)) return false;
+            if (prepare) prepare(block);
+            indices = order(block.features.rows());
+            next = 0;
+        }
+        int rows = static_cast<int>(std::min<size_t>(batch_size, indices.size() - next));
+        batch.features.resize(rows, block.features.cols());
+        batch.labels.resize(rows);
+        for (int j = 0; j < rows; ++j) {
+            batch.features.row(j) = block.features.row(indices[next + j]);
+            batch.labels(j) = block.labels(indices[next + j]);
+        }
+        next += rows;
+        return true;
+    };
+}
@@ -0,0 +1,135 @@
+// Lossy payload codecs for the wire: IEEE half (fp16), bfloat16, and 8-bit
+// integers with one float32 scale per block of WIRE_INT8_BLOCK_SIZE elements.
+// Conversions round to nearest even; the aggregates they feed stay in full precision.
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+const size_t WIRE_INT8_BLOCK_SIZE = 64;
+
+inline uint32_t float_bits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float bits_float(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline uint16_t float_to_half(float value) {
+    uint32_t x = float_bits(value);
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t mantissa = x & 0x7fffff;
+    int exponent = static_cast<int>((x >> 23) & 0xff);
+
+    if (exponent == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0);  // Inf, NaN
+    exponent += 15 - 127;
+    if (exponent >= 0x1f) return sign | 0x7c00;  // Overflow to Inf
+
+    uint32_t shift = 13;
+    if (exponent <= 0) {
+        // Subnormal half: shift the explicit leading bit into the mantissa
+        if (exponent < -10) return sign;
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        exponent = 0;
+    }
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> shift);
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) half++;  // A carry rolls into the exponent correctly
+    return static_cast<uint16_t>(half);
+}
+
+inline float half_to_float(uint16_t half) {
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+
+    if (exponent == 0x1f) return bits_float(sign | 0x7f800000 | (mantissa << 13));
+    if (exponent == 0) {
+        if (mantissa == 0) return bits_float(sign);
+        // Subnormal: renormalize
+        exponent = 113;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        return bits_float(sign | (exponent << 23) | ((mantissa & 0x3ff) << 13));
+    }
+    return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+inline uint16_t float_to_bfloat16(float value) {
+    uint32_t x = float_bits(value);
+    if ((x & 0x7fffffff) > 0x7f800000) return static_cast<uint16_t>((x >> 16) | 0x40);  // Keep NaN a NaN
+    x += 0x7fff + ((x >> 16) & 1);
+    return static_cast<uint16_t>(x >> 16);
+}
+
+inline float bfloat16_to_float(uint16_t value) {
+    return bits_float(static_cast<uint32_t>(value) << 16);
+}
+
+inline size_t int8_block_bytes(size_t elements) {
+    size_t blocks = (elements + WIRE_INT8_BLOCK_SIZE - 1) / WIRE_INT8_BLOCK_SIZE;
+    return blocks * sizeof(float) + elements;
+}
+
+template <typename T>
+void encode_half(const T* data, size_t n, uint8_t* out) {
+    uint16_t* halves = reinterpret_cast<uint16_t*>(out);
+    for (size_t i = 0; i < n; ++i) halves[i] = float_to_half(static_cast<float>(data[i]));
+}
+
+template <typename T>
+void decode_half(const uint8_t* in, size_t n, T* data) {
+    const uint16_t* halves = reinterpret_cast<const uint16_t*>(in);
+    for (size_t i = 0; i < n; ++i) data[i] = static_cast<T>(half_to_float(halves[i]));
+}
+
+template <typename T>
+void encode_bfloat16(const T* data, size_t n, uint8_t* out) {
+    uint16_t* values = reinterpret_cast<uint16_t*>(out);
+    for (size_t i = 0; i < n; ++i) values[i] = float_to_bfloat16(static_cast<float>(data[i]));
+}
+
+template <typename T>
+void decode_bfloat16(const uint8_t* in, size_t n, T* data) {
+    const uint16_t* values = reinterpret_cast<const uint16_t*>(in);
+    for (size_t i = 0; i < n; ++i) data[i] = static_cast<T>(bfloat16_to_float(values[i]));
+}
+
+// Layout: one float32 scale per block, then the n int8 values. Each block maps
+// [-max|x|, max|x|] onto [-127, 127].
+template <typename T>
+void encode_int8_blocks(const T* data, size_t n, uint8_t* out) {
+    size_t blocks = (n + WIRE_INT8_BLOCK_SIZE - 1) / WIRE_INT8_BLOCK_SIZE;
+    float* scales = reinterpret_cast<float*>(out);
+    int8_t* values = reinterpret_cast<int8_t*>(out + blocks * sizeof(float));
+    for (size_t b = 0; b < blocks; ++b) {
+        size_t begin = b * WIRE_INT8_BLOCK_SIZE, end = std::min(n, begin + WIRE_INT8_BLOCK_SIZE);
+        double max_abs = 0;
+        for (size_t i = begin; i < end; ++i) max_abs = std::max(max_abs, std::abs(static_cast<double>(data[i])));
+        float scale = static_cast<float>(max_abs / 127);
+        scales[b] = scale;
+        for (size_t i = begin; i < end; ++i) {
+            double q = scale > 0 ? std::nearbyint(data[i] / scale) : 0;
+            values[i] = static_cast<int8_t>(std::max(-127.0, std::min(127.0, q)));
+        }
+    }
+}
+
+template <typename T>
+void decode_int8_blocks(const uint8_t* in, size_t n, T* data) {
+    size_t blocks = (n + WIRE_INT8_BLOCK_SIZE - 1) / WIRE_INT8_BLOCK_SIZE;
+    const float* scales = reinterpret_cast<const float*>(in);
+    const int8_t* values = reinterpret_cast<const int8_t*>(in + blocks * sizeof(float));
+    for (size_t i = 0; i < n; ++i) data[i] = static_cast<T>(values[i] * scales[i / WIRE_INT8_BLOCK_SIZE]);
+}
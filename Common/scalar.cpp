@@ -0,0 +1,27 @@
+// Scalar type for datasets, model state and the wire.
+// Build with -DFED_FLOAT32 for single precision (half the memory and network
+// bytes, twice the SIMD width). -DFED_ACCUMULATE_DOUBLE keeps the server's
+// running aggregates in double even in a float32 build.
+// Clients and server must be built with the same FED_FLOAT32 setting.
+#pragma once
+#include <Eigen/Dense>
+
+#ifdef FED_FLOAT32
+using Scalar = float;
+#else
+using Scalar = double;
+#endif
+
+#ifdef FED_ACCUMULATE_DOUBLE
+using Accumulator = double;
+#else
+using Accumulator = Scalar;
+#endif
+
+using MatrixXs = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+using VectorXs = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+using RowVectorXs = Eigen::Matrix<Scalar, 1, Eigen::Dynamic>;
+// Sample storage for the per-sample SGD loops: each sample is one contiguous row
+using RowMatrixXs = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using MatrixXa = Eigen::Matrix<Accumulator, Eigen::Dynamic, Eigen::Dynamic>;
+using VectorXa = Eigen::Matrix<Accumulator, Eigen::Dynamic, 1>;
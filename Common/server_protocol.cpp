@@ -0,0 +1,350 @@
+// The server's side of the framed protocol, apart from its I/O: options, the
+// state every connection shares, and SessionProtocol, which turns the bytes a
+// connection reads into handler calls and reply buffers. The Asio backend
+// (async_server.cpp) and the io_uring backend (uring_server.cpp) both drive it.
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <thread>
+#include <functional>
+#include <type_traits>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/asio.hpp>
+#include "wire_protocol.cpp"
+#include "model_versions.cpp"
+
+struct ServerOptions {
+    unsigned short port = 8080;  // --port N
+    int workers = std::max(1u, std::thread::hardware_concurrency());  // --workers N: threads serving connections
+    std::string socket_path;  // --socket PATH: also accept clients on this AF_UNIX socket
+    std::string shm_name;     // --shm NAME: publish replies for --transport shm clients in this shared memory ring
+    int compression_level = 0;  // --compression-level N: level for compressed replies; 0 keeps each client's
+    std::string backend = "asio";  // --backend asio|uring: epoll through Boost.Asio, or one io_uring per worker
+    uint64_t max_elements = WIRE_MAX_PAYLOAD_BYTES;  // --max-elements N: largest update (rows x cols) a client may send
+};
+
+// max_elements is the server's default for --max-elements: the largest update
+// its clients send, as each server capped its own before the framed protocol
+inline ServerOptions parse_server_options(int argc, char* argv[], uint64_t max_elements) {
+    ServerOptions options;
+    options.max_elements = max_elements;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--port") {
+            options.port = static_cast<unsigned short>(std::stoi(value()));
+        } else if (arg == "--workers") {
+            options.workers = std::stoi(value());
+            if (options.workers < 1) throw std::invalid_argument("--workers expects N >= 1");
+        } else if (arg == "--socket") {
+            options.socket_path = value();
+        } else if (arg == "--shm") {
+            options.shm_name = value();
+        } else if (arg == "--compression-level") {
+            options.compression_level = std::stoi(value());
+        } else if (arg == "--backend") {
+            options.backend = value();
+            if (options.backend != "asio" && options.backend != "uring")
+                throw std::invalid_argument("--backend expects asio or uring, got " + options.backend);
+        } else if (arg == "--max-elements") {
+            options.max_elements = std::stoull(value());
+            if (options.max_elements < 1) throw std::invalid_argument("--max-elements expects N >= 1");
+        } else {
+            throw std::invalid_argument("unknown option " + arg +
+                                        " (expected --port N, --workers N, --socket PATH, --shm NAME,"
+                                        " --compression-level N, --backend asio|uring, --max-elements N)");
+        }
+    }
+    return options;
+}
+
+// Versions the models handlers leave in their payloads. A handler stamps its
+// model while it still holds the lock that model was read under, so stamps
+// follow the order the reads happened in: a model with a later stamp holds
+// every update one with an earlier stamp does. Pushes rely on this.
+class ModelStamp {
+public:
+    explicit ModelStamp(std::atomic<uint64_t>& clock) : clock_(clock) {}
+
+    void stamp() { version_ = clock_.fetch_add(1, std::memory_order_relaxed) + 1; }
+    uint64_t version() const { return version_; }  // 0 until stamped
+
+private:
+    std::atomic<uint64_t>& clock_;  // The server's; every stamp is a new version
+    uint64_t version_ = 0;
+};
+
+// Turns one client update into the reply model. It runs on a worker thread and
+// may replace the payload (shape included); the return value becomes the
+// reply header's count. Shared model state needs its own lock, as before, and
+// the handler stamps the payload's model under it.
+template <typename Payload>
+using UpdateHandler = std::function<int(const MessageHeader& header, Payload& payload, ModelStamp& stamp)>;
+
+template <typename Payload>
+class FramedSession;
+
+// Immutable models for replies and pushes to point into. A snapshot's buffer
+// is reused once no reply or push holds it, so steady publishing does not allocate.
+template <typename Payload>
+class SnapshotPool {
+public:
+    // Swaps model into a free snapshot and returns it; model keeps that
+    // snapshot's previous contents, already the right shape once warm
+    std::shared_ptr<const Payload> take(Payload& model) {
+        std::shared_ptr<Payload> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& buffer : buffers_) {
+                if (buffer.use_count() == 1) {  // Only the pool holds it, and only the pool hands it out
+                    snapshot = buffer;
+                    break;
+                }
+            }
+            if (!snapshot) snapshot = buffers_.emplace_back(std::make_shared<Payload>());
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);  // After the last holder's reads
+        using std::swap;
+        swap(*snapshot, model);
+        return snapshot;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<Payload>> buffers_;
+};
+
+// What every connection to one server shares
+template <typename Payload>
+struct ServerContext {
+    ServerContext(ModelId model_id, const UpdateHandler<Payload>& handler, int max_rounds, const ServerOptions& options)
+        : model_id(model_id), handler(handler), max_rounds(max_rounds), compression_level(options.compression_level),
+          max_elements(options.max_elements), shared(options.shm_name) {}
+
+    ModelId model_id;
+    const UpdateHandler<Payload>& handler;
+    int max_rounds;
+    int compression_level;
+    uint64_t max_elements;
+    ModelVersions<typename Payload::value_type> versions;  // For delta replies
+    SharedModelWriter shared;                              // For shared replies; disabled without --shm
+
+    std::atomic<uint64_t> model_clock{0};  // Last ModelStamp handed out
+
+    // Subscriptions (Asio backend). Once any client subscribes, every update's
+    // model is swapped into a snapshot and published, unless a newer one
+    // already is; push_mutex covers only the swap of `latest`, and replies and
+    // pushes are built outside it.
+    std::atomic<bool> any_subscribers{false};
+    std::mutex push_mutex;
+    SnapshotPool<Payload> snapshots;
+    std::shared_ptr<const Payload> latest;  // Newest model published
+    int latest_count = 0;
+    uint64_t latest_version = 0;  // ModelStamp version of latest
+    std::vector<std::weak_ptr<FramedSession<Payload>>> subscribers;
+};
+
+// Per-client state of one logical client on a connection
+struct LogicalClient {
+    int rounds = 0;              // Updates handled
+    uint64_t model_version = 0;  // Last model version this client received; 0 before the first reply
+};
+
+// One connection's protocol state. The backend reads a header into `header`,
+// then the bytes of accept_header()'s buffer, then calls answer_hello() or
+// finish_update(), the handler, count_round() and reply_to_update(), and
+// writes the buffers those return.
+template <typename Payload>
+class SessionProtocol {
+public:
+    using T = typename Payload::value_type;
+    // Floating payloads may arrive quantized or sparse and leave quantized or as
+    // deltas; record payloads (ensemble_records.cpp) are only ever compressed
+    static constexpr bool ENCODABLE = std::is_floating_point_v<T>;
+
+    // Everything one outgoing model message points into until its write completes
+    struct Reply {
+        MessageHeader header;
+        std::vector<uint8_t> encoded;  // Quantized model
+        std::vector<uint32_t> delta_indices;
+        std::vector<T> delta_values;
+        uint64_t shared_sequence = 0;  // Slot of a shared reply
+        std::vector<uint8_t> compressed;
+        CompressionStats compressed_stats;  // Kept apart from the socket's, as replies and pushes run concurrently
+    };
+
+    SessionProtocol(ServerContext<Payload>& context, WireCompression& compression)
+        : context(context), compression_(compression) {}
+
+    // Every logical client on the connection has had its max_rounds updates
+    bool finished() const { return context.max_rounds > 0 && !clients_.empty() && finished_ == clients_.size(); }
+    size_t logical_clients() const { return clients_.size(); }
+    bool is_hello() const { return header.type == MSG_HELLO; }
+
+    // Checks the header just read and returns where its body goes: a hello's
+    // settings, else the update's bytes (compressed_, encoded_ or the payload)
+    boost::asio::mutable_buffer accept_header() {
+        if (is_hello()) {
+            check_hello(header);
+            return boost::asio::buffer(&hello_, sizeof(hello_));
+        }
+        check_header(header, MSG_UPDATE, context.model_id, wire_dtype<T>());
+        check_update_size();
+        client_ = &clients_[header.client_id];  // Nodes stay put on rehash
+        if (context.max_rounds > 0 && client_->rounds == context.max_rounds)
+            throw std::runtime_error("logical client " + std::to_string(header.client_id) + " sent more than " +
+                                     std::to_string(context.max_rounds) + " updates");
+        if (header.flags & FLAG_COMPRESSED) {  // Resized once the uncompressed length is checked
+            compressed_.resize(header.length);
+            return boost::asio::buffer(compressed_);
+        }
+        resize_payload(payload, header);
+        return boost::asio::buffer(payload_target(), header.length);
+    }
+
+    // Takes the client's compression offer: its codec if this build has one,
+    // else none, at --compression-level or the client's level. Returns the answer.
+    std::array<boost::asio::const_buffer, 2> answer_hello() {
+        compression_.codec = codec_available(hello_.codec) ? hello_.codec : static_cast<uint16_t>(CODEC_NONE);
+        compression_.level = context.compression_level ? context.compression_level : hello_.level;
+        compression_.threshold = hello_.threshold;
+        hello_ = {compression_.codec, static_cast<int16_t>(compression_.level), hello_.threshold};
+        reply.header = make_hello_header();
+        return {boost::asio::buffer(&reply.header, sizeof(reply.header)), boost::asio::buffer(&hello_, sizeof(hello_))};
+    }
+
+    // Inflates and decodes the update's bytes into payload
+    void finish_update() {
+        if (header.flags & FLAG_COMPRESSED) inflate_payload();
+        if constexpr (ENCODABLE) {
+            if (is_encoded(header.dtype))
+                decode_payload(header.dtype, encoded_.data(), encoded_.size(), payload.size(), payload.data());
+        }
+    }
+
+    // Counts the update just handled against its logical client
+    void count_round() {
+        if (++client_->rounds == context.max_rounds) finished_++;
+    }
+
+    // The model goes back in the quantization the client chose for its update
+    WireDtype reply_encoding() const {
+        return is_quantized(header.dtype) ? static_cast<WireDtype>(header.dtype) : wire_dtype<T>();
+    }
+
+    // The reply to the update just handled, which left the model in payload
+    std::array<boost::asio::const_buffer, 3> reply_to_update(int count) { return reply_with(payload, count); }
+
+    // Or the reply to it with model, which must outlive the write
+    std::array<boost::asio::const_buffer, 3> reply_with(const Payload& model, int count) {
+        return build_reply(model, count, reply_encoding(), header.flags, header.client_id, *client_, reply);
+    }
+
+    // Header and buffers sending model to a client: quantized in encoding, else
+    // through the shared ring, else as a delta, as the flags allow; dense otherwise.
+    // Then compressed, on a connection that agreed a codec, if that is smaller.
+    std::array<boost::asio::const_buffer, 3> build_reply(const Payload& model, int count, WireDtype encoding,
+                                                         uint8_t flags, uint32_t client_id, LogicalClient& client,
+                                                         Reply& reply) {
+        reply.header = make_header<T>(MSG_MODEL, context.model_id, count, payload_rows(model), payload_cols(model),
+                                      encoding, 0, client_id);
+        std::array<boost::asio::const_buffer, 3> buffers = {
+            boost::asio::buffer(&reply.header, sizeof(reply.header)),
+            boost::asio::buffer(model.data(), reply.header.length),
+            boost::asio::const_buffer()};
+        if (is_quantized(encoding)) {
+            if constexpr (ENCODABLE) {
+                reply.encoded.resize(reply.header.length);
+                encode_payload(encoding, model.data(), model.size(), reply.encoded.data());
+                buffers[1] = boost::asio::buffer(reply.encoded.data(), reply.header.length);
+            }
+        } else if ((flags & FLAG_SHARED_MODEL) && context.shared.enabled() &&
+                   context.shared.publish(model.data(), reply.header.length, reply.shared_sequence)) {
+            reply.header.dtype = WIRE_SHARED;
+            reply.header.length = sizeof(reply.shared_sequence);
+            buffers[1] = boost::asio::buffer(&reply.shared_sequence, sizeof(reply.shared_sequence));
+        } else if (flags & FLAG_ACCEPTS_DELTA) {
+            if constexpr (ENCODABLE) {  // Records always go out whole
+                bool full;
+                client.model_version = context.versions.publish(model.data(), reply.header.rows, reply.header.cols,
+                                                                client.model_version, reply.delta_indices,
+                                                                reply.delta_values, full);
+                if (!full) {
+                    reply.header.dtype = delta_dtype<T>();
+                    reply.header.length = reply.delta_indices.size() * sparse_entry_bytes(reply.header.dtype);
+                    buffers[1] = boost::asio::buffer(reply.delta_indices.data(),
+                                                     reply.delta_indices.size() * sizeof(uint32_t));
+                    buffers[2] = boost::asio::buffer(reply.delta_values.data(), reply.delta_values.size() * sizeof(T));
+                }
+            }
+        }
+        std::array<boost::asio::const_buffer, 2> payload = {buffers[1], buffers[2]};
+        if (compression_.enabled() && reply.header.length >= compression_.threshold &&
+            compress_payload(compression_, payload, reply.header.length, reply.compressed, reply.compressed_stats)) {
+            reply.header.flags |= FLAG_COMPRESSED;
+            reply.header.length = reply.compressed.size();
+            buffers[1] = boost::asio::buffer(reply.compressed);
+            buffers[2] = boost::asio::const_buffer();
+        }
+        return buffers;
+    }
+
+    ServerContext<Payload>& context;
+    MessageHeader header;  // Of the message being read or handled
+    Payload payload;
+    Reply reply;
+
+private:
+    // The wire allows payloads of up to 4 GiB; a server sizes its buffers from
+    // the header, so it takes updates of at most --max-elements values, in
+    // bytes at most those values sparse (or compressed, behind the block's length)
+    void check_update_size() const {
+        uint64_t elements = static_cast<uint64_t>(header.rows) * header.cols;
+        uint64_t max_bytes = context.max_elements * std::max(sizeof(T), sizeof(uint32_t) + sizeof(double)) +
+                             sizeof(uint64_t);
+        if (elements > context.max_elements || header.length > max_bytes)
+            throw std::runtime_error("update of " + std::to_string(header.rows) + "x" + std::to_string(header.cols) +
+                                     " values in " + std::to_string(header.length) + " bytes exceeds --max-elements " +
+                                     std::to_string(context.max_elements));
+    }
+
+    // Where the update's bytes belong: encoded_ (sized here) when they need
+    // decoding, else the payload itself
+    uint8_t* payload_target() {
+        if (!is_encoded(header.dtype)) return reinterpret_cast<uint8_t*>(payload.data());
+        encoded_.resize(header.length);
+        return encoded_.data();
+    }
+
+    // Turns header into the uncompressed message's, sizes payload once that
+    // checks out, and inflates compressed_ to where the uncompressed bytes
+    // would have been read
+    void inflate_payload() {
+        if (!compression_.enabled()) throw std::runtime_error("compressed update on a connection that agreed no codec");
+        header.length = compressed_payload_raw_bytes(compressed_);
+        header.flags &= ~FLAG_COMPRESSED;
+        check_update_size();
+        check_payload_length(header);
+        resize_payload(payload, header);
+        decompress_payload(compression_, compressed_, payload_target(), compression_.received);
+    }
+
+    WireCompression& compression_;
+    std::unordered_map<uint32_t, LogicalClient> clients_;  // By client_id
+    LogicalClient* client_ = nullptr;  // Sender of the update in progress
+    size_t finished_ = 0;              // Clients that reached max_rounds
+    std::vector<uint8_t> encoded_;     // Quantized or sparse update
+    std::vector<uint8_t> compressed_;  // Compressed update
+    CompressionSettings hello_;        // The client's offer, then the answer
+};
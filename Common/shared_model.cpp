@@ -0,0 +1,160 @@
+// Shared-memory model ring for clients on the server's host. The server copies
+// each new model version once into the next of SHARED_MODEL_SLOTS slots of a
+// POSIX shared memory segment; every reply carrying that version, to however
+// many clients, holds only the slot's sequence number on the socket. The client
+// copies the model straight out of the mapping, so model bytes skip the socket
+// and the kernel copies it implies.
+// Each slot is a seqlock: its sequence is odd while the server writes it. A
+// reader that finds its slot already reused takes the newest model instead.
+#pragma once
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+const uint32_t SHARED_MODEL_MAGIC = 0x4d444546;  // "FEDM"
+const uint32_t SHARED_MODEL_SLOTS = 16;
+
+struct SharedModelHeader {
+    uint32_t magic;
+    uint32_t slots;
+    uint64_t slot_bytes;               // Model bytes each slot holds
+    std::atomic<uint64_t> published;   // Sequence of the newest complete slot; 0 before the first
+};
+
+struct alignas(64) SharedModelSlot {
+    std::atomic<uint64_t> sequence;    // 2s + 2 once model s is complete, odd while being written
+    uint64_t bytes;
+    // slot_bytes of model data follow
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "slots are shared between processes");
+static_assert(sizeof(SharedModelHeader) <= sizeof(SharedModelSlot), "the header takes the first slot header's room");
+
+inline size_t shared_model_stride(uint64_t slot_bytes) {
+    return sizeof(SharedModelSlot) + (slot_bytes + 63) / 64 * 64;
+}
+
+inline uint8_t* shared_model_data(SharedModelSlot* slot) {
+    return reinterpret_cast<uint8_t*>(slot + 1);
+}
+
+inline SharedModelSlot* shared_model_slot(void* base, uint64_t sequence) {
+    auto* header = static_cast<SharedModelHeader*>(base);
+    uint8_t* slots = static_cast<uint8_t*>(base) + sizeof(SharedModelSlot);  // Header padded to one slot header
+    return reinterpret_cast<SharedModelSlot*>(slots + (sequence % header->slots) * shared_model_stride(header->slot_bytes));
+}
+
+// Server side. The segment is created on the first publish, with slots as
+// large as that model, and removed with the writer.
+class SharedModelWriter {
+public:
+    explicit SharedModelWriter(std::string name) : name_(std::move(name)) {}
+    ~SharedModelWriter() {
+        if (region_) boost::interprocess::shared_memory_object::remove(name_.c_str());
+    }
+    SharedModelWriter(const SharedModelWriter&) = delete;
+    SharedModelWriter& operator=(const SharedModelWriter&) = delete;
+
+    bool enabled() const { return !name_.empty(); }
+
+    // Returns through `sequence` the slot holding bytes of model data: the
+    // newest slot when it already holds this version, else the next one, which
+    // the model is copied into. Returns false when the model is larger than a slot.
+    bool publish(const void* data, uint64_t bytes, uint64_t& sequence) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!region_) create(bytes);
+        auto* header = static_cast<SharedModelHeader*>(region_->get_address());
+        if (bytes > header->slot_bytes) return false;
+
+        SharedModelSlot* slot = shared_model_slot(header, published_);
+        if (published_ && slot->bytes == bytes && std::memcmp(shared_model_data(slot), data, bytes) == 0) {
+            sequence = published_;  // Unchanged since the last reply: no copy, and no slot is reused
+            return true;
+        }
+        sequence = ++published_;
+        slot = shared_model_slot(header, sequence);
+        slot->sequence.store(2 * sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot->bytes = bytes;
+        std::memcpy(shared_model_data(slot), data, bytes);
+        slot->sequence.store(2 * sequence + 2, std::memory_order_release);
+        header->published.store(sequence, std::memory_order_release);
+        return true;
+    }
+
+private:
+    void create(uint64_t slot_bytes) {
+        using namespace boost::interprocess;
+        shared_memory_object::remove(name_.c_str());  // Left over from a server that did not exit cleanly
+        shared_memory_object segment(create_only, name_.c_str(), read_write);
+        segment.truncate(sizeof(SharedModelSlot) + SHARED_MODEL_SLOTS * shared_model_stride(slot_bytes));
+        region_ = std::make_unique<mapped_region>(segment, read_write);
+        auto* header = new (region_->get_address()) SharedModelHeader;
+        header->magic = SHARED_MODEL_MAGIC;
+        header->slots = SHARED_MODEL_SLOTS;
+        header->slot_bytes = slot_bytes;
+        header->published.store(0, std::memory_order_relaxed);
+        for (uint64_t s = 0; s < SHARED_MODEL_SLOTS; ++s)
+            new (shared_model_slot(header, s)) SharedModelSlot{{0}, 0};
+    }
+
+    std::string name_;
+    std::mutex mutex_;
+    std::unique_ptr<boost::interprocess::mapped_region> region_;
+    uint64_t published_ = 0;
+};
+
+// Client side: maps an existing segment read-only
+class SharedModelReader {
+public:
+    explicit SharedModelReader(const std::string& name) {
+        using namespace boost::interprocess;
+        shared_memory_object segment(open_only, name.c_str(), read_only);
+        region_ = mapped_region(segment, read_only);
+        if (static_cast<SharedModelHeader*>(region_.get_address())->magic != SHARED_MODEL_MAGIC)
+            throw std::runtime_error("shared memory " + name + " does not hold a model ring");
+    }
+
+    // Copies model `sequence` (bytes long) into out, or the newest model when
+    // the server has already reused its slot
+    void read(uint64_t sequence, void* out, uint64_t bytes) {
+        auto* header = static_cast<SharedModelHeader*>(region_.get_address());
+        if (bytes > header->slot_bytes) throw std::runtime_error("shared model larger than its slot");
+        for (;;) {
+            SharedModelSlot* slot = shared_model_slot(header, sequence);
+            uint64_t expected = 2 * sequence + 2;
+            if (slot->sequence.load(std::memory_order_acquire) == expected) {
+                uint64_t slot_bytes = slot->bytes;
+                std::memcpy(out, shared_model_data(slot), std::min(bytes, slot_bytes));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot->sequence.load(std::memory_order_relaxed) == expected) {
+                    if (slot_bytes != bytes) throw std::runtime_error("shared model size changed");
+                    return;
+                }
+            }
+            sequence = header->published.load(std::memory_order_acquire);
+        }
+    }
+
+private:
+    boost::interprocess::mapped_region region_;
+};
+
+// Name of the server's ring when this process runs over --transport shm, empty otherwise
+inline std::string& shared_model_name() {
+    static std::string name;
+    return name;
+}
+
+// Mapped on the first shared reply, by which time the server has created the segment
+inline SharedModelReader& shared_model_reader() {
+    static SharedModelReader reader(shared_model_name());
+    return reader;
+}
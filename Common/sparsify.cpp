@@ -0,0 +1,62 @@
+// Top-k gradient sparsification with error feedback: each update carries only
+// the k largest-magnitude coordinates; what was left out is kept locally and
+// added to the next gradient, so every coordinate is eventually applied.
+#pragma once
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <boost/asio.hpp>
+#include <Eigen/Dense>
+#include "scalar.cpp"
+#include "wire_protocol.cpp"
+
+class TopKSparsifier {
+public:
+    explicit TopKSparsifier(size_t k = 0) : k_(k) {}
+
+    bool enabled() const { return k_ > 0; }
+
+    // Adds the residual to gradient, moves its top k coordinates (in index
+    // order) into indices/values and keeps the remainder as the new residual
+    void select(const VectorXs& gradient, std::vector<uint32_t>& indices, std::vector<Scalar>& values) {
+        if (residual_.size() != gradient.size()) residual_ = VectorXs::Zero(gradient.size());
+        residual_ += gradient;
+
+        size_t k = std::min<size_t>(k_, residual_.size());
+        order_.resize(residual_.size());
+        std::iota(order_.begin(), order_.end(), 0);
+        std::nth_element(order_.begin(), order_.begin() + k, order_.end(), [this](uint32_t a, uint32_t b) {
+            return std::abs(residual_(a)) > std::abs(residual_(b));
+        });
+        indices.assign(order_.begin(), order_.begin() + k);
+        std::sort(indices.begin(), indices.end());
+
+        values.resize(k);
+        for (size_t i = 0; i < k; ++i) {
+            values[i] = residual_(indices[i]);
+            residual_(indices[i]) = 0;
+        }
+    }
+
+private:
+    size_t k_;
+    VectorXs residual_;            // Gradient mass not yet sent
+    std::vector<uint32_t> order_;  // Scratch for the selection
+};
+
+// Sends one gradient update: top-k sparse when the sparsifier is enabled,
+// otherwise dense in encoding
+inline void send_gradient(FramedSocket& socket, ModelId model_id, int batch_size,
+                          const VectorXs& gradient, WireDtype encoding, TopKSparsifier& sparsifier,
+                          uint8_t flags = 0) {
+    if (!sparsifier.enabled()) {
+        send_message(socket, MSG_UPDATE, model_id, batch_size, gradient, encoding, flags);
+        return;
+    }
+    thread_local std::vector<uint32_t> indices;
+    thread_local std::vector<Scalar> values;
+    sparsifier.select(gradient, indices, values);
+    send_sparse_message(socket, MSG_UPDATE, model_id, batch_size, gradient.size(), indices, values, flags);
+}
@@ -0,0 +1,130 @@
+// Client side of a model subscription (FLAG_SUBSCRIBE): updates go out without
+// waiting for a reply, and a reader thread keeps the newest model the server
+// pushes. Training picks it up between batches, so a batch costs compute time
+// rather than a round trip. The server skips versions while a push is still in
+// flight, so a client that falls behind gets the newest model, not a backlog.
+// The reader thread receives on its own socket, a dup() of the connection's
+// descriptor, so no Asio socket object is used from two threads at once; the
+// training thread keeps the original for sending.
+#pragma once
+#include <iostream>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <unistd.h>
+#include <boost/asio.hpp>
+#include "wire_protocol.cpp"
+
+template <typename Payload>
+class ModelSubscription {
+public:
+    ModelSubscription(FramedSocket& socket, ModelId model_id)
+        : socket_(socket), pushes_socket_(read_handle(io_context_, socket)), model_id_(model_id),
+          reader_([this]() { read_pushes(); }) {}
+
+    // Ends the subscription if finish() did not, e.g. when training threw
+    ~ModelSubscription() {
+        if (!reader_.joinable()) return;
+        boost::system::error_code ec;
+        socket_.shutdown(boost::asio::socket_base::shutdown_both, ec);
+        reader_.join();
+        merge_received();
+    }
+
+    ModelSubscription(const ModelSubscription&) = delete;
+    ModelSubscription& operator=(const ModelSubscription&) = delete;
+
+    // Records one update sent with FLAG_SUBSCRIBE
+    void sent_update() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sent_++;
+    }
+
+    // Copies the newest pushed model into model if one arrived since the last call
+    bool latest(Payload& model) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!fresh_) return false;
+        model = latest_;
+        fresh_ = false;
+        return true;
+    }
+
+    // Waits for a pushed model that includes every update sent and copies it
+    // into model. Then stops sending; the server closes the connection once
+    // its last push is out, which ends the reader.
+    void finish(Payload& model) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            pushed_.wait(lock, [this]() { return applied_ >= sent_ || done_; });
+            if (applied_ < sent_)
+                throw std::runtime_error("subscription ended with " + std::to_string(sent_ - applied_) +
+                                         " updates unacknowledged" + (error_.empty() ? "" : ": " + error_));
+            model = latest_;
+        }
+        socket_.shutdown(boost::asio::socket_base::shutdown_send);
+        reader_.join();
+        merge_received();
+        std::cout << "[INFO] Subscription: " << sent_ << " updates sent, " << pushes_ << " models pushed." << std::endl;
+    }
+
+private:
+    // A second handle on socket's connection, with the same compression, for
+    // the reader. Shutting down either handle shuts down the connection.
+    static FramedSocket read_handle(boost::asio::io_context& io_context, FramedSocket& socket) {
+        int fd = ::dup(socket.native_handle());
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), "dup");
+        FramedSocket handle(io_context);
+        handle.assign(socket.local_endpoint().protocol(), fd);
+        handle.compression.codec = socket.compression.codec;
+        handle.compression.level = socket.compression.level;
+        handle.compression.threshold = socket.compression.threshold;
+        return handle;
+    }
+
+    // Moves the reader's decompression stats onto socket_, which reports both directions
+    void merge_received() {
+        socket_.compression.received = pushes_socket_.compression.received;
+        pushes_socket_.compression = {};
+    }
+
+    // received_ keeps the previous push, the base of a delta
+    void read_pushes() {
+        try {
+            MessageHeader header;
+            while (receive_message(pushes_socket_, MSG_MODEL, model_id_, received_, &header)) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                latest_ = received_;
+                applied_ = header.applied;
+                fresh_ = true;
+                pushes_++;
+                pushed_.notify_all();
+            }
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = e.what();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+        pushed_.notify_all();
+    }
+
+    FramedSocket& socket_;                // Sends, from the training thread
+    boost::asio::io_context io_context_;  // Of pushes_socket_
+    FramedSocket pushes_socket_;          // Receives, from the reader thread
+    ModelId model_id_;
+    Payload received_;
+    std::mutex mutex_;
+    std::condition_variable pushed_;
+    Payload latest_;
+    bool fresh_ = false;    // latest_ not yet taken by latest()
+    bool done_ = false;     // The reader has stopped
+    uint32_t sent_ = 0;
+    uint32_t applied_ = 0;  // Updates the newest push includes
+    uint64_t pushes_ = 0;
+    std::string error_;
+    std::thread reader_;    // Last, so it starts after everything it uses
+};
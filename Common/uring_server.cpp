@@ -0,0 +1,638 @@
+// io_uring backend for the framed server (--backend uring): the same protocol,
+// handlers and replies as the Asio sessions (SessionProtocol), but each worker
+// thread drives its own ring instead of sharing an epoll reactor. A worker
+// queues every read, write and accept its completions lead to and submits
+// them all with the wait for the next completions in one io_uring_enter, so
+// a busy server makes far fewer than one system call per message.
+// Each connection reads into a staging slot that holds a header and a small
+// payload together, so one read usually brings a whole update; the slots live
+// in one arena registered with the ring (READ_FIXED/WRITE_FIXED), and small
+// replies are gathered into the slot's other half. Larger payloads are
+// received straight into their buffers, and larger replies sent with sendmsg.
+// Handlers run on the worker that read the update, as with --workers under
+// Asio. Every worker listens on the TCP port through SO_REUSEPORT; the first
+// also takes the AF_UNIX socket. Subscriptions (FLAG_SUBSCRIBE) need the Asio
+// backend. The ring is driven through raw system calls; no liburing needed.
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <array>
+#include <memory>
+#include <unordered_set>
+#include <deque>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <csignal>
+#include "server_protocol.cpp"
+#include "alloc_stats.cpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/io_uring.h>
+
+const unsigned URING_SUBMIT_ENTRIES = 1024;
+const unsigned URING_COMPLETION_ENTRIES = 65536;  // At least the operations in flight: one per connection
+const size_t URING_SLOT_IN_BYTES = 2048;          // Header plus a small payload
+const size_t URING_SLOT_OUT_BYTES = 2048;         // A small reply
+const unsigned URING_REGISTERED_SLOTS = 1024;     // Per worker; later connections get unregistered slots
+const long URING_ACCEPT_PAUSE_NS = 100000000;     // Before accepting again when out of descriptors or memory
+
+inline std::runtime_error uring_error(const std::string& what, int error) {
+    return std::runtime_error(what + ": " + std::strerror(error));
+}
+
+// A submission and completion queue pair, mapped from the kernel
+class Uring {
+public:
+    Uring() {
+        io_uring_params params = {};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = URING_COMPLETION_ENTRIES;
+        fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, URING_SUBMIT_ENTRIES, &params));
+        if (fd_ < 0) throw uring_error("io_uring unavailable (use --backend asio)", errno);
+
+        sq_bytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_bytes_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) sq_bytes_ = cq_bytes_ = std::max(sq_bytes_, cq_bytes_);
+        sq_ring_ = map(sq_bytes_, IORING_OFF_SQ_RING);
+        cq_ring_ = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring_ : map(cq_bytes_, IORING_OFF_CQ_RING);
+        sqes_bytes_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map(sqes_bytes_, IORING_OFF_SQES));
+
+        auto* sq = static_cast<uint8_t*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sq_entries_; ++i) array[i] = i;  // Entries are used in ring order
+        auto* cq = static_cast<uint8_t*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        tail_ = *sq_tail_;
+    }
+
+    ~Uring() {
+        ::munmap(sqes_, sqes_bytes_);
+        if (cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_bytes_);
+        ::munmap(sq_ring_, sq_bytes_);
+        ::close(fd_);
+    }
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    // A zeroed entry to fill in; submitted with the next enter(). A full
+    // queue is submitted first; while the kernel will not take it until
+    // completions are reaped, they are set aside for the next reap().
+    io_uring_sqe* next_entry() {
+        while (tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+            if (!enter(0) && !set_aside_completions()) throw uring_error("io_uring_enter", EBUSY);
+        }
+        io_uring_sqe* sqe = &sqes_[tail_++ & sq_mask_];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // Submits what is queued and waits for at least wait completions; false
+    // when the kernel wants completions reaped first
+    bool enter(unsigned wait) {
+        __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+        unsigned pending = tail_ - submitted_;
+        for (;;) {
+            int n = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, pending, wait,
+                                               wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+            if (n >= 0) {
+                submitted_ += n;
+                return true;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EBUSY || errno == EAGAIN) return false;
+            throw uring_error("io_uring_enter", errno);
+        }
+    }
+
+    // Calls f(user_data, result) for each completion ready, oldest first
+    template <typename F>
+    void reap(F f) {
+        for (;;) {
+            io_uring_cqe cqe;
+            if (!set_aside_.empty()) {
+                cqe = set_aside_.front();
+                set_aside_.pop_front();
+            } else if (!take_completion(cqe)) {
+                return;
+            }
+            f(cqe.user_data, cqe.res);
+        }
+    }
+
+    // One fixed buffer per iovec; false (with errno) when the kernel refuses,
+    // e.g. over RLIMIT_MEMLOCK
+    bool register_buffers(const std::vector<iovec>& buffers) {
+        return ::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, buffers.data(),
+                         static_cast<unsigned>(buffers.size())) == 0;
+    }
+
+private:
+    bool take_completion(io_uring_cqe& cqe) {
+        unsigned head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) return false;
+        cqe = cqes_[head & cq_mask_];
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Frees the completion queue without handling what is in it; false if it was empty
+    bool set_aside_completions() {
+        io_uring_cqe cqe;
+        bool any = false;
+        while (take_completion(cqe)) {
+            set_aside_.push_back(cqe);
+            any = true;
+        }
+        return any;
+    }
+
+    void* map(size_t bytes, off_t offset) {
+        void* region = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+        if (region == MAP_FAILED) throw uring_error("io_uring mmap", errno);
+        return region;
+    }
+
+    int fd_;
+    void* sq_ring_;
+    void* cq_ring_;
+    size_t sq_bytes_, cq_bytes_, sqes_bytes_;
+    io_uring_sqe* sqes_;
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned sq_mask_, sq_entries_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+    unsigned tail_;           // Next entry to hand out
+    unsigned submitted_ = 0;  // Entries the kernel has taken
+    std::deque<io_uring_cqe> set_aside_;  // Taken off the ring by next_entry(), not yet reaped
+};
+
+// What a completion's user_data points at
+struct UringTarget {
+    enum Kind { LISTENER, ACCEPT_PAUSE, CONNECTION, STOP } kind;
+};
+
+struct UringListener : UringTarget {
+    int fd;
+    bool tcp;
+    // A timeout that re-arms the accept after it failed for want of descriptors or memory
+    struct Pause : UringTarget {
+        UringListener* listener;
+        __kernel_timespec delay;
+    } pause;
+};
+
+// A connection's staging buffers: registered when index >= 0
+struct UringSlot {
+    uint8_t* in = nullptr;
+    uint8_t* out = nullptr;
+    int index = -1;
+    std::unique_ptr<uint8_t[]> owned;  // When the registered slots are all taken
+};
+
+template <typename Payload>
+struct UringConnection : UringTarget {
+    enum State { READING, READING_BODY, WRITING };
+
+    UringConnection(ServerContext<Payload>& context, int fd, UringSlot slot)
+        : UringTarget{CONNECTION}, fd(fd), slot(std::move(slot)), protocol(context, compression) {}
+
+    int fd;
+    UringSlot slot;
+    State state = READING;
+    size_t in_start = 0, in_end = 0;  // Unparsed bytes of slot.in
+    bool in_body = false;             // Header accepted, body incomplete
+    boost::asio::mutable_buffer body;
+    size_t body_done = 0;
+    std::array<iovec, 3> out;  // Unsent parts of the reply
+    size_t out_parts = 0;
+    msghdr message = {};
+    WireCompression compression;
+    SessionProtocol<Payload> protocol;
+    AllocationStats allocations;  // Reported on close with -DFED_COUNT_ALLOCS
+};
+
+// One worker thread's ring, listeners and connections
+template <typename Payload>
+class UringWorker {
+public:
+    using Connection = UringConnection<Payload>;
+
+    UringWorker(ServerContext<Payload>& context, const ServerOptions& options, bool take_unix_socket, int stop_fd)
+        : context_(context), stop_fd_(stop_fd),
+          arena_(new uint8_t[URING_REGISTERED_SLOTS * (URING_SLOT_IN_BYTES + URING_SLOT_OUT_BYTES)]) {
+        std::vector<iovec> slots(URING_REGISTERED_SLOTS);
+        for (unsigned i = 0; i < URING_REGISTERED_SLOTS; ++i)
+            slots[i] = {arena_.get() + i * (URING_SLOT_IN_BYTES + URING_SLOT_OUT_BYTES),
+                        URING_SLOT_IN_BYTES + URING_SLOT_OUT_BYTES};
+        if (ring_.register_buffers(slots)) {
+            for (unsigned i = URING_REGISTERED_SLOTS; i > 0; --i) free_slots_.push_back(i - 1);
+        } else {
+            std::cout << "[INFO] io_uring buffer registration failed (" << std::strerror(errno)
+                      << "); reading and writing unregistered." << std::endl;
+        }
+
+        listen_tcp(options.port);
+        if (take_unix_socket && !options.socket_path.empty()) listen_unix(options.socket_path);
+        for (auto& listener : listeners_) accept(*listener);
+        read_stop();
+    }
+
+    ~UringWorker() {
+        for (auto& listener : listeners_) ::close(listener->fd);
+    }
+
+    // Serves until the stop eventfd fires and every connection has wound down
+    void run() {
+        while (!stopping_ || !connections_.empty() || accepts_ > 0) {
+            ring_.enter(1);
+            ring_.reap([this](uint64_t user_data, int result) { complete(user_data, result); });
+        }
+    }
+
+private:
+    void complete(uint64_t user_data, int result) {
+        if (user_data == 0) return;  // A cancel request
+        auto* target = reinterpret_cast<UringTarget*>(user_data);
+        switch (target->kind) {
+            case UringTarget::LISTENER: return accepted(*static_cast<UringListener*>(target), result);
+            case UringTarget::ACCEPT_PAUSE: return paused(*static_cast<UringListener::Pause*>(target)->listener);
+            case UringTarget::CONNECTION: return transferred(static_cast<Connection*>(target), result);
+            case UringTarget::STOP: return stop();
+        }
+    }
+
+    void listen_tcp(unsigned short port) {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int on = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));  // One listener per worker
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(fd, SOMAXCONN) < 0)
+            throw uring_error("listen on port " + std::to_string(port), errno);
+        add_listener(fd, true);
+    }
+
+    void listen_unix(const std::string& path) {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(fd, SOMAXCONN) < 0)
+            throw uring_error("listen on " + path, errno);
+        add_listener(fd, false);
+    }
+
+    void add_listener(int fd, bool tcp) {
+        auto listener = std::make_unique<UringListener>();
+        *listener = {{UringTarget::LISTENER}, fd, tcp, {{UringTarget::ACCEPT_PAUSE}, listener.get(), {0, URING_ACCEPT_PAUSE_NS}}};
+        listeners_.push_back(std::move(listener));
+    }
+
+    void accept(UringListener& listener) {
+        io_uring_sqe* sqe = ring_.next_entry();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listener.fd;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = reinterpret_cast<uint64_t>(&listener);
+        accepts_++;
+    }
+
+    void accepted(UringListener& listener, int fd) {
+        accepts_--;
+        if (stopping_) {
+            if (fd >= 0) ::close(fd);
+            return;
+        }
+        if (fd < 0) {
+            std::cerr << "[ERROR] Accept failed: " << std::strerror(-fd) << std::endl;
+            // One connection's failure; anything else would fail again at once
+            if (-fd != ECONNABORTED && -fd != EINTR && -fd != EAGAIN && -fd != EPERM && -fd != EPROTO)
+                return pause_accept(listener);
+        } else {
+            std::cout << "[DEBUG] New client connected." << std::endl;
+            if (listener.tcp) {
+                int on = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+            auto* c = new Connection(context_, fd, take_slot());
+            connections_.insert(c);
+            read_more(c);
+        }
+        accept(listener);
+    }
+
+    void pause_accept(UringListener& listener) {
+        io_uring_sqe* sqe = ring_.next_entry();
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = reinterpret_cast<uint64_t>(&listener.pause.delay);
+        sqe->len = 1;
+        sqe->user_data = reinterpret_cast<uint64_t>(&listener.pause);
+        accepts_++;  // Stands in for the accept until it expires
+    }
+
+    void paused(UringListener& listener) {
+        accepts_--;
+        if (!stopping_) accept(listener);
+    }
+
+    UringSlot take_slot() {
+        UringSlot slot;
+        if (!free_slots_.empty()) {
+            slot.index = free_slots_.back();
+            free_slots_.pop_back();
+            slot.in = arena_.get() + slot.index * (URING_SLOT_IN_BYTES + URING_SLOT_OUT_BYTES);
+        } else {
+            slot.owned.reset(new uint8_t[URING_SLOT_IN_BYTES + URING_SLOT_OUT_BYTES]);
+            slot.in = slot.owned.get();
+        }
+        slot.out = slot.in + URING_SLOT_IN_BYTES;
+        return slot;
+    }
+
+    // Reads what has arrived into the free end of the slot
+    void read_more(Connection* c) {
+        if (c->in_start > 0) {
+            std::memmove(c->slot.in, c->slot.in + c->in_start, c->in_end - c->in_start);
+            c->in_end -= c->in_start;
+            c->in_start = 0;
+        }
+        c->state = Connection::READING;
+        io_uring_sqe* sqe = ring_.next_entry();
+        sqe->fd = c->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(c->slot.in + c->in_end);
+        sqe->len = static_cast<uint32_t>(URING_SLOT_IN_BYTES - c->in_end);
+        if (c->slot.index >= 0) {
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->buf_index = static_cast<uint16_t>(c->slot.index);
+        } else {
+            sqe->opcode = IORING_OP_RECV;
+        }
+        sqe->user_data = reinterpret_cast<uint64_t>(c);
+    }
+
+    // The rest of a body too large for the slot, straight into its buffer
+    void read_body(Connection* c) {
+        c->state = Connection::READING_BODY;
+        io_uring_sqe* sqe = ring_.next_entry();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = c->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(static_cast<uint8_t*>(c->body.data()) + c->body_done);
+        sqe->len = static_cast<uint32_t>(c->body.size() - c->body_done);
+        sqe->msg_flags = MSG_WAITALL;
+        sqe->user_data = reinterpret_cast<uint64_t>(c);
+    }
+
+    // Small replies are gathered into the slot; others go out as they are
+    template <size_t N>
+    void write(Connection* c, const std::array<boost::asio::const_buffer, N>& buffers) {
+        size_t total = 0;
+        for (const auto& buffer : buffers) total += buffer.size();
+        c->out_parts = 0;
+        if (total <= URING_SLOT_OUT_BYTES) {
+            uint8_t* out = c->slot.out;
+            for (const auto& buffer : buffers) {
+                std::memcpy(out, buffer.data(), buffer.size());
+                out += buffer.size();
+            }
+            c->out[c->out_parts++] = {c->slot.out, total};
+        } else {
+            for (const auto& buffer : buffers)
+                if (buffer.size() > 0) c->out[c->out_parts++] = {const_cast<void*>(buffer.data()), buffer.size()};
+        }
+        write_rest(c);
+    }
+
+    void write_rest(Connection* c) {
+        c->state = Connection::WRITING;
+        io_uring_sqe* sqe = ring_.next_entry();
+        sqe->fd = c->fd;
+        bool in_slot = c->out_parts == 1 && c->out[0].iov_base >= c->slot.out &&
+                       c->out[0].iov_base < c->slot.out + URING_SLOT_OUT_BYTES;
+        if (in_slot && c->slot.index >= 0) {
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->addr = reinterpret_cast<uint64_t>(c->out[0].iov_base);
+            sqe->len = static_cast<uint32_t>(c->out[0].iov_len);
+            sqe->buf_index = static_cast<uint16_t>(c->slot.index);
+        } else {
+            c->message.msg_iov = c->out.data();
+            c->message.msg_iovlen = c->out_parts;
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->addr = reinterpret_cast<uint64_t>(&c->message);
+            sqe->len = 1;
+            sqe->msg_flags = MSG_NOSIGNAL;
+        }
+        sqe->user_data = reinterpret_cast<uint64_t>(c);
+    }
+
+    void transferred(Connection* c, int result) {
+        if (stopping_) return close(c);
+        if (result < 0) return fail(c, std::strerror(-result));
+        switch (c->state) {
+            case Connection::READING:
+                if (result == 0) {
+                    if (c->in_body || c->in_end > c->in_start) return fail(c, "End of file");
+                    size_t clients = c->protocol.logical_clients();
+                    std::cout << "[DEBUG] Client disconnected";
+                    if (clients > 1) std::cout << " (" << clients << " logical clients)";
+                    std::cout << "." << std::endl;
+                    return close(c);
+                }
+                c->in_end += result;
+                return parse(c);
+            case Connection::READING_BODY:
+                if (result == 0) return fail(c, "End of file");
+                c->body_done += result;
+                if (c->body_done < c->body.size()) return read_body(c);
+                c->in_body = false;
+                return handle(c);
+            case Connection::WRITING: {
+                size_t sent = result;
+                size_t part = 0;
+                while (part < c->out_parts && sent >= c->out[part].iov_len) sent -= c->out[part++].iov_len;
+                if (part < c->out_parts) {  // Short write: send the rest
+                    std::copy(c->out.begin() + part, c->out.begin() + c->out_parts, c->out.begin());
+                    c->out_parts -= part;
+                    c->out[0].iov_base = static_cast<uint8_t*>(c->out[0].iov_base) + sent;
+                    c->out[0].iov_len -= sent;
+                    return write_rest(c);
+                }
+                c->allocations.end_message();
+                if (c->protocol.finished()) return close(c);
+                return parse(c);  // Pipelined messages may already be in the slot
+            }
+        }
+    }
+
+    // Takes the next message out of the slot when it is all there
+    void parse(Connection* c) {
+        size_t available = c->in_end - c->in_start;
+        try {
+            if (!c->in_body) {
+                AllocationScope scope(c->allocations);  // Sizing the payload
+                if (available < sizeof(MessageHeader)) return read_more(c);
+                std::memcpy(&c->protocol.header, c->slot.in + c->in_start, sizeof(MessageHeader));
+                c->in_start += sizeof(MessageHeader);
+                available -= sizeof(MessageHeader);
+                c->body = c->protocol.accept_header();
+                c->body_done = 0;
+                c->in_body = true;
+            }
+        } catch (const std::exception& e) {
+            return fail(c, e.what());
+        }
+        size_t take = std::min(available, c->body.size() - c->body_done);
+        std::memcpy(static_cast<uint8_t*>(c->body.data()) + c->body_done, c->slot.in + c->in_start, take);
+        c->body_done += take;
+        c->in_start += take;
+        if (c->body_done < c->body.size()) {
+            c->in_start = c->in_end = 0;  // The slot is drained
+            return read_body(c);
+        }
+        c->in_body = false;
+        handle(c);
+    }
+
+    void handle(Connection* c) {
+        AllocationScope scope(c->allocations);  // Covers the handler and the reply
+        auto& protocol = c->protocol;
+        try {
+            if (protocol.is_hello()) return write(c, protocol.answer_hello());
+            protocol.finish_update();
+            if (protocol.header.flags & FLAG_SUBSCRIBE)
+                throw std::runtime_error("subscriptions need --backend asio");
+            ModelStamp stamp(context_.model_clock);  // Only pushes need it
+            int count = context_.handler(protocol.header, protocol.payload, stamp);
+            protocol.count_round();
+            write(c, protocol.reply_to_update(count));
+        } catch (const std::exception& e) {
+            fail(c, e.what());
+        }
+    }
+
+    void fail(Connection* c, const std::string& what) {
+        std::cerr << "[ERROR] Exception in handle_client: " << what << std::endl;
+        close(c);
+    }
+
+    // Only called from the connection's own completion, so nothing is in flight
+    void close(Connection* c) {
+        c->compression.sent += c->protocol.reply.compressed_stats;
+        c->compression.report();
+        c->allocations.report();
+        ::close(c->fd);
+        if (c->slot.index >= 0) free_slots_.push_back(c->slot.index);
+        connections_.erase(c);
+        delete c;
+    }
+
+    void read_stop() {
+        io_uring_sqe* sqe = ring_.next_entry();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = stop_fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(&stop_count_);
+        sqe->len = sizeof(stop_count_);
+        sqe->user_data = reinterpret_cast<uint64_t>(&stop_target_);
+    }
+
+    // Cancels the accepts (or their pauses) and cuts every connection; each
+    // one's pending operation then completes and closes it
+    void stop() {
+        stopping_ = true;
+        for (auto& listener : listeners_) {
+            for (UringTarget* target : {static_cast<UringTarget*>(listener.get()), static_cast<UringTarget*>(&listener->pause)}) {
+                io_uring_sqe* sqe = ring_.next_entry();
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = reinterpret_cast<uint64_t>(target);
+            }
+        }
+        for (auto* c : connections_) ::shutdown(c->fd, SHUT_RDWR);
+    }
+
+    Uring ring_;
+    ServerContext<Payload>& context_;
+    int stop_fd_;
+    uint64_t stop_count_ = 0;
+    UringTarget stop_target_{UringTarget::STOP};
+    std::unique_ptr<uint8_t[]> arena_;
+    std::vector<int> free_slots_;
+    std::vector<std::unique_ptr<UringListener>> listeners_;
+    std::unordered_set<Connection*> connections_;
+    size_t accepts_ = 0;
+    bool stopping_ = false;
+};
+
+// Serves handler from options.workers rings until SIGINT/SIGTERM, like
+// run_framed_server. The signals are taken with sigwait on this thread, so
+// the workers never see them.
+template <typename Payload>
+void run_uring_server(const ServerOptions& options, ModelId model_id, const UpdateHandler<Payload>& handler,
+                      int max_rounds) {
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);  // Inherited by the workers
+    std::signal(SIGPIPE, SIG_IGN);  // WRITE_FIXED cannot ask for MSG_NOSIGNAL
+
+    if (!options.socket_path.empty()) ::unlink(options.socket_path.c_str());  // Left over from a server that did not exit cleanly
+    int stop_fd = ::eventfd(0, EFD_CLOEXEC | EFD_SEMAPHORE);  // One read per worker
+    ServerContext<Payload> context(model_id, handler, max_rounds, options);
+    std::vector<std::unique_ptr<UringWorker<Payload>>> workers;
+    for (int i = 0; i < options.workers; ++i)
+        workers.push_back(std::make_unique<UringWorker<Payload>>(context, options, i == 0, stop_fd));
+    std::cout << "[DEBUG] Server started on port " << options.port;
+    if (!options.socket_path.empty()) std::cout << " and " << options.socket_path;
+    if (!options.shm_name.empty()) std::cout << ", shared model ring " << options.shm_name;
+    if (options.compression_level) std::cout << ", compression level " << options.compression_level;
+    std::cout << " with " << options.workers << " io_uring workers." << std::endl;
+
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) threads.emplace_back([&worker]() { worker->run(); });
+    int signal_number;
+    sigwait(&signals, &signal_number);
+    std::cout << "[INFO] Signal " << signal_number << " received, shutting down." << std::endl;
+    uint64_t stops = workers.size();
+    if (::write(stop_fd, &stops, sizeof(stops)) < 0) std::cerr << "[ERROR] Could not stop the workers" << std::endl;
+    for (auto& thread : threads) thread.join();
+    workers.clear();
+    ::close(stop_fd);
+    if (!options.socket_path.empty()) ::unlink(options.socket_path.c_str());
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+#else
+template <typename Payload>
+void run_uring_server(const ServerOptions&, ModelId, const UpdateHandler<Payload>&, int) {
+    throw std::runtime_error("--backend uring needs Linux with <linux/io_uring.h>");
+}
+#endif
@@ -0,0 +1,304 @@
+// Block compression of message payloads, agreed per connection (MSG_HELLO in
+// wire_protocol.cpp). A compressed payload is its uncompressed length (uint64)
+// followed by one block in the connection's codec; it is only sent when it
+// comes out smaller. Each side counts the bytes and time it spends, reported
+// when the connection closes.
+// Build with -DFED_HAVE_LZ4 -llz4, -DFED_HAVE_ZSTD -lzstd and/or
+// -DFED_HAVE_ZLIB -lz for the codecs to offer; without any, every connection
+// stays uncompressed.
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#ifdef FED_HAVE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#ifdef FED_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef FED_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+enum WireCodec : uint16_t {
+    CODEC_NONE = 0,
+    CODEC_LZ4 = 1,      // level <= 1: LZ4 fast; higher: LZ4 HC at that level
+    CODEC_ZSTD = 2,
+    CODEC_DEFLATE = 3,  // zlib format
+};
+
+const uint64_t DEFAULT_COMPRESS_ABOVE = 4096;  // Payload bytes below which compression is not worth a call
+
+inline const char* codec_name(uint16_t codec) {
+    switch (codec) {
+        case CODEC_LZ4: return "lz4";
+        case CODEC_ZSTD: return "zstd";
+        case CODEC_DEFLATE: return "deflate";
+        default: return "none";
+    }
+}
+
+inline WireCodec codec_from_name(const std::string& name) {
+    if (name == "none") return CODEC_NONE;
+    if (name == "lz4") return CODEC_LZ4;
+    if (name == "zstd") return CODEC_ZSTD;
+    if (name == "deflate") return CODEC_DEFLATE;
+    throw std::invalid_argument("unknown codec " + name + " (expected none, lz4, zstd, deflate)");
+}
+
+// Whether this build can compress and decompress codec
+inline bool codec_available(uint16_t codec) {
+    switch (codec) {
+        case CODEC_NONE: return true;
+#ifdef FED_HAVE_LZ4
+        case CODEC_LZ4: return true;
+#endif
+#ifdef FED_HAVE_ZSTD
+        case CODEC_ZSTD: return true;
+#endif
+#ifdef FED_HAVE_ZLIB
+        case CODEC_DEFLATE: return true;
+#endif
+        default: return false;
+    }
+}
+
+inline const char* codec_build_flags(uint16_t codec) {
+    switch (codec) {
+        case CODEC_LZ4: return "-DFED_HAVE_LZ4 -llz4";
+        case CODEC_ZSTD: return "-DFED_HAVE_ZSTD -lzstd";
+        default: return "-DFED_HAVE_ZLIB -lz";
+    }
+}
+
+#ifdef FED_HAVE_ZSTD
+// One compression and one decompression context per thread, reused across messages
+struct ZstdContexts {
+    ZSTD_CCtx* compress = ZSTD_createCCtx();
+    ZSTD_DCtx* decompress = ZSTD_createDCtx();
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(compress);
+        ZSTD_freeDCtx(decompress);
+    }
+};
+
+inline ZstdContexts& zstd_contexts() {
+    thread_local ZstdContexts contexts;
+    return contexts;
+}
+#endif
+
+// Largest input codec takes in one block: LZ4 counts bytes in an int
+inline uint64_t codec_max_input(uint16_t codec) {
+#ifdef FED_HAVE_LZ4
+    if (codec == CODEC_LZ4) return LZ4_MAX_INPUT_SIZE;
+#endif
+    (void)codec;
+    return UINT64_MAX;
+}
+
+// Largest block codec may produce for n bytes of input. The default branches
+// name every argument, which no codec uses when none is built in.
+inline size_t compress_bound(uint16_t codec, size_t n) {
+    switch (codec) {
+#ifdef FED_HAVE_LZ4
+        case CODEC_LZ4: return n > LZ4_MAX_INPUT_SIZE ? 0 : LZ4_compressBound(static_cast<int>(n));
+#endif
+#ifdef FED_HAVE_ZSTD
+        case CODEC_ZSTD: return ZSTD_compressBound(n);
+#endif
+#ifdef FED_HAVE_ZLIB
+        case CODEC_DEFLATE: return compressBound(n);
+#endif
+        default:
+            (void)n;
+            throw std::invalid_argument(std::string("codec ") + codec_name(codec) + " is not built in");
+    }
+}
+
+// Compresses n bytes into out, which holds at least compress_bound(codec, n);
+// returns the block size. level 0 is the codec's default. n is at most
+// codec_max_input(codec).
+inline size_t compress_block(uint16_t codec, int level, const uint8_t* in, size_t n, uint8_t* out,
+                             size_t capacity) {
+    if (n > codec_max_input(codec))
+        throw std::invalid_argument(std::to_string(n) + " bytes are too many for one " + codec_name(codec) + " block");
+    switch (codec) {
+#ifdef FED_HAVE_LZ4
+        case CODEC_LZ4: {
+            const char* source = reinterpret_cast<const char*>(in);
+            char* dest = reinterpret_cast<char*>(out);
+            int size = static_cast<int>(n);  // Within codec_max_input
+            int room = static_cast<int>(std::min<size_t>(capacity, INT_MAX));
+            int bytes = level <= 1 ? LZ4_compress_default(source, dest, size, room)
+                                   : LZ4_compress_HC(source, dest, size, room, level);
+            if (bytes <= 0) throw std::runtime_error("lz4 compression failed");
+            return static_cast<size_t>(bytes);
+        }
+#endif
+#ifdef FED_HAVE_ZSTD
+        case CODEC_ZSTD: {
+            size_t bytes = ZSTD_compressCCtx(zstd_contexts().compress, out, capacity, in, n,
+                                             level == 0 ? ZSTD_CLEVEL_DEFAULT : level);
+            if (ZSTD_isError(bytes)) throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(bytes));
+            return bytes;
+        }
+#endif
+#ifdef FED_HAVE_ZLIB
+        case CODEC_DEFLATE: {
+            uLongf bytes = capacity;
+            if (compress2(out, &bytes, in, n, level == 0 ? Z_DEFAULT_COMPRESSION : level) != Z_OK)
+                throw std::runtime_error("deflate compression failed");
+            return bytes;
+        }
+#endif
+        default:
+            (void)level, (void)in, (void)out, (void)capacity;
+            throw std::invalid_argument(std::string("codec ") + codec_name(codec) + " is not built in");
+    }
+}
+
+// Decompresses a block that must inflate to exactly raw bytes
+inline void decompress_block(uint16_t codec, const uint8_t* in, size_t n, uint8_t* out, size_t raw) {
+    // A peer's lengths are checked before they reach a codec that counts in int
+    if (n > codec_max_input(codec) || raw > codec_max_input(codec))
+        throw std::runtime_error(std::string(codec_name(codec)) + " payload of " + std::to_string(raw) +
+                                 " bytes is larger than one block");
+    bool ok = false;
+    switch (codec) {
+#ifdef FED_HAVE_LZ4
+        case CODEC_LZ4:
+            ok = LZ4_decompress_safe(reinterpret_cast<const char*>(in), reinterpret_cast<char*>(out),
+                                     static_cast<int>(n), static_cast<int>(raw)) == static_cast<int>(raw);
+            break;
+#endif
+#ifdef FED_HAVE_ZSTD
+        case CODEC_ZSTD:
+            ok = ZSTD_decompressDCtx(zstd_contexts().decompress, out, raw, in, n) == raw;
+            break;
+#endif
+#ifdef FED_HAVE_ZLIB
+        case CODEC_DEFLATE: {
+            uLongf bytes = raw;
+            ok = uncompress(out, &bytes, in, n) == Z_OK && bytes == raw;
+            break;
+        }
+#endif
+        default:
+            (void)in, (void)n, (void)out;
+            throw std::invalid_argument(std::string("codec ") + codec_name(codec) + " is not built in");
+    }
+    if (!ok) throw std::runtime_error(std::string("corrupt ") + codec_name(codec) + " payload");
+}
+
+// Bytes and time spent on one direction of a connection
+struct CompressionStats {
+    uint64_t messages = 0;
+    uint64_t raw_bytes = 0;
+    uint64_t wire_bytes = 0;
+    double seconds = 0;
+
+    CompressionStats& operator+=(const CompressionStats& other) {
+        messages += other.messages;
+        raw_bytes += other.raw_bytes;
+        wire_bytes += other.wire_bytes;
+        seconds += other.seconds;
+        return *this;
+    }
+};
+
+// The codec agreed for one connection and what it has done
+struct WireCompression {
+    uint16_t codec = CODEC_NONE;
+    int level = 0;
+    uint64_t threshold = DEFAULT_COMPRESS_ABOVE;  // Payloads smaller than this go out as they are
+    CompressionStats sent, received;
+
+    bool enabled() const { return codec != CODEC_NONE; }
+
+    void report() const {
+        if (!enabled()) return;
+        auto direction = [](const char* name, const CompressionStats& stats) {
+            if (stats.messages == 0) return;
+            std::cout << "; " << name << " " << stats.messages << " payloads, " << stats.raw_bytes << " -> "
+                      << stats.wire_bytes << " bytes ("
+                      << static_cast<double>(stats.raw_bytes) / std::max<uint64_t>(stats.wire_bytes, 1) << "x) in "
+                      << stats.seconds * 1e3 << " ms";
+        };
+        std::cout << "[INFO] Compression " << codec_name(codec) << " level " << level;
+        direction("sent", sent);
+        direction("received", received);
+        if (sent.messages == 0 && received.messages == 0) std::cout << "; no payload reached " << threshold << " bytes";
+        std::cout << std::endl;
+    }
+};
+
+// Appends payload parts compressed as one block (behind its uint64 length) to
+// out; returns false, leaving out empty, when that would not be smaller
+template <typename Buffers>
+bool compress_payload(const WireCompression& compression, const Buffers& parts, uint64_t raw,
+                      std::vector<uint8_t>& out, CompressionStats& stats) {
+    if (raw > codec_max_input(compression.codec)) {  // Sent as it is
+        out.clear();
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    thread_local std::vector<uint8_t> gathered;
+    const uint8_t* in = nullptr;
+    size_t count = 0;
+    for (const auto& part : parts) count += part.size() > 0;
+    if (count == 1) {
+        for (const auto& part : parts)
+            if (part.size() > 0) in = static_cast<const uint8_t*>(part.data());
+    } else {
+        gathered.resize(raw);
+        size_t offset = 0;
+        for (const auto& part : parts) {
+            std::memcpy(gathered.data() + offset, part.data(), part.size());
+            offset += part.size();
+        }
+        in = gathered.data();
+    }
+
+    out.resize(sizeof(uint64_t) + compress_bound(compression.codec, raw));
+    std::memcpy(out.data(), &raw, sizeof(raw));
+    size_t bytes = compress_block(compression.codec, compression.level, in, raw, out.data() + sizeof(raw),
+                                  out.size() - sizeof(raw));
+    stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.messages++;
+    stats.raw_bytes += raw;
+    if (sizeof(raw) + bytes >= raw) {
+        stats.wire_bytes += raw;
+        out.clear();
+        return false;
+    }
+    out.resize(sizeof(raw) + bytes);
+    stats.wire_bytes += out.size();
+    return true;
+}
+
+// Uncompressed length of a compressed payload
+inline uint64_t compressed_payload_raw_bytes(const std::vector<uint8_t>& in) {
+    if (in.size() < sizeof(uint64_t)) throw std::runtime_error("compressed payload without a length");
+    uint64_t raw;
+    std::memcpy(&raw, in.data(), sizeof(raw));
+    return raw;
+}
+
+inline void decompress_payload(const WireCompression& compression, const std::vector<uint8_t>& in, uint8_t* out,
+                               CompressionStats& stats) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t raw = compressed_payload_raw_bytes(in);
+    decompress_block(compression.codec, in.data() + sizeof(raw), in.size() - sizeof(raw), out, raw);
+    stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.messages++;
+    stats.raw_bytes += raw;
+    stats.wire_bytes += in.size();
+}
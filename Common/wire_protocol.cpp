@@ -0,0 +1,536 @@
+// Framed client/server messages shared by every algorithm: a fixed header
+// followed by one payload array, written with a single gather write on a
+// TCP_NODELAY or AF_UNIX socket and read back with one read per part.
+// Numbers travel in host byte order, as before. Floating payloads may be sent
+// quantized (fp16, bf16, block-scaled int8); the receiver decodes them back
+// into its own scalar type, and the server replies in the update's encoding.
+// Updates may also be sparse (index, value) pairs, which decode to a dense
+// payload with zeros elsewhere; replies to them are dense. Tree and stump
+// ensembles travel as arrays of fixed-layout records (ensemble_records.cpp);
+// encodings apply only to floating payloads.
+// Clients that set FLAG_ACCEPTS_DELTA may get a model reply as a delta: the
+// coordinates that changed since the model they last received, with their new values.
+// Clients on the server's host may get it through shared memory instead (shared_model.cpp).
+// Every message names a logical client, so one connection can carry many: the
+// server keeps per-client state for each id and answers them in request order.
+// Clients that set FLAG_SUBSCRIBE get no reply to their updates; the server
+// pushes them the newest model instead, whenever it changes and they are not
+// still receiving the previous one.
+// A client may open with MSG_HELLO to agree a payload codec (wire_compression.cpp);
+// large payloads then travel compressed, marked FLAG_COMPRESSED.
+#pragma once
+#include <iostream>
+#include <vector>
+#include <string>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include <stdexcept>
+#include <boost/asio.hpp>
+#include <Eigen/Dense>
+#include "quantize.cpp"
+#include "ensemble_records.cpp"
+#include "shared_model.cpp"
+#include "wire_compression.cpp"
+
+const uint32_t WIRE_MAGIC = 0x31444546;  // "FED1"
+const uint16_t WIRE_VERSION = 2;  // 2: 40-byte header with client_id
+const uint64_t WIRE_MAX_PAYLOAD_BYTES = 1ull << 32;  // Any message; servers cap updates lower (--max-elements)
+
+enum MessageType : uint8_t {
+    MSG_UPDATE = 1,  // client -> server: gradient, local model or statistics
+    MSG_MODEL = 2,   // server -> client: the aggregated model
+    MSG_HELLO = 3,   // client -> server, then back: CompressionSettings offered and agreed
+};
+
+enum MessageFlags : uint8_t {
+    FLAG_ACCEPTS_DELTA = 1,  // On an update: the client keeps the last model it received, so the reply may be a delta
+    FLAG_SHARED_MODEL = 2,   // On an update: the client maps the server's shared model ring, so the reply may point into it
+    FLAG_SUBSCRIBE = 4,      // On an update: send no reply; push this connection each new model from now on
+    FLAG_COMPRESSED = 8,     // Payload is a uint64 length and one block in the connection's codec
+};
+
+// One id per algorithm, so a client pointed at the wrong server fails on the first message
+enum ModelId : uint16_t {
+    MODEL_LOGISTIC_REGRESSION = 1,
+    MODEL_LINEAR_SVM = 2,
+    MODEL_LINEAR_REGRESSION = 3,
+    MODEL_KERNEL_SVM = 4,
+    MODEL_KMEANS = 5,
+    MODEL_NAIVE_BAYES = 6,
+    MODEL_ADABOOST = 7,
+    MODEL_RANDOM_FOREST = 8,
+};
+
+enum WireDtype : uint16_t {
+    WIRE_FLOAT32 = 1,
+    WIRE_FLOAT64 = 2,
+    WIRE_FLOAT16 = 3,     // IEEE half
+    WIRE_BFLOAT16 = 4,    // float32 with the low 16 mantissa bits rounded off
+    WIRE_INT8_BLOCK = 5,  // int8 with a float32 scale per WIRE_INT8_BLOCK_SIZE elements
+    WIRE_SPARSE_FLOAT32 = 6,  // k uint32 indices, then k float32 values; rows x cols is the dense shape
+    WIRE_SPARSE_FLOAT64 = 7,  // the same with float64 values
+    WIRE_DELTA_FLOAT32 = 8,   // Sparse layout, but overwriting the receiver's previous model
+    WIRE_DELTA_FLOAT64 = 9,
+    WIRE_SHARED = 10,         // A uint64 sequence in the shared model ring; rows x cols in the native dtype
+    WIRE_TREE_RECORDS = 11,   // TreeRecord array
+    WIRE_STUMP_RECORDS = 12,  // StumpRecord array
+};
+
+inline bool is_quantized(uint16_t dtype) {
+    return dtype == WIRE_FLOAT16 || dtype == WIRE_BFLOAT16 || dtype == WIRE_INT8_BLOCK;
+}
+
+inline bool is_sparse(uint16_t dtype) {
+    return dtype == WIRE_SPARSE_FLOAT32 || dtype == WIRE_SPARSE_FLOAT64;
+}
+
+inline bool is_delta(uint16_t dtype) {
+    return dtype == WIRE_DELTA_FLOAT32 || dtype == WIRE_DELTA_FLOAT64;
+}
+
+// Payloads that need decoding before use
+inline bool is_encoded(uint16_t dtype) {
+    return is_quantized(dtype) || is_sparse(dtype) || is_delta(dtype);
+}
+
+// Bytes per (index, value) pair of a sparse or delta payload
+inline size_t sparse_entry_bytes(uint16_t dtype) {
+    bool single = dtype == WIRE_SPARSE_FLOAT32 || dtype == WIRE_DELTA_FLOAT32;
+    return sizeof(uint32_t) + (single ? sizeof(float) : sizeof(double));
+}
+
+// Payload bytes for `elements` values in dtype; 0 for an unknown dtype
+inline uint64_t payload_bytes(uint16_t dtype, uint64_t elements) {
+    switch (dtype) {
+        case WIRE_FLOAT32: return elements * sizeof(float);
+        case WIRE_FLOAT64: return elements * sizeof(double);
+        case WIRE_FLOAT16:
+        case WIRE_BFLOAT16: return elements * sizeof(uint16_t);
+        case WIRE_INT8_BLOCK: return int8_block_bytes(elements);
+        case WIRE_TREE_RECORDS: return elements * sizeof(TreeRecord);
+        case WIRE_STUMP_RECORDS: return elements * sizeof(StumpRecord);
+        default: return 0;
+    }
+}
+
+template <typename T> constexpr WireDtype wire_dtype();
+template <> constexpr WireDtype wire_dtype<float>() { return WIRE_FLOAT32; }
+template <> constexpr WireDtype wire_dtype<double>() { return WIRE_FLOAT64; }
+template <> constexpr WireDtype wire_dtype<TreeRecord>() { return WIRE_TREE_RECORDS; }
+template <> constexpr WireDtype wire_dtype<StumpRecord>() { return WIRE_STUMP_RECORDS; }
+
+template <typename T> constexpr WireDtype sparse_dtype();
+template <> constexpr WireDtype sparse_dtype<float>() { return WIRE_SPARSE_FLOAT32; }
+template <> constexpr WireDtype sparse_dtype<double>() { return WIRE_SPARSE_FLOAT64; }
+
+template <typename T> constexpr WireDtype delta_dtype();
+template <> constexpr WireDtype delta_dtype<float>() { return WIRE_DELTA_FLOAT32; }
+template <> constexpr WireDtype delta_dtype<double>() { return WIRE_DELTA_FLOAT64; }
+
+struct MessageHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t type;       // MessageType
+    uint8_t flags;      // MessageFlags
+    uint16_t model_id;  // ModelId
+    uint16_t dtype;     // WireDtype the payload elements are encoded in
+    int32_t count;      // per message type: samples behind an update, learners in an ensemble, ...
+    int32_t rows;       // payload shape; vectors have cols == 1
+    int32_t cols;
+    uint64_t length;    // payload bytes
+    uint32_t client_id; // logical client on a multiplexed connection; 0 when the connection has only one
+    uint32_t applied;   // On a pushed model: this connection's subscribed updates already in it; zero otherwise
+};
+static_assert(sizeof(MessageHeader) == 40, "MessageHeader is sent as raw bytes");
+
+// Payload of MSG_HELLO. The client offers a codec, its level and the smallest
+// payload worth compressing; the server answers with the codec both ends will
+// use (CODEC_NONE when it lacks the one offered) and the level it compresses at.
+struct CompressionSettings {
+    uint16_t codec;     // WireCodec
+    int16_t level;
+    uint32_t threshold;
+};
+static_assert(sizeof(CompressionSettings) == 8, "CompressionSettings is sent as raw bytes");
+
+// A connected TCP or AF_UNIX stream; the framing is the same over both. It
+// carries the compression agreed for the connection and reports it on close.
+class FramedSocket : public boost::asio::generic::stream_protocol::socket {
+public:
+    using Socket = boost::asio::generic::stream_protocol::socket;
+    using Socket::Socket;
+    FramedSocket(Socket&& socket) : Socket(std::move(socket)) {}
+    FramedSocket(FramedSocket&& other) noexcept
+        : Socket(std::move(other)), compression(std::exchange(other.compression, {})) {}
+    FramedSocket& operator=(FramedSocket&& other) {
+        compression.report();
+        Socket::operator=(std::move(other));
+        compression = std::exchange(other.compression, {});
+        return *this;
+    }
+    ~FramedSocket() { compression.report(); }
+
+    WireCompression compression;
+};
+
+// Small request/reply messages must not wait for delayed ACKs (TCP only)
+inline void set_no_delay(FramedSocket& socket) {
+    int family = socket.local_endpoint().protocol().family();
+    if (family == AF_INET || family == AF_INET6) socket.set_option(boost::asio::ip::tcp::no_delay(true));
+}
+
+// --wire native|fp16|bf16|int8 as the encoding for payloads of type T
+template <typename T>
+WireDtype wire_encoding(const std::string& name) {
+    if (name == "native") return wire_dtype<T>();
+    if (name == "fp16") return WIRE_FLOAT16;
+    if (name == "bf16") return WIRE_BFLOAT16;
+    if (name == "int8") return WIRE_INT8_BLOCK;
+    throw std::invalid_argument("unknown wire encoding " + name + " (expected native, fp16, bf16, int8)");
+}
+
+template <typename T>
+void encode_payload(WireDtype encoding, const T* data, size_t n, uint8_t* out) {
+    switch (encoding) {
+        case WIRE_FLOAT16: encode_half(data, n, out); break;
+        case WIRE_BFLOAT16: encode_bfloat16(data, n, out); break;
+        case WIRE_INT8_BLOCK: encode_int8_blocks(data, n, out); break;
+        default: throw std::invalid_argument("not a quantized encoding");
+    }
+}
+
+// Scatters k (index, value) pairs into a dense array of n values
+template <typename Value, typename T>
+void scatter_pairs(const uint8_t* in, size_t k, size_t n, T* data) {
+    const uint8_t* values = in + k * sizeof(uint32_t);
+    for (size_t i = 0; i < k; ++i) {
+        uint32_t index;
+        Value value;
+        std::memcpy(&index, in + i * sizeof(uint32_t), sizeof(index));
+        std::memcpy(&value, values + i * sizeof(Value), sizeof(value));  // Unaligned when k is odd
+        if (index >= n) throw std::runtime_error("sparse index " + std::to_string(index) + " out of range");
+        data[index] = static_cast<T>(value);
+    }
+}
+
+template <typename Value, typename T>
+void decode_sparse(const uint8_t* in, size_t k, size_t n, T* data) {
+    std::fill(data, data + n, T(0));
+    scatter_pairs<Value>(in, k, n, data);
+}
+
+// Decodes `bytes` of payload in encoding into n dense values; a delta
+// updates the n values already in data
+template <typename T>
+void decode_payload(uint16_t encoding, const uint8_t* in, size_t bytes, size_t n, T* data) {
+    switch (encoding) {
+        case WIRE_FLOAT16: decode_half(in, n, data); break;
+        case WIRE_BFLOAT16: decode_bfloat16(in, n, data); break;
+        case WIRE_INT8_BLOCK: decode_int8_blocks(in, n, data); break;
+        case WIRE_SPARSE_FLOAT32: decode_sparse<float>(in, bytes / sparse_entry_bytes(encoding), n, data); break;
+        case WIRE_SPARSE_FLOAT64: decode_sparse<double>(in, bytes / sparse_entry_bytes(encoding), n, data); break;
+        case WIRE_DELTA_FLOAT32: scatter_pairs<float>(in, bytes / sparse_entry_bytes(encoding), n, data); break;
+        case WIRE_DELTA_FLOAT64: scatter_pairs<double>(in, bytes / sparse_entry_bytes(encoding), n, data); break;
+        default: throw std::invalid_argument("not an encoded payload");
+    }
+}
+
+template <typename T>
+MessageHeader make_header(MessageType type, ModelId model_id, int count, Eigen::Index rows, Eigen::Index cols,
+                          WireDtype encoding = wire_dtype<T>(), uint8_t flags = 0, uint32_t client_id = 0) {
+    MessageHeader header = {};
+    header.magic = WIRE_MAGIC;
+    header.version = WIRE_VERSION;
+    header.type = type;
+    header.flags = flags;
+    if (type == MSG_UPDATE && !shared_model_name().empty()) header.flags |= FLAG_SHARED_MODEL;  // --transport shm
+    header.model_id = model_id;
+    header.dtype = encoding;
+    header.count = count;
+    header.rows = static_cast<int32_t>(rows);
+    header.cols = static_cast<int32_t>(cols);
+    header.length = payload_bytes(encoding, static_cast<uint64_t>(rows) * cols);
+    header.client_id = client_id;
+    return header;
+}
+
+// Header and payload as one gather write. Payloads of at least the
+// connection's threshold are compressed into `compressed` first, and sent
+// that way when it makes them smaller. header must outlive the write.
+template <size_t N>
+std::array<boost::asio::const_buffer, N + 1> frame_message(FramedSocket& socket, MessageHeader& header,
+                                                           const std::array<boost::asio::const_buffer, N>& payload,
+                                                           std::vector<uint8_t>& compressed) {
+    std::array<boost::asio::const_buffer, N + 1> buffers;
+    buffers[0] = boost::asio::buffer(&header, sizeof(header));
+    if (socket.compression.enabled() && header.length >= socket.compression.threshold &&
+        compress_payload(socket.compression, payload, header.length, compressed, socket.compression.sent)) {
+        header.flags |= FLAG_COMPRESSED;
+        header.length = compressed.size();
+        buffers[1] = boost::asio::buffer(compressed);
+        return buffers;
+    }
+    std::copy(payload.begin(), payload.end(), buffers.begin() + 1);
+    return buffers;
+}
+
+// Writes a message framed into a per-thread compression buffer
+template <size_t N>
+void write_message(FramedSocket& socket, MessageHeader& header, const std::array<boost::asio::const_buffer, N>& payload) {
+    thread_local std::vector<uint8_t> compressed;
+    boost::asio::write(socket, frame_message(socket, header, payload, compressed));
+}
+
+// The payload bytes of a dense message: quantized ones are encoded into `encoded` first
+template <typename T>
+boost::asio::const_buffer encode_message(const MessageHeader& header, const T* data, size_t n,
+                                         std::vector<uint8_t>& encoded) {
+    if constexpr (std::is_floating_point_v<T>) {
+        if (is_quantized(header.dtype)) {
+            encoded.resize(header.length);
+            encode_payload(static_cast<WireDtype>(header.dtype), data, n, encoded.data());
+            return boost::asio::buffer(encoded.data(), header.length);
+        }
+    }
+    return boost::asio::buffer(data, header.length);
+}
+
+// Quantized payloads are encoded into a per-thread buffer first
+template <typename T>
+void send_message(FramedSocket& socket, MessageType type, ModelId model_id, int count,
+                  const T* data, Eigen::Index rows, Eigen::Index cols, WireDtype encoding = wire_dtype<T>(),
+                  uint8_t flags = 0, uint32_t client_id = 0) {
+    thread_local std::vector<uint8_t> encoded;
+    MessageHeader header = make_header<T>(type, model_id, count, rows, cols, encoding, flags, client_id);
+    write_message(socket, header, std::array<boost::asio::const_buffer, 1>{
+                                      encode_message(header, data, static_cast<size_t>(rows) * cols, encoded)});
+}
+
+// Matrices travel in their own storage order; both ends use the same type
+template <typename Derived>
+void send_message(FramedSocket& socket, MessageType type, ModelId model_id, int count,
+                  const Eigen::PlainObjectBase<Derived>& payload,
+                  WireDtype encoding = wire_dtype<typename Derived::Scalar>(), uint8_t flags = 0,
+                  uint32_t client_id = 0) {
+    send_message(socket, type, model_id, count, payload.data(), payload.rows(), payload.cols(), encoding, flags,
+                 client_id);
+}
+
+template <typename T>
+void send_message(FramedSocket& socket, MessageType type, ModelId model_id, int count,
+                  const std::vector<T>& payload, WireDtype encoding = wire_dtype<T>(), uint8_t flags = 0,
+                  uint32_t client_id = 0) {
+    send_message(socket, type, model_id, count, payload.data(), payload.size(), 1, encoding, flags, client_id);
+}
+
+// Sends the coordinates `indices` of a dense vector of size n; the receiver
+// sees that vector with every other coordinate zero
+template <typename T>
+void send_sparse_message(FramedSocket& socket, MessageType type, ModelId model_id, int count,
+                         Eigen::Index n, const std::vector<uint32_t>& indices, const std::vector<T>& values,
+                         uint8_t flags = 0, uint32_t client_id = 0) {
+    MessageHeader header = make_header<T>(type, model_id, count, n, 1, wire_dtype<T>(), flags, client_id);
+    header.dtype = sparse_dtype<T>();
+    header.length = indices.size() * sparse_entry_bytes(header.dtype);
+    std::array<boost::asio::const_buffer, 2> payload = {
+        boost::asio::buffer(indices.data(), indices.size() * sizeof(uint32_t)),
+        boost::asio::buffer(values.data(), values.size() * sizeof(T))};
+    write_message(socket, header, payload);
+}
+
+// Throws unless the payload length fits the header's shape and dtype
+inline void check_payload_length(const MessageHeader& header) {
+    bool pairs = is_sparse(header.dtype) || is_delta(header.dtype);
+    bool shared = header.dtype == WIRE_SHARED;
+    uint64_t elements = static_cast<uint64_t>(header.rows) * header.cols;
+    bool length_ok = pairs ? header.length % sparse_entry_bytes(header.dtype) == 0 &&
+                                  header.length / sparse_entry_bytes(header.dtype) <= elements
+                   : shared ? header.length == sizeof(uint64_t)
+                            : header.length == payload_bytes(header.dtype, elements);
+    if (header.length > WIRE_MAX_PAYLOAD_BYTES || !length_ok)
+        throw std::runtime_error("invalid payload size " + std::to_string(header.length));
+}
+
+// Throws unless header starts a well-formed message of the expected kind,
+// with elements in dtype, in a quantized encoding, as sparse or delta pairs
+// in dtype's precision, or (for a model) in the shared model ring. Its shape
+// must fit WIRE_MAX_PAYLOAD_BYTES in dtype whatever the encoding, as the
+// receiver allocates it before reading the payload. The length of a
+// compressed payload is checked once its uncompressed length is read.
+inline void check_header(const MessageHeader& header, MessageType type, ModelId model_id, WireDtype dtype) {
+    if (header.magic != WIRE_MAGIC || header.version != WIRE_VERSION)
+        throw std::runtime_error("not a framed message (bad magic or version)");
+    if (header.model_id != model_id)
+        throw std::runtime_error("message for model " + std::to_string(header.model_id) +
+                                 ", expected " + std::to_string(model_id) + " (wrong client/server pair?)");
+    if (header.type != type)
+        throw std::runtime_error("unexpected message type " + std::to_string(header.type));
+    bool single = dtype == WIRE_FLOAT32;
+    bool floating = single || dtype == WIRE_FLOAT64;
+    bool pairs = header.dtype == (single ? WIRE_SPARSE_FLOAT32 : WIRE_SPARSE_FLOAT64) ||
+                 header.dtype == (single ? WIRE_DELTA_FLOAT32 : WIRE_DELTA_FLOAT64);
+    bool shared = type == MSG_MODEL && header.dtype == WIRE_SHARED;
+    if (header.dtype != dtype && !(floating && (is_quantized(header.dtype) || pairs)) && !shared)
+        throw std::runtime_error("payload dtype mismatch (are both ends built with the same FED_FLOAT32 setting?)");
+    uint64_t elements = static_cast<uint64_t>(header.rows) * header.cols;
+    if (header.rows < 0 || header.cols < 0 || elements > WIRE_MAX_PAYLOAD_BYTES ||
+        payload_bytes(dtype, elements) > WIRE_MAX_PAYLOAD_BYTES)
+        throw std::runtime_error("invalid payload shape " + std::to_string(header.rows) + "x" +
+                                 std::to_string(header.cols));
+    if (!(header.flags & FLAG_COMPRESSED)) return check_payload_length(header);
+    if (header.length < sizeof(uint64_t) || header.length > WIRE_MAX_PAYLOAD_BYTES)
+        throw std::runtime_error("invalid compressed payload size " + std::to_string(header.length));
+}
+
+// Throws unless header starts a MSG_HELLO; the hello precedes any model
+inline void check_hello(const MessageHeader& header) {
+    if (header.magic != WIRE_MAGIC || header.version != WIRE_VERSION)
+        throw std::runtime_error("not a framed message (bad magic or version)");
+    if (header.type != MSG_HELLO || header.length != sizeof(CompressionSettings))
+        throw std::runtime_error("malformed hello");
+}
+
+inline MessageHeader make_hello_header() {
+    MessageHeader header = {};
+    header.magic = WIRE_MAGIC;
+    header.version = WIRE_VERSION;
+    header.type = MSG_HELLO;
+    header.length = sizeof(CompressionSettings);
+    return header;
+}
+
+// Client side of MSG_HELLO: offers codec and adopts what the server agrees to.
+// Sent before the first update, so no other message is in flight.
+inline CompressionSettings negotiate_compression(FramedSocket& socket, WireCodec codec, int level, uint64_t threshold) {
+    MessageHeader header = make_hello_header();
+    CompressionSettings settings = {codec, static_cast<int16_t>(level), static_cast<uint32_t>(threshold)};
+    std::array<boost::asio::const_buffer, 2> buffers = {
+        boost::asio::buffer(&header, sizeof(header)),
+        boost::asio::buffer(&settings, sizeof(settings))};
+    boost::asio::write(socket, buffers);
+    boost::asio::read(socket, boost::asio::buffer(&header, sizeof(header)));
+    check_hello(header);
+    boost::asio::read(socket, boost::asio::buffer(&settings, sizeof(settings)));
+    if (!codec_available(settings.codec)) throw std::runtime_error("server answered with an unknown codec");
+    socket.compression.codec = settings.codec;
+    socket.compression.level = level;
+    socket.compression.threshold = settings.threshold;
+    return settings;
+}
+
+// Reads and checks a header; returns false when the peer closed the
+// connection cleanly instead of starting a message
+inline bool receive_header(FramedSocket& socket, MessageType type, ModelId model_id,
+                           WireDtype dtype, MessageHeader& header) {
+    boost::system::error_code ec;
+    boost::asio::read(socket, boost::asio::buffer(&header, sizeof(header)), ec);
+    if (ec == boost::asio::error::eof) return false;
+    if (ec) throw boost::system::system_error(ec);
+    check_header(header, type, model_id, dtype);
+    return true;
+}
+
+// Payload shape helpers, so Eigen objects and std::vector share one code path
+template <typename Derived>
+Eigen::Index payload_rows(const Eigen::PlainObjectBase<Derived>& payload) { return payload.rows(); }
+template <typename Derived>
+Eigen::Index payload_cols(const Eigen::PlainObjectBase<Derived>& payload) { return payload.cols(); }
+template <typename T>
+Eigen::Index payload_rows(const std::vector<T>& payload) { return payload.size(); }
+template <typename T>
+Eigen::Index payload_cols(const std::vector<T>&) { return 1; }
+
+// Resizes payload to the shape announced in a checked header
+template <typename Derived>
+void resize_payload(Eigen::PlainObjectBase<Derived>& payload, const MessageHeader& header) {
+    if (Derived::ColsAtCompileTime == 1 && header.cols != 1)
+        throw std::runtime_error("expected a vector payload");
+    payload.resize(header.rows, header.cols);
+}
+
+template <typename T>
+void resize_payload(std::vector<T>& payload, const MessageHeader& header) {
+    payload.resize(static_cast<size_t>(header.rows) * header.cols);
+}
+
+// Where a message's payload is received, besides the payload itself
+struct ReceiveBuffers {
+    std::vector<uint8_t> block;    // Compressed payload
+    std::vector<uint8_t> encoded;  // Quantized, sparse or delta payload
+    uint64_t sequence = 0;         // Slot of a shared model
+};
+
+// Where the uncompressed bytes of a checked, uncompressed header belong
+template <typename Payload>
+void* payload_destination(const MessageHeader& received, Payload& payload, ReceiveBuffers& buffers) {
+    if (is_encoded(received.dtype)) {
+        buffers.encoded.resize(received.length);
+        return buffers.encoded.data();
+    }
+    if (received.dtype == WIRE_SHARED) return &buffers.sequence;
+    return payload.data();
+}
+
+// Returns the buffer the payload bytes of the checked header `received` are to
+// be read into, resizing payload to its shape; finish_payload then turns them
+// into the model. A compressed payload is resized only there, once its
+// uncompressed length is known to fit the shape. A delta reply is applied to
+// payload, which must still hold the model received last.
+template <typename Payload>
+boost::asio::mutable_buffer payload_buffer(FramedSocket& socket, const MessageHeader& received, Payload& payload,
+                                           ReceiveBuffers& buffers) {
+    if (is_delta(received.dtype) &&
+        (payload_rows(payload) != received.rows || payload_cols(payload) != received.cols))
+        throw std::runtime_error("delta reply does not match the shape of the previous model");
+    if (received.flags & FLAG_COMPRESSED) {
+        if (!socket.compression.enabled())
+            throw std::runtime_error("compressed payload on a connection that agreed no codec");
+        buffers.block.resize(received.length);
+        return boost::asio::buffer(buffers.block);
+    }
+    resize_payload(payload, received);
+    return boost::asio::buffer(payload_destination(received, payload, buffers), received.length);
+}
+
+// A compressed payload is inflated to where the uncompressed bytes would have
+// been read, then encoded ones are decoded and a shared model copied out of
+// the shared model ring. received becomes the uncompressed message's header.
+template <typename Payload>
+void finish_payload(FramedSocket& socket, MessageHeader& received, Payload& payload, ReceiveBuffers& buffers) {
+    using T = typename Payload::value_type;
+    if (received.flags & FLAG_COMPRESSED) {
+        received.length = compressed_payload_raw_bytes(buffers.block);
+        received.flags &= ~FLAG_COMPRESSED;
+        check_payload_length(received);
+        resize_payload(payload, received);
+        decompress_payload(socket.compression, buffers.block,
+                           static_cast<uint8_t*>(payload_destination(received, payload, buffers)),
+                           socket.compression.received);
+    }
+    if (is_encoded(received.dtype)) {
+        if constexpr (std::is_floating_point_v<T>)  // check_header admits encodings for nothing else
+            decode_payload(received.dtype, buffers.encoded.data(), buffers.encoded.size(), payload.size(),
+                           payload.data());
+    } else if (received.dtype == WIRE_SHARED) {
+        shared_model_reader().read(buffers.sequence, payload.data(), payload.size() * sizeof(T));
+    }
+}
+
+// Receives one message into payload, resized to the sender's shape, through
+// per-thread buffers; the header is returned through `header` when given
+template <typename Payload>
+bool receive_message(FramedSocket& socket, MessageType type, ModelId model_id,
+                     Payload& payload, MessageHeader* header = nullptr) {
+    using T = typename Payload::value_type;
+    thread_local ReceiveBuffers buffers;
+    MessageHeader received;
+    if (!receive_header(socket, type, model_id, wire_dtype<T>(), received)) return false;
+    boost::asio::read(socket, payload_buffer(socket, received, payload, buffers));
+    finish_payload(socket, received, payload, buffers);
+    if (header) *header = received;
+    return true;
+}
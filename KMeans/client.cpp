@@ -3,10 +3,14 @@
 #include <vector>
 #include <algorithm>
 #include <random>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
 #include <numeric>
-#include "data_loader.cpp"
+#include "../Common/datasets.cpp"
+#include "../Common/client_options.cpp"
+#include "../Common/scalar.cpp"
+#include "../Common/wire_protocol.cpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
@@ -16,8 +20,8 @@ const int MAX_ITERS = 100;
 const int NETWORK_BATCH_SIZE = 100;
 
 // Function to simulate local data
-MatrixXd load_local_data() {
-    MatrixXd data(4, 2);
+MatrixXs load_local_data() {
+    MatrixXs data(4, 2);
     data << 1.0, 2.0,
             2.0, 1.0,
             3.0, 4.0,
@@ -26,14 +30,14 @@ MatrixXd load_local_data() {
 }
 
 // Random initialization of centroids
-MatrixXd initialize_centroids(const MatrixXd& data, int k) {
+MatrixXs initialize_centroids(const MatrixXs& data, int k) {
     std::vector<int> indices(data.rows());
     std::iota(indices.begin(), indices.end(), 0);
     std::random_device rd;
     std::mt19937 g(rd());
     std::shuffle(indices.begin(), indices.end(), g);
 
-    MatrixXd centroids(k, data.cols());
+    MatrixXs centroids(k, data.cols());
     for (int i = 0; i < k; ++i) {
         centroids.row(i) = data.row(indices[i]);
     }
@@ -41,18 +45,18 @@ MatrixXd initialize_centroids(const MatrixXd& data, int k) {
 }
 
 // One iteration of local KMeans
-MatrixXd kmeans_single_iter(const MatrixXd& data, const MatrixXd& centroids) {
+MatrixXs kmeans_single_iter(const MatrixXs& data, const MatrixXs& centroids) {
     int n_samples = data.rows();
     int k = centroids.rows();
     VectorXi labels(n_samples);
 
     for (int i = 0; i < n_samples; ++i) {
-        RowVectorXd point = data.row(i);
-        VectorXd distances = (centroids.rowwise() - point).rowwise().squaredNorm();
+        RowVectorXs point = data.row(i);
+        VectorXs distances = (centroids.rowwise() - point).rowwise().squaredNorm();
         distances.minCoeff(&labels(i));
     }
 
-    MatrixXd new_centroids = MatrixXd::Zero(k, data.cols());
+    MatrixXs new_centroids = MatrixXs::Zero(k, data.cols());
     std::vector<int> counts(k, 0);
 
     for (int i = 0; i < n_samples; ++i) {
@@ -68,50 +72,30 @@ MatrixXd kmeans_single_iter(const MatrixXd& data, const MatrixXd& centroids) {
     return new_centroids;
 }
 
-void send_matrix(tcp::socket& socket, const MatrixXd& matrix) {
-    int rows = matrix.rows(), cols = matrix.cols();
-    boost::asio::write(socket, boost::asio::buffer(&rows, sizeof(int)));
-    boost::asio::write(socket, boost::asio::buffer(&cols, sizeof(int)));
-    boost::asio::write(socket, boost::asio::buffer(matrix.data(), rows * cols * sizeof(double)));
-}
-
-void receive_matrix(tcp::socket& socket, MatrixXd& matrix) {
-    int rows, cols;
-    boost::asio::read(socket, boost::asio::buffer(&rows, sizeof(int)));
-    boost::asio::read(socket, boost::asio::buffer(&cols, sizeof(int)));
-    matrix.resize(rows, cols);
-    boost::asio::read(socket, boost::asio::buffer(matrix.data(), rows * cols * sizeof(double)));
-}
-
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        ClientOptions options = parse_client_options(argc, argv);
+        reject_unsupported(options, OPTION_SHARD, "KMeans");
         boost::asio::io_context io_context;
-        tcp::socket socket(io_context);
-        socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        FramedSocket socket = connect_to_server(io_context, options);
         
-        std::vector<float> features;
-        std::vector<int> labels;
-       
-        load_data("../Datasets/circles.csv", features, labels);
-        // Convert to Eigen matrices
-        MatrixXd local_data(features.size(), 2);
-        for (size_t i = 0; i < features.size(); ++i) {
-                local_data(i, 0) = features[i];
-                local_data(i, 1) = labels[i];
-            }
+        MatrixXs local_data;
+        load_data("../Datasets/circles.csv", shard_of(circles_schema(), options), local_data);
 
         //data = local_data;
-        MatrixXd centroids = initialize_centroids(local_data, K);
+        MatrixXs centroids = initialize_centroids(local_data, K);
 
 
         for (int iter = 0; iter < MAX_ITERS; ++iter) {
-            MatrixXd local_centroids = kmeans_single_iter(local_data, centroids);
+            MatrixXs local_centroids = kmeans_single_iter(local_data, centroids);
 
-            // Send local centroids
-            send_matrix(socket, local_centroids);
+            // Send local centroids; centroids only ever holds the last reply, so the
+            // server may answer with just the coordinates that changed since
+            send_message(socket, MSG_UPDATE, MODEL_KMEANS, local_data.rows(), local_centroids,
+                         wire_dtype<Scalar>(), FLAG_ACCEPTS_DELTA);
 
             // Receive updated global centroids
-            receive_matrix(socket, centroids);
+            receive_message(socket, MSG_MODEL, MODEL_KMEANS, centroids);
 
             std::cout << "[INFO] Iteration " << iter + 1 << " updated centroids:\n" << centroids << std::endl;
         }
@@ -2,11 +2,14 @@
 #include <vector>
 #include <algorithm>
 #include <random>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
-#include "data_loader.cpp"
-//#include "data_loader_susy.cpp"
-//#include "data_loader_higgs.cpp"
+#include "../Common/datasets.cpp"
+#include "../Common/scalar.cpp"
+#include "../Common/client_options.cpp"
+#include "../Common/awaitable_protocol.cpp"
+// g++ -std=c++20 client.cpp -o client -I /usr/include/eigen3 -pthread
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
@@ -14,103 +17,87 @@ using boost::asio::ip::tcp;
 const int MAX_EPOCHS = 3;
 const double EPSILON = 1e-5;
 const int TRAIN_BATCH_SIZE = 30;
-const int NETWORK_BATCH_SIZE = 30;
+WireDtype update_encoding = wire_dtype<Scalar>();  // --wire: encoding of each update; the server replies in kind
 
-double rbf_kernel(const VectorXd& x1, const VectorXd& x2, double gamma = 0.1) {
+Scalar rbf_kernel(const Ref<const RowVectorXs>& x1, const Ref<const RowVectorXs>& x2, Scalar gamma = 0.1) {
     return std::exp(-gamma * (x1 - x2).squaredNorm());
 }
 
-void send_in_batches(tcp::socket& socket, const VectorXd& data) {
-    int total_size = data.size();
-    for (int i = 0; i < total_size; i += NETWORK_BATCH_SIZE) {
-        int batch_size = std::min(NETWORK_BATCH_SIZE, total_size - i);
-        boost::asio::write(socket, boost::asio::buffer(data.data() + i, batch_size * sizeof(double)));
-    }
-}
-
-bool train_incrementally(const MatrixXd& data, const VectorXd& labels,
-                         VectorXd& weights, double learning_rate,
-                         double gamma, tcp::socket& socket) {
-    //std::cout<<"Inside Function 1"<<std::endl;
+// Trains in slices of n/TRAIN_BATCH_SIZE samples, one per epoch, each
+// picking up where the last stopped, and trades weights with the server after
+// every TRAIN_BATCH_SIZE samples
+awaitable<void> train(FramedSocket& socket, const RowMatrixXs& data, const VectorXs& labels, VectorXs& weights,
+                      Scalar learning_rate, Scalar gamma) {
+    MessageBuffers buffers;
     int n_samples = data.rows();
-    static int last_sample = 0;
-    VectorXd gradient = VectorXd::Zero(weights.size());
-    int current_sample = last_sample;
-    int processed_samples = 0;
+    int current_sample = 0;
     int Iteration = n_samples / TRAIN_BATCH_SIZE;
 
-    while (processed_samples < Iteration) {
-        if (current_sample >= n_samples) return true; // All samples processed
-        std::cout<<current_sample<<std::endl;
+    for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
+        VectorXs gradient = VectorXs::Zero(weights.size());
+        int processed_samples = 0;
 
-        VectorXd xi = data.row(current_sample);
-        double yi = labels(current_sample);
-        double kernel_output = 0.0;
+        while (processed_samples < Iteration) {
+            if (current_sample >= n_samples) co_return; // All samples processed
+            std::cout<<current_sample<<std::endl;
 
-        for (int j = 0; j < weights.size(); ++j)
-            kernel_output += rbf_kernel(xi, data.row(j), gamma) * weights(j);
+            auto xi = data.row(current_sample);
+            Scalar yi = labels(current_sample);
+            Scalar kernel_output = 0;
 
-        if (yi * kernel_output < 1) {
             for (int j = 0; j < weights.size(); ++j)
-                gradient(j) += -yi * rbf_kernel(data.row(j), xi, gamma);
-        }
-
-        weights -= learning_rate * gradient;
-        current_sample++;
-        processed_samples++;
-
-        if (processed_samples % TRAIN_BATCH_SIZE == 0) {
-            int batch_size = TRAIN_BATCH_SIZE;
-            int vector_size = weights.size();
-            boost::asio::write(socket, boost::asio::buffer(&batch_size, sizeof(int)));
-            boost::asio::write(socket, boost::asio::buffer(&vector_size, sizeof(int)));
-            send_in_batches(socket, weights);
-            boost::asio::read(socket, boost::asio::buffer(weights.data(), weights.size() * sizeof(double)));
-            std::cout<<"Send and Recieved"<<std::endl;
+                kernel_output += rbf_kernel(xi, data.row(j), gamma) * weights(j);
+
+            if (yi * kernel_output < 1) {
+                for (int j = 0; j < weights.size(); ++j)
+                    gradient(j) += -yi * rbf_kernel(data.row(j), xi, gamma);
+            }
+
+            weights -= learning_rate * gradient;
+            current_sample++;
+            processed_samples++;
+
+            if (processed_samples % TRAIN_BATCH_SIZE == 0) {
+                co_await async_send_message(socket, buffers, MSG_UPDATE, MODEL_KERNEL_SVM, TRAIN_BATCH_SIZE, weights,
+                                            update_encoding);
+                co_await async_receive_message(socket, buffers, MSG_MODEL, MODEL_KERNEL_SVM, weights);
+                std::cout<<"Send and Recieved"<<std::endl;
+            }
         }
     }
-
-    last_sample = current_sample;
-    return false;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
-        std::vector<std::vector<float>> features;
-        std::vector<int> labels;
-        load_data("../Datasets/santander-customer-transaction-prediction.csv", features, labels);
-        //load_data("../Datasets/SUSY.csv", features, labels);
-        //load_data("../Datasets/HIGGS.csv", features, labels);
-
-        MatrixXd local_data(features.size(), features[0].size());
-        VectorXd local_labels(labels.size());
-        for (size_t i = 0; i < features.size(); ++i) {
-            for (size_t j = 0; j < features[i].size(); ++j)
-                local_data(i, j) = features[i][j];
-            local_labels(i) = labels[i];
-        }
+        ClientOptions options = parse_client_options(argc, argv);
+        reject_unsupported(options, OPTION_WIRE, "KernelSVM");  // Weights are per local sample
+        update_encoding = wire_encoding<Scalar>(options.wire);
+
+        RowMatrixXs local_data;
+        VectorXs local_labels;
+        load_data("../Datasets/santander-customer-transaction-prediction.csv", santander_schema(), local_data, local_labels);
+        //load_data("../Datasets/SUSY.csv", susy_schema(), local_data, local_labels);
+        //load_data("../Datasets/HIGGS.csv", higgs_schema(), local_data, local_labels);
 
         std::random_device rd;
         std::mt19937 gen(rd());
         std::normal_distribution<> d(0, 0.01);
-        VectorXd local_weights = VectorXd::Zero(local_data.rows()).unaryExpr([&](double) { return d(gen); });
+        VectorXs local_weights = VectorXs::Zero(local_data.rows()).unaryExpr([&](Scalar) { return Scalar(d(gen)); });
 
-        double learning_rate = 0.01;
-        double gamma = 0.1;
+        Scalar learning_rate = 0.01;
+        Scalar gamma = 0.1;
 
         boost::asio::io_context io_context;
-        tcp::socket socket(io_context);
         std::cout << "[DEBUG] Connecting to server..." << std::endl;
-        socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        FramedSocket socket = connect_to_server(io_context, options);
         std::cout << "[DEBUG] Connected to server." << std::endl;
 
         // int vector_size = local_weights.size();
         // boost::asio::write(socket, boost::asio::buffer(&vector_size, sizeof(int)));
 
-        for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
-            bool exit = train_incrementally(local_data, local_labels, local_weights, learning_rate, gamma, socket);
-            if (exit) break;
-        }
+        boost::asio::co_spawn(io_context, train(socket, local_data, local_labels, local_weights, learning_rate, gamma),
+                              rethrow_if_failed);
+        io_context.run();
 
         socket.close();
     } catch (const std::exception& e) {
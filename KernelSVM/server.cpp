@@ -1,82 +1,48 @@
 #include <iostream>
 #include <vector>
-#include <thread>
+#include <utility>
 #include <boost/asio.hpp>
 #include <mutex>
 #include <Eigen/Dense>
+#include "../Common/scalar.cpp"
+#include "../Common/async_server.cpp"
+// g++ -std=c++20 server.cpp -o server -I /usr/include/eigen3 -pthread
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
+const uint64_t MAX_UPDATE_ELEMENTS = 1000000000;  // One weight per sample (--max-elements)
+
 std::mutex model_mutex;
-VectorXd global_weights;
-VectorXd total_weights;
+VectorXs global_weights;  // Average sent back to clients, in the wire scalar type
+VectorXa total_weights;   // Running sum, in the accumulator precision
 int client_count = 0;
 
-const int BATCH_SIZE = 30;
-
-void aggregate_model(const VectorXd& local_update) {
+template <typename Derived>
+void aggregate_model(const MatrixBase<Derived>& local_update) {
     std::lock_guard<std::mutex> lock(model_mutex);
-    if (total_weights.size() == 0) total_weights = VectorXd::Zero(local_update.size());
-    total_weights += local_update;
+    if (total_weights.size() == 0) total_weights = VectorXa::Zero(local_update.size());
+    total_weights += local_update.template cast<Accumulator>();
     client_count++;
-    global_weights = total_weights / client_count;
+    global_weights = (total_weights / client_count).template cast<Scalar>();
 }
 
-void handle_client(tcp::socket socket) {
-    try {
-
-        std::cout<<"Client Connected"<<std::endl;
-        
-        //boost::asio::read(socket, boost::asio::buffer(&vector_size, sizeof(int)));
-
-        while (true) {
-            int batch_size = 0;
-            int vector_size = 0;
-            //std::cout<<"Before Read"<<std::endl;
-            boost::asio::read(socket, boost::asio::buffer(&batch_size, sizeof(int)));
-            boost::asio::read(socket, boost::asio::buffer(&vector_size, sizeof(int)));
-            //std::cout<<"After Read"<<std::endl;
-            if (vector_size <= 0 || vector_size > 1e9) {
-                std::cerr << "[ERROR] Invalid vector size: " << vector_size << std::endl;
-                return;
-            }
-
-            VectorXd local_update = VectorXd::Zero(vector_size);
-            int received = 0;
-
-            while (received < vector_size) {
-                int chunk_size = std::min(BATCH_SIZE, vector_size - received);
-                boost::asio::read(socket, boost::asio::buffer(local_update.data() + received, chunk_size * sizeof(double)));
-                received += chunk_size;
-            }
-
-            aggregate_model(local_update);
+int handle_update(const MessageHeader&, VectorXs& payload, ModelStamp& stamp) {
+    aggregate_model(payload);
 
-            boost::asio::write(socket, boost::asio::buffer(global_weights.data(), global_weights.size() * sizeof(double)));
-            std::cout<<"Send and Recieved"<<std::endl;
-        }
-
-    } catch (const std::exception& e) {
-        std::cerr << "[ERROR] Exception in handle_client: " << e.what() << std::endl;
-    }
+    std::lock_guard<std::mutex> lock(model_mutex);
+    payload = global_weights;
+    stamp.stamp();
+    std::cout<<"Send and Recieved"<<std::endl;
+    return 0;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
-        boost::asio::io_context io_context;
-        tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 8080));
-        std::cout << "[INFO] Server started. Waiting for clients..." << std::endl;
-
-        while (true) {
-            tcp::socket socket(io_context);
-            acceptor.accept(socket);
-            std::thread(handle_client, std::move(socket)).detach();
-        }
-
+        ServerOptions options = parse_server_options(argc, argv, MAX_UPDATE_ELEMENTS);
+        run_framed_server<VectorXs>(options, MODEL_KERNEL_SVM, handle_update);
     } catch (const std::exception& e) {
         std::cerr << "[ERROR] Exception in server: " << e.what() << std::endl;
     }
-
     return 0;
 }
@@ -3,30 +3,38 @@
 #include <vector>
 #include <algorithm>
 #include <random>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
-//#include "data_loader.cpp"
-//#include "data_loader_susy.cpp"
-#include "data_loader_higgs.cpp"
+#include "../Common/datasets.cpp"
+#include "../Common/block_reader.cpp"
+#include "../Common/scalar.cpp"
+#include "../Common/client_options.cpp"
+#include "../Common/wire_protocol.cpp"
+#include "../Common/sparsify.cpp"
+#include "../Common/prefetcher.cpp"
+#include "../Common/subscription.cpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
-const double LEARNING_RATE = 0.01;
+const Scalar LEARNING_RATE = 0.01;
 const int MAX_EPOCHS = 1;
 const int TRAIN_BATCH_SIZE = 2;
-const int NETWORK_BATCH_SIZE = 100;
+WireDtype update_encoding = wire_dtype<Scalar>();  // --wire: encoding of each update; the server replies in kind
+TopKSparsifier sparsifier;  // --top-k: sparse updates with error feedback
+ModelSubscription<VectorXs>* subscription = nullptr;  // --subscribe: updates are not answered, models are pushed
 
 // Hinge loss derivative for Linear SVM
-VectorXd compute_svm_gradient(const MatrixXd& X, const VectorXd& y, const VectorXd& weights) {
-    VectorXd gradient = VectorXd::Zero(weights.size());
+VectorXs compute_svm_gradient(const RowMatrixXs& X, const VectorXs& y, const VectorXs& weights) {
+    VectorXs gradient = VectorXs::Zero(weights.size());
     int n = X.rows();
 
     for (int i = 0; i < n; ++i) {
-        VectorXd xi = X.row(i);
-        double yi = y(i);
+        auto xi = X.row(i);
+        Scalar yi = y(i);
         if (yi * xi.dot(weights) < 1) {
-            gradient -= yi * xi;
+            gradient -= yi * xi.transpose();
         }
     }
 
@@ -34,19 +42,34 @@ VectorXd compute_svm_gradient(const MatrixXd& X, const VectorXd& y, const Vector
     return gradient;
 }
 
-void send_in_batches(tcp::socket& socket, const VectorXd& data) {
-    int total_size = data.size();
-    int sent = 0;
-    while (sent < total_size) {
-        int batch_size = std::min(NETWORK_BATCH_SIZE, total_size - sent);
-        boost::asio::write(socket, boost::asio::buffer(data.data() + sent, batch_size * sizeof(double)));
-        sent += batch_size;
+// Minibatch loop over one epoch; batch_X for step t+1 is gathered on the
+// prefetch thread while step t trains
+void train_on_batches(FramedSocket& socket, Prefetcher<RowBatch>& batches, VectorXs& weights) {
+    RowBatch batch;
+    while (batches.next(batch)) {
+        int batch_size = batch.features.rows();
+        VectorXs gradient = compute_svm_gradient(batch.features, batch.labels, weights);
+
+        if (subscription) {
+            // Send and carry on with the newest model pushed so far; no round trip per batch
+            send_gradient(socket, MODEL_LINEAR_SVM, batch_size, gradient, update_encoding, sparsifier,
+                          FLAG_ACCEPTS_DELTA | FLAG_SUBSCRIBE);
+            subscription->sent_update();
+            subscription->latest(weights);
+        } else {
+            // Send the gradient and its batch size as one message, then receive the updated global model.
+            // weights only ever holds the last reply, so the server may send just what changed since.
+            send_gradient(socket, MODEL_LINEAR_SVM, batch_size, gradient, update_encoding, sparsifier,
+                          FLAG_ACCEPTS_DELTA);
+            receive_message(socket, MSG_MODEL, MODEL_LINEAR_SVM, weights);
+        }
+
+        std::cout << "[DEBUG] Updated weights received: " << weights.transpose() << std::endl;
     }
 }
 
-void train_and_send_batches(tcp::socket& socket, MatrixXd& data, VectorXd& labels, VectorXd& weights) {
+void train_and_send_batches(FramedSocket& socket, RowMatrixXs& data, VectorXs& labels, VectorXs& weights) {
     int n_samples = data.rows();
-    int n_features = data.cols();
 
     for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
         std::cout << "[INFO] Starting Epoch " << epoch + 1 << std::endl;
@@ -57,59 +80,70 @@ void train_and_send_batches(tcp::socket& socket, MatrixXd& data, VectorXd& label
         std::mt19937 g(rd());
         std::shuffle(indices.begin(), indices.end(), g);
 
-        for (int i = 0; i < n_samples; i += TRAIN_BATCH_SIZE) {
-            int batch_size = std::min(TRAIN_BATCH_SIZE, n_samples - i);
-            MatrixXd batch_X(batch_size, n_features);
-            VectorXd batch_y(batch_size);
-
-            for (int j = 0; j < batch_size; ++j) {
-                batch_X.row(j) = data.row(indices[i + j]);
-                batch_y(j) = labels(indices[i + j]);
-            }
-
-            VectorXd gradient = compute_svm_gradient(batch_X, batch_y, weights);
-
-            // Send batch metadata
-            boost::asio::write(socket, boost::asio::buffer(&batch_size, sizeof(int)));
-            boost::asio::write(socket, boost::asio::buffer(&n_features, sizeof(int)));
-
-            // Send gradient
-            send_in_batches(socket, gradient);
+        Prefetcher<RowBatch> batches("minibatches", gather_batches(data, labels, indices, TRAIN_BATCH_SIZE));
+        train_on_batches(socket, batches, weights);
+    }
+    if (subscription) subscription->finish(weights);  // Wait for the model that includes every update
+}
 
-            // Receive updated global model
-            boost::asio::read(socket, boost::asio::buffer(weights.data(), weights.size() * sizeof(double)));
+// Out-of-core training: one block in memory at a time, shuffled within the block
+void train_and_send_stream(FramedSocket& socket, BlockReader& reader, VectorXs& weights) {
+    std::random_device rd;
+    std::mt19937 g(rd());
 
-            std::cout << "[DEBUG] Updated weights received: " << weights.transpose() << std::endl;
-        }
+    for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
+        std::cout << "[INFO] Starting Epoch " << epoch + 1 << " (streaming "
+                  << reader.block_rows() << " rows per block)" << std::endl;
+        reader.rewind();
+        // Minibatches cross block boundaries on one prefetch thread, fed by the block reader's
+        Prefetcher<RowBatch> blocks("blocks", read_blocks(reader), 1);
+        Prefetcher<RowBatch> batches("minibatches", gather_block_batches(blocks, [&g](int rows) {
+            return shuffled_window(rows, g);
+        }, TRAIN_BATCH_SIZE));
+        train_on_batches(socket, batches, weights);
     }
+    if (subscription) subscription->finish(weights);  // Wait for the model that includes every update
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        ClientOptions options = parse_client_options(argc, argv);
+        reject_unsupported(options, OPTION_STREAM | OPTION_SHARD | OPTION_WIRE | OPTION_TOP_K | OPTION_SUBSCRIBE,
+                           "LSVM");
+        update_encoding = wire_encoding<Scalar>(options.wire);
+        sparsifier = TopKSparsifier(options.top_k);
         boost::asio::io_context io_context;
-        tcp::socket socket(io_context);
-
-        std::vector<std::vector<float>> features;
-        std::vector<int> labels;
-        //load_data("../Datasets/santander-customer-transaction-prediction.csv", features, labels);
-        //load_data("../Datasets/SUSY.csv", features, labels);
-        load_data("../Datasets/HIGGS.csv", features, labels);
-
-
-        MatrixXd data(features.size(), features[0].size());
-        VectorXd label_vec(labels.size());
-        for (size_t i = 0; i < features.size(); ++i) {
-            for (size_t j = 0; j < features[i].size(); ++j) {
-                data(i, j) = features[i][j];
-            }
-            label_vec(i) = labels[i];
+        FramedSocket socket(io_context);
+        std::unique_ptr<ModelSubscription<VectorXs>> pushes;  // Ends before the socket closes
+
+        if (options.stream) {
+            //BlockReader reader("../Datasets/santander-customer-transaction-prediction.csv", shard_of(santander_schema(), options), options.memory_mb << 20);
+            //BlockReader reader("../Datasets/SUSY.csv", shard_of(susy_schema(), options), options.memory_mb << 20);
+            BlockReader reader("../Datasets/HIGGS.csv", shard_of(higgs_schema(), options), options.memory_mb << 20);
+            if (!reader.is_open()) return 1;
+
+            VectorXs weights = VectorXs::Random(reader.cols());
+            socket = connect_to_server(io_context, options);
+            if (options.subscribe) pushes = std::make_unique<ModelSubscription<VectorXs>>(socket, MODEL_LINEAR_SVM);
+            subscription = pushes.get();
+            train_and_send_stream(socket, reader, weights);
+            socket.close();
+            return 0;
         }
 
-        VectorXd weights = VectorXd::Random(data.cols());
+        RowMatrixXs data;
+        VectorXs label_vec;
+        //load_data("../Datasets/santander-customer-transaction-prediction.csv", shard_of(santander_schema(), options), data, label_vec);
+        //load_data("../Datasets/SUSY.csv", shard_of(susy_schema(), options), data, label_vec);
+        load_data("../Datasets/HIGGS.csv", shard_of(higgs_schema(), options), data, label_vec);
+
+        VectorXs weights = VectorXs::Random(data.cols());
         
   
 
-        socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        socket = connect_to_server(io_context, options);
+        if (options.subscribe) pushes = std::make_unique<ModelSubscription<VectorXs>>(socket, MODEL_LINEAR_SVM);
+        subscription = pushes.get();
 
         train_and_send_batches(socket, data, label_vec, weights);
         socket.close();
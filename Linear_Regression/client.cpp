@@ -3,41 +3,140 @@
 #include <vector>
 #include <algorithm>
 #include <random>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
-#include "data_loader.cpp"  // Include the data loader
-// g++ client_updated.cpp -o client  -I /usr/include/eigen3
+#include "../Common/datasets.cpp"
+#include "../Common/block_reader.cpp"
+#include "../Common/scalar.cpp"
+#include "../Common/client_options.cpp"
+#include "../Common/wire_protocol.cpp"
+#include "../Common/sparsify.cpp"
+#include "../Common/prefetcher.cpp"
+#include "../Common/subscription.cpp"
+// g++ -std=c++20 client.cpp -o client -I /usr/include/eigen3 -pthread
+// Add -DFED_FLOAT32 for a float32 build (the server must match)
+// Add -DFED_HAVE_ZLIB -lz (or -DFED_HAVE_ZSTD -lzstd) to load .csv.gz (.csv.zst) datasets directly
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
 const int MAX_EPOCHS = 1;
 const int TRAIN_BATCH_SIZE = 100;
-const int NETWORK_BATCH_SIZE = 100;
+WireDtype update_encoding = wire_dtype<Scalar>();  // --wire: encoding of each update; the server replies in kind
+TopKSparsifier sparsifier;  // --top-k: sparse updates with error feedback
+ModelSubscription<VectorXs>* subscription = nullptr;  // --subscribe: updates are not answered, models are pushed
 
 // **Mean Squared Error (MSE) Loss Function**
-double compute_mse(const MatrixXd& data, const VectorXd& labels, const VectorXd& weights) {
-    VectorXd predictions = data * weights;
-    VectorXd errors = labels - predictions;
+Scalar compute_mse(const RowMatrixXs& data, const VectorXs& labels, const VectorXs& weights) {
+    VectorXs predictions = data * weights;
+    VectorXs errors = labels - predictions;
     return (errors.squaredNorm() / labels.size());
 }
 
-// **Sends the gradient vector in batches**
-void send_in_batches(tcp::socket& socket, const VectorXd& data) {
-    int total_size = data.size();
-    int sent = 0;
+// **Standardize features (zero mean, unit variance)**
+void standardize(RowMatrixXs& data, const VectorXs& mean, const VectorXs& stddev) {
+    for (int i = 0; i < data.cols(); ++i) {
+        data.col(i) = (data.col(i).array() - mean(i)) / (stddev(i) + Scalar(1e-8));  // Avoid divide-by-zero
+    }
+}
+
+// **Sums over every row of a streamed shard, enough to standardize it and to
+// give the MSE of any weights over all of it, standardized, without another pass.
+// Kept in double whatever Scalar is, as the MSE comes from differences of them.**
+struct ShardMoments {
+    int64_t rows = 0;
+    VectorXd sum;     // Of each feature
+    MatrixXd gram;    // X^T X
+    VectorXd xty;     // X^T y
+    double y_sum = 0;
+    double yty = 0;
+    VectorXd feature_mean, scale;  // Feature means, and the stddevs standardize() divides by
+
+    void add(const RowMatrixXs& data, const VectorXs& labels) {
+        MatrixXd x = data.cast<double>();
+        VectorXd y = labels.cast<double>();
+        if (rows == 0) {
+            sum = VectorXd::Zero(x.cols());
+            gram = MatrixXd::Zero(x.cols(), x.cols());
+            xty = VectorXd::Zero(x.cols());
+        }
+        rows += x.rows();
+        sum += x.colwise().sum().transpose();
+        gram.selfadjointView<Lower>().rankUpdate(x.transpose());
+        xty += x.transpose() * y;
+        y_sum += y.sum();
+        yty += y.squaredNorm();
+    }
+
+    // Once every row is in: the mean and (population) stddev of each feature
+    void finish(VectorXs& mean, VectorXs& stddev) {
+        gram = gram.selfadjointView<Lower>();
+        feature_mean = sum / rows;
+        VectorXd variance = (gram.diagonal() / rows - feature_mean.cwiseAbs2()).cwiseMax(0.0);
+        mean = feature_mean.cast<Scalar>();
+        stddev = variance.cwiseSqrt().cast<Scalar>();
+        scale = stddev.cast<double>().array() + double(Scalar(1e-8));
+    }
 
-    while (sent < total_size) {
-        int batch_size = std::min(NETWORK_BATCH_SIZE, total_size - sent);
-        boost::asio::write(socket, boost::asio::buffer(data.data() + sent, batch_size * sizeof(double)));
-        sent += batch_size;
+    // Over the standardized rows (x - mean) / scale: with z = w / scale the
+    // predictions are (X - 1 mean^T) z, and the squared errors expand into the sums
+    Scalar mse(const VectorXs& weights) const {
+        VectorXd z = weights.cast<double>().array() / scale.array();
+        double centered_xty = z.dot(xty - feature_mean * y_sum);
+        double centered_gram = z.dot(gram * z) - rows * std::pow(feature_mean.dot(z), 2);
+        return static_cast<Scalar>((yty - 2 * centered_xty + centered_gram) / rows);
+    }
+};
+
+// **Minibatch loop over one epoch; batch t+1 is gathered on the prefetch thread while batch t trains.
+// After each update the MSE of the new weights over the client's whole shard is reported.**
+template <typename ShardLoss>
+void train_on_batches(FramedSocket& socket, Prefetcher<RowBatch>& batches, VectorXs& weights, int epoch,
+                      const ShardLoss& shard_mse) {
+    RowBatch batch;
+    for (int batch_index = 1; batches.next(batch); ++batch_index) {
+        int batch_size = batch.features.rows();
+        VectorXs gradient = VectorXs::Zero(batch.features.cols());
+
+        // **Compute the gradient using MSE loss**
+        for (int j = 0; j < batch_size; ++j) {
+            auto xi = batch.features.row(j);
+            Scalar yi = batch.labels(j);
+            Scalar prediction = xi.dot(weights);
+            Scalar lambda = 0.001; // Regularization strength
+            gradient += -2 * xi.transpose() * (yi - prediction) + lambda * weights;
+        }
+
+        gradient /= batch_size;  // Normalize gradient
+
+        if (subscription) {
+            // Send and carry on with the newest model pushed so far; no round trip per batch
+            send_gradient(socket, MODEL_LINEAR_REGRESSION, batch_size, gradient, update_encoding, sparsifier,
+                          FLAG_ACCEPTS_DELTA | FLAG_SUBSCRIBE);
+            subscription->sent_update();
+            subscription->latest(weights);
+        } else {
+            // Send the gradient and its batch size as one message, then receive the updated global model.
+            // weights only ever holds the last reply, so the server may send just what changed since.
+            send_gradient(socket, MODEL_LINEAR_REGRESSION, batch_size, gradient, update_encoding, sparsifier,
+                          FLAG_ACCEPTS_DELTA);
+            receive_message(socket, MSG_MODEL, MODEL_LINEAR_REGRESSION, weights);
+        }
+
+        std::cout << "[DEBUG] Updated weights received from server (first 10): "
+                  << weights.head(10).transpose() << std::endl;
+
+        // **Compute and display MSE loss after update**
+        Scalar mse_loss = shard_mse(weights);
+        std::cout << "[INFO] Epoch " << epoch + 1 << ", Batch " << batch_index
+                  << " - MSE Loss: " << mse_loss << std::endl;
     }
 }
 
 // **Training and Sending Batches**
-void train_and_send_batches(tcp::socket& socket, MatrixXd& data, VectorXd& labels, VectorXd& weights) {
+void train_and_send_batches(FramedSocket& socket, RowMatrixXs& data, VectorXs& labels, VectorXs& weights) {
     int n_samples = data.rows();
-    int n_features = data.cols();
 
     for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
         std::cout << "[INFO] Starting Epoch " << epoch + 1 << std::endl;
@@ -48,78 +147,94 @@ void train_and_send_batches(tcp::socket& socket, MatrixXd& data, VectorXd& label
         std::mt19937 g(rd());
         std::shuffle(indices.begin(), indices.end(), g);
 
-        for (int i = 0; i < n_samples; i += TRAIN_BATCH_SIZE) {
-            int batch_size = std::min(TRAIN_BATCH_SIZE, n_samples - i);
-            VectorXd gradient = VectorXd::Zero(n_features);
-
-            // **Compute the gradient using MSE loss**
-            for (int j = 0; j < batch_size; ++j) {
-                VectorXd xi = data.row(indices[i + j]);
-                double yi = labels(indices[i + j]);
-                double prediction = xi.dot(weights);
-                double lambda = 0.001; // Regularization strength
-                gradient += -2 * xi * (yi - prediction) + lambda * weights;
-            }
-
-            gradient /= batch_size;  // Normalize gradient
-
-            // **Send batch size and gradient size before sending updates**
-            boost::asio::write(socket, boost::asio::buffer(&batch_size, sizeof(int)));
-            boost::asio::write(socket, boost::asio::buffer(&n_features, sizeof(int)));
-
-            // **Send gradient update to the server**
-            send_in_batches(socket, gradient);
-
-            // **Receive updated global weights from server**
-            boost::asio::read(socket, boost::asio::buffer(weights.data(), weights.size() * sizeof(double)));
+        Prefetcher<RowBatch> batches("minibatches", gather_batches(data, labels, indices, TRAIN_BATCH_SIZE));
+        train_on_batches(socket, batches, weights, epoch,
+                         [&](const VectorXs& w) { return compute_mse(data, labels, w); });
+    }
+    if (subscription) subscription->finish(weights);  // Wait for the model that includes every update
+}
 
-            std::cout << "[DEBUG] Updated weights received from server (first 10): "
-                      << weights.head(10).transpose() << std::endl;
+// **Out-of-core training: one block in memory at a time, shuffled within the block.
+// A first pass over the shard gathers its moments, so the rows are standardized
+// and the MSE is reported over the whole shard, as in memory.**
+void train_and_send_stream(FramedSocket& socket, BlockReader& reader, VectorXs& weights) {
+    std::random_device rd;
+    std::mt19937 g(rd());
+    VectorXs mean, stddev;
+    ShardMoments moments;
+    {
+        RowBatch block;
+        Prefetcher<RowBatch> blocks("blocks", read_blocks(reader), 1);
+        while (blocks.next(block)) moments.add(block.features, block.labels);
+    }
+    if (moments.rows == 0) return;
+    moments.finish(mean, stddev);
 
-            // **Compute and display MSE loss after update**
-            double mse_loss = compute_mse(data, labels, weights);
-            std::cout << "[INFO] Epoch " << epoch + 1 << ", Batch " << (i / TRAIN_BATCH_SIZE) + 1
-                      << " - MSE Loss: " << mse_loss << std::endl;
-        }
+    for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
+        std::cout << "[INFO] Starting Epoch " << epoch + 1 << " (streaming "
+                  << reader.block_rows() << " rows per block)" << std::endl;
+        reader.rewind();
+        // Minibatches cross block boundaries on one prefetch thread, fed by the block reader's;
+        // blocks are standardized there too
+        Prefetcher<RowBatch> blocks("blocks", read_blocks(reader), 1);
+        auto standardize_block = [&mean, &stddev](RowBatch& block) { standardize(block.features, mean, stddev); };
+        Prefetcher<RowBatch> batches("minibatches", gather_block_batches(blocks, [&g](int rows) {
+            return shuffled_window(rows, g);
+        }, TRAIN_BATCH_SIZE, standardize_block));
+        train_on_batches(socket, batches, weights, epoch, [&moments](const VectorXs& w) { return moments.mse(w); });
     }
+    if (subscription) subscription->finish(weights);  // Wait for the model that includes every update
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        ClientOptions options = parse_client_options(argc, argv);
+        reject_unsupported(options, OPTION_STREAM | OPTION_SHARD | OPTION_WIRE | OPTION_TOP_K | OPTION_SUBSCRIBE,
+                           "Linear Regression");
+        update_encoding = wire_encoding<Scalar>(options.wire);
+        sparsifier = TopKSparsifier(options.top_k);
         boost::asio::io_context io_context;
-        tcp::socket socket(io_context);
-
-        std::vector<std::vector<double>> features;
-        std::vector<double> labels;
-        load_data("../Datasets/Regression_1m_v3.csv", features, labels);
-
-        MatrixXd local_data(features.size(), features[0].size());
-        VectorXd local_labels(labels.size());
-
-        for (size_t i = 0; i < features.size(); ++i) {
-            for (size_t j = 0; j < features[i].size(); ++j) {
-                local_data(i, j) = features[i][j];
-            }
-            local_labels(i) = labels[i];
+        FramedSocket socket(io_context);
+        std::unique_ptr<ModelSubscription<VectorXs>> pushes;  // Ends before the socket closes
+
+        if (options.stream) {
+            BlockReader reader("../Datasets/Regression_1m_v3.csv", shard_of(regression_schema(), options), options.memory_mb << 20);
+            if (!reader.is_open()) return 1;
+
+            std::random_device rd;
+            std::mt19937 gen(rd());
+            std::normal_distribution<> d(0, 0.01);
+            VectorXs weights = VectorXs::Zero(reader.cols()).unaryExpr([&](Scalar) { return Scalar(d(gen)); });
+
+            socket = connect_to_server(io_context, options);
+            if (options.subscribe) pushes = std::make_unique<ModelSubscription<VectorXs>>(socket, MODEL_LINEAR_REGRESSION);
+            subscription = pushes.get();
+            train_and_send_stream(socket, reader, weights);
+            socket.close();
+            return 0;
         }
 
+        RowMatrixXs local_data;
+        VectorXs local_labels;
+        load_data("../Datasets/Regression_1m_v3.csv", shard_of(regression_schema(), options), local_data, local_labels);
+
         // Compute mean and standard deviation per feature
-        VectorXd mean = local_data.colwise().mean();
-        VectorXd stddev = ((local_data.rowwise() - mean.transpose()).array().square().colwise().mean()).sqrt();
+        VectorXs mean = local_data.colwise().mean();
+        VectorXs stddev = ((local_data.rowwise() - mean.transpose()).array().square().colwise().mean()).sqrt();
 
         // Standardize data (zero mean, unit variance)
-        for (int i = 0; i < local_data.cols(); ++i) {
-            local_data.col(i) = (local_data.col(i).array() - mean(i)) / (stddev(i) + 1e-8);  // Avoid divide-by-zero
-        }
+        standardize(local_data, mean, stddev);
 
 
         std::random_device rd;
         std::mt19937 gen(rd());
         std::normal_distribution<> d(0, 0.01);
-        VectorXd weights = VectorXd::Zero(local_data.cols()).unaryExpr([&](double) { return d(gen); });
+        VectorXs weights = VectorXs::Zero(local_data.cols()).unaryExpr([&](Scalar) { return Scalar(d(gen)); });
 
 
-        socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        socket = connect_to_server(io_context, options);
+        if (options.subscribe) pushes = std::make_unique<ModelSubscription<VectorXs>>(socket, MODEL_LINEAR_REGRESSION);
+        subscription = pushes.get();
 
         train_and_send_batches(socket, local_data, local_labels, weights);
 
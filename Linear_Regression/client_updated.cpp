@@ -3,9 +3,12 @@
 #include <vector>
 #include <algorithm>
 #include <random>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
-#include "data_loader.cpp"  // Include the data loader
+#include "../Common/datasets.cpp"
+#include "../Common/awaitable_protocol.cpp"
+// g++ -std=c++20 client_updated.cpp -o client_updated -I /usr/include/eigen3 -pthread
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
@@ -23,14 +26,15 @@ void normalize_data(MatrixXd& data) {
     }
 }
 
-void send_in_batches(tcp::socket& socket, const VectorXd& data) {
+awaitable<void> send_in_batches(tcp::socket& socket, const VectorXd& data) {
     int total_size = data.size();
     std::cout << "[INFO] Sending data in batches of size: " << NETWORK_BATCH_SIZE << std::endl;
 
     int sent = 0;
     while (sent < total_size) {
         int batch_size = std::min(NETWORK_BATCH_SIZE, total_size - sent);
-        boost::asio::write(socket, boost::asio::buffer(data.data() + sent, batch_size * sizeof(double)));
+        co_await boost::asio::async_write(socket, boost::asio::buffer(data.data() + sent, batch_size * sizeof(double)),
+                                          use_awaitable);
         sent += batch_size;
         std::cout << "[DEBUG] Sent batch of size: " << batch_size << std::endl;
     }
@@ -44,73 +48,60 @@ void clip_gradients(VectorXd& gradient, double max_norm) {
     }
 }
 
-bool train_incrementally(const MatrixXd& data, const VectorXd& labels, 
-                         VectorXd& weights, double learning_rate, 
-                         tcp::socket& socket) {
+// Mini-batch training over every epoch; after each batch the weights go to the
+// server and its averaged model comes back in their place
+awaitable<void> train(const MatrixXd& data, const VectorXd& labels, 
+                      VectorXd& weights, double learning_rate, 
+                      tcp::socket& socket) {
     int n_samples = data.rows();
     int n_features = data.cols();
-    static int last_sample = 0;  // Remember the last sample across function calls
 
     VectorXd gradient = VectorXd::Zero(n_features);
-    int batch_count = 0;
 
-    std::cout << "[DEBUG] Resuming training from sample index: " << last_sample << std::endl;
+    for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
+        std::cout << "[INFO] Starting epoch " << epoch + 1 << std::endl;
+        int batch_count = 0;
 
-    for (int i = last_sample; i < n_samples; ++i) {
-        VectorXd xi = data.row(i);
-        double yi = labels(i);
-        gradient += -2 * xi * (yi - xi.dot(weights));
-        batch_count++;
+        for (int i = 0; i < n_samples; ++i) {
+            VectorXd xi = data.row(i);
+            double yi = labels(i);
+            gradient += -2 * xi * (yi - xi.dot(weights));
+            batch_count++;
 
-        if (batch_count == TRAIN_BATCH_SIZE || i == n_samples - 1) {
-            clip_gradients(gradient, 1.0); // Clip gradients to a max norm of 1.0
+            if (batch_count == TRAIN_BATCH_SIZE || i == n_samples - 1) {
+                clip_gradients(gradient, 1.0); // Clip gradients to a max norm of 1.0
 
-            if (!gradient.allFinite()) {
-                std::cerr << "[ERROR] Gradient contains NaN or inf values. Resetting gradient." << std::endl;
-                gradient.setZero(); // Reset gradient to prevent invalid updates
-            }
-
-            weights -= learning_rate * gradient / batch_count;
+                if (!gradient.allFinite()) {
+                    std::cerr << "[ERROR] Gradient contains NaN or inf values. Resetting gradient." << std::endl;
+                    gradient.setZero(); // Reset gradient to prevent invalid updates
+                }
 
-            if (!weights.allFinite()) {
-                std::cerr << "[ERROR] Weights contain NaN or inf values." << std::endl;
-                weights.setZero(); // Reset weights to prevent cascading errors
-            }
+                weights -= learning_rate * gradient / batch_count;
 
-            std::cout << "[DEBUG] Sending weights after batch." << std::endl;
-            send_in_batches(socket, weights);
+                if (!weights.allFinite()) {
+                    std::cerr << "[ERROR] Weights contain NaN or inf values." << std::endl;
+                    weights.setZero(); // Reset weights to prevent cascading errors
+                }
 
-            gradient.setZero();  // Reset gradient for the next batch
-            batch_count = 0;
+                std::cout << "[DEBUG] Sending weights after batch." << std::endl;
+                co_await send_in_batches(socket, weights);
+                // The server answers every update with its averaged model
+                co_await boost::asio::async_read(socket, boost::asio::buffer(weights.data(), weights.size() * sizeof(double)),
+                                                 use_awaitable);
 
-            if (i == n_samples - 1) {
-                last_sample = 0;  // Reset for the next epoch
-                return true;  // Completed one epoch
+                gradient.setZero();  // Reset gradient for the next batch
+                batch_count = 0;
             }
-
-            last_sample = i + 1;  // Update the state for the next call
-            return false;  // Continue training
         }
     }
-    return true;
 }
 
 int main() {
     try {
         // Load data from train.csv
-        std::vector<std::vector<float>> features;
-        std::vector<int> labels;
-        load_data("/home/yash/Work/Profiling_Fed/ML/KernelSVM/train.csv", features, labels);
-
-        // Convert to Eigen matrices
-        MatrixXd local_data(features.size(), features[0].size());
-        VectorXd local_labels(labels.size());
-        for (size_t i = 0; i < features.size(); ++i) {
-            for (size_t j = 0; j < features[i].size(); ++j) {
-                local_data(i, j) = features[i][j];
-            }
-            local_labels(i) = labels[i];
-        }
+        MatrixXd local_data;
+        VectorXd local_labels;
+        load_data("/home/yash/Work/Profiling_Fed/ML/KernelSVM/train.csv", regression_schema(), local_data, local_labels);
 
         normalize_data(local_data); // Normalize the data
         std::cout << "[INFO] Normalization complete." << std::endl;
@@ -133,14 +124,10 @@ int main() {
         std::cout << "[DEBUG] Sending vector size: " << vector_size << std::endl;
         boost::asio::write(socket, boost::asio::buffer(&vector_size, sizeof(int)));
 
-        // Train incrementally in batches
-        for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
-            std::cout << "[INFO] Starting epoch " << epoch + 1 << std::endl;
-
-            while (!train_incrementally(local_data, local_labels, local_weights, learning_rate, socket)) {
-                // Continue training in incremental batches
-            }
-        }
+        // Train in batches; the coroutine runs until the last epoch is done
+        boost::asio::co_spawn(io_context, train(local_data, local_labels, local_weights, learning_rate, socket),
+                              rethrow_if_failed);
+        io_context.run();
 
         socket.close();
 
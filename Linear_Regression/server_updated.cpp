@@ -1,11 +1,13 @@
 // Updated server.cpp
 #include <iostream>
 #include <vector>
-#include <thread>
 #include <fstream>
+#include <utility>
 #include <boost/asio.hpp>
+#include "../Common/awaitable_protocol.cpp"
 #include <mutex>
 #include <Eigen/Dense>
+// g++ -std=c++20 server_updated.cpp -o server_updated -I /usr/include/eigen3 -pthread
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
@@ -49,8 +51,8 @@ void aggregate_model(const VectorXd& local_update) {
 }
 
 
-// Handle communication with a client
-void handle_client(tcp::socket socket) {
+// Handle communication with a client; each client is a coroutine on the one io_context thread
+awaitable<void> handle_client(tcp::socket socket) {
     try {
         std::cout << "[DEBUG] Handling new client connection." << std::endl;
 
@@ -59,20 +61,22 @@ void handle_client(tcp::socket socket) {
         boost::system::error_code error;
 
         // Read the vector size directly
-        boost::asio::read(socket, boost::asio::buffer(&vector_size, sizeof(int)), error);
+        co_await boost::asio::async_read(socket, boost::asio::buffer(&vector_size, sizeof(int)),
+                                         boost::asio::redirect_error(use_awaitable, error));
 
         if (error) {
             std::cerr << "[ERROR] Failed to receive vector size: " << error.message() << std::endl;
-            return;
+            co_return;
         }
 
         std::cout << "[DEBUG] Received vector size: " << vector_size << std::endl;
 
         if (vector_size <= 0 || vector_size > 1e7) {
             std::cerr << "[ERROR] Invalid vector size received: " << vector_size << std::endl;
-            return;
+            co_return;
         }
 
+        VectorXd reply;
         while (true) {
             VectorXd local_update = VectorXd::Zero(vector_size);
             int received = 0;
@@ -81,8 +85,8 @@ void handle_client(tcp::socket socket) {
 
             while (received < vector_size) {
                 int batch_size = std::min(BATCH_SIZE, vector_size - received);
-                boost::asio::read(socket, boost::asio::buffer(
-                    local_update.data() + received, batch_size * sizeof(double)));
+                co_await boost::asio::async_read(socket, boost::asio::buffer(
+                    local_update.data() + received, batch_size * sizeof(double)), use_awaitable);
 
                 received += batch_size;
             }
@@ -92,8 +96,13 @@ void handle_client(tcp::socket socket) {
 
             aggregate_model(local_update);
 
-            boost::asio::write(socket, boost::asio::buffer(
-                global_weights.data(), global_weights.size() * sizeof(double)));
+            // Other clients aggregate while this write is in flight, so it sends a copy
+            {
+                std::lock_guard<std::mutex> lock(model_mutex);
+                reply = global_weights;
+            }
+            co_await boost::asio::async_write(socket, boost::asio::buffer(
+                reply.data(), reply.size() * sizeof(double)), use_awaitable);
 
             std::cout << "[DEBUG] Sent updated global model to client." << std::endl;
         }
@@ -103,6 +112,15 @@ void handle_client(tcp::socket socket) {
     }
 }
 
+awaitable<void> accept_clients(tcp::acceptor& acceptor) {
+    while (true) {
+        tcp::socket socket = co_await acceptor.async_accept(use_awaitable);
+        std::cout << "[DEBUG] Client connected." << std::endl;
+
+        boost::asio::co_spawn(acceptor.get_executor(), handle_client(std::move(socket)), boost::asio::detached);
+    }
+}
+
 // Main function to run the server
 int main() {
     try {
@@ -111,13 +129,8 @@ int main() {
 
         std::cout << "[DEBUG] Server started. Waiting for clients on port 8080..." << std::endl;
 
-        while (true) {
-            tcp::socket socket(io_context);
-            acceptor.accept(socket);
-            std::cout << "[DEBUG] Client connected." << std::endl;
-
-            std::thread(handle_client, std::move(socket)).detach();
-        }
+        boost::asio::co_spawn(io_context, accept_clients(acceptor), rethrow_if_failed);
+        io_context.run();
     } catch (const std::exception& e) {
         std::cerr << "[ERROR] Exception in main: " << e.what() << std::endl;
     }
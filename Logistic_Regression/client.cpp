@@ -2,40 +2,51 @@
 #include <vector>
 #include <algorithm>
 #include <random>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
-//#include "data_loader.cpp" // Include the data loader
-//#include "data_loader_susy.cpp"
-#include "data_loader_higgs.cpp"
-// g++ client_updated.cpp -o client  -I /usr/include/eigen3
+#include "../Common/datasets.cpp"
+#include "../Common/block_reader.cpp"
+#include "../Common/scalar.cpp"
+#include "../Common/client_options.cpp"
+#include "../Common/wire_protocol.cpp"
+#include "../Common/sparsify.cpp"
+#include "../Common/prefetcher.cpp"
+#include "../Common/subscription.cpp"
+// g++ -std=c++20 client.cpp -o client -I /usr/include/eigen3 -pthread
+// Add -DFED_FLOAT32 for a float32 build (the server must match)
+// Add -DFED_HAVE_ZLIB -lz (or -DFED_HAVE_ZSTD -lzstd) to load .csv.gz (.csv.zst) datasets directly
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
-const double LEARNING_RATE = 0.01;
+const Scalar LEARNING_RATE = 0.01;
 const int MAX_EPOCHS = 1;
 const int TRAIN_BATCH_SIZE = 100;
-const int NETWORK_BATCH_SIZE = 100;
+WireDtype update_encoding = wire_dtype<Scalar>();  // --wire: encoding of each update; the server replies in kind
+TopKSparsifier sparsifier;  // --top-k: sparse updates with error feedback
+ModelSubscription<VectorXs>* subscription = nullptr;  // --subscribe: updates are not answered, models are pushed
 
 // Sigmoid function
-double sigmoid(double z) {
-    return 1.0 / (1.0 + std::exp(-z));
+Scalar sigmoid(Scalar z) {
+    return Scalar(1) / (Scalar(1) + std::exp(-z));
 }
 
-int predict(const VectorXd& sample, const VectorXd& weights) {
-    double dot_product = sample.dot(weights);
+int predict(const Ref<const RowVectorXs>& sample, const VectorXs& weights) {
+    Scalar dot_product = sample.dot(weights);
     
     if (std::isnan(dot_product) || std::isinf(dot_product)) {
         std::cerr << "[ERROR] Invalid dot product value: " << dot_product << std::endl;
         return -1;  // Return an invalid label for debugging
     }
 
-    double probability = sigmoid(dot_product);
+    Scalar probability = sigmoid(dot_product);
     return (probability >= 0.5) ? 1 : 0;
 }
 
-void predict_samples(const MatrixXd& test_data, const VectorXd& weights) {
-    std::cout << "[INFO] Predicting labels for test data..." << std::endl;
+// first_row numbers the samples of a block after those of the blocks before it
+void predict_samples(const RowMatrixXs& test_data, const VectorXs& weights, size_t first_row = 0) {
+    if (first_row == 0) std::cout << "[INFO] Predicting labels for test data..." << std::endl;
 
     if (test_data.cols() != weights.size()) {
         std::cerr << "[ERROR] Mismatched dimensions! Test data has " << test_data.cols()
@@ -46,27 +57,49 @@ void predict_samples(const MatrixXd& test_data, const VectorXd& weights) {
     for (int i = 0; i < test_data.rows(); ++i) {
         int predicted_label = predict(test_data.row(i), weights);
         if (predicted_label == -1) continue;  // Skip invalid predictions
-        std::cout << "Sample " << i + 1 << " predicted class: " << predicted_label << std::endl;
+        std::cout << "Sample " << first_row + i + 1 << " predicted class: " << predicted_label << std::endl;
     }
 }
 
 
-// Sends the weight vector in batches over the network
-void send_in_batches(tcp::socket& socket, const VectorXd& data) {
-    int total_size = data.size();
-    int sent = 0;
+// **Minibatch loop over one epoch; batch t+1 is gathered on the prefetch thread while batch t trains**
+void train_on_batches(FramedSocket& socket, Prefetcher<RowBatch>& batches, VectorXs& weights) {
+    RowBatch batch;
+    while (batches.next(batch)) {
+        int batch_size = batch.features.rows();
+        VectorXs gradient = VectorXs::Zero(batch.features.cols());
 
-    while (sent < total_size) {
-        int batch_size = std::min(NETWORK_BATCH_SIZE, total_size - sent);
-        boost::asio::write(socket, boost::asio::buffer(data.data() + sent, batch_size * sizeof(double)));
-        sent += batch_size;
+        for (int j = 0; j < batch_size; ++j) {
+            auto xi = batch.features.row(j);
+            Scalar yi = batch.labels(j);
+            gradient += xi.transpose() * (sigmoid(xi.dot(weights)) - yi);
+        }
+
+        // Normalize the gradient
+        gradient /= batch_size;
+
+        if (subscription) {
+            // Send and carry on with the newest model pushed so far; no round trip per batch
+            send_gradient(socket, MODEL_LOGISTIC_REGRESSION, batch_size, gradient, update_encoding, sparsifier,
+                          FLAG_ACCEPTS_DELTA | FLAG_SUBSCRIBE);
+            subscription->sent_update();
+            subscription->latest(weights);
+        } else {
+            // Send the gradient and its batch size as one message, then receive the updated global model.
+            // weights only ever holds the last reply, so the server may send just what changed since.
+            send_gradient(socket, MODEL_LOGISTIC_REGRESSION, batch_size, gradient, update_encoding, sparsifier,
+                          FLAG_ACCEPTS_DELTA);
+            receive_message(socket, MSG_MODEL, MODEL_LOGISTIC_REGRESSION, weights);
+        }
+
+        std::cout << "[DEBUG] Updated weights received from server (first 10): " 
+                  << weights.head(10).transpose() << std::endl;
     }
 }
 
 // **Training and Sending Batches**
-void train_and_send_batches(tcp::socket& socket, MatrixXd& data, VectorXd& labels, VectorXd& weights) {
+void train_and_send_batches(FramedSocket& socket, RowMatrixXs& data, VectorXs& labels, VectorXs& weights) {
     int n_samples = data.rows();
-    int n_features = data.cols();
     
     for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
         std::cout << "[INFO] Starting Epoch " << epoch + 1 << std::endl;
@@ -78,77 +111,98 @@ void train_and_send_batches(tcp::socket& socket, MatrixXd& data, VectorXd& label
         std::mt19937 g(rd());
         std::shuffle(indices.begin(), indices.end(), g);
 
-        for (int i = 0; i < n_samples; i += TRAIN_BATCH_SIZE) {
-            int batch_size = std::min(TRAIN_BATCH_SIZE, n_samples - i);
-            VectorXd gradient = VectorXd::Zero(n_features);
-
-            for (int j = 0; j < batch_size; ++j) {
-                VectorXd xi = data.row(indices[i + j]);
-                double yi = labels(indices[i + j]);
-                gradient += xi * (sigmoid(xi.dot(weights)) - yi);
-            }
-
-            // Normalize the gradient
-            gradient /= batch_size;
-
-            // Send batch metadata
-            boost::asio::write(socket, boost::asio::buffer(&batch_size, sizeof(int)));
-            boost::asio::write(socket, boost::asio::buffer(&n_features, sizeof(int)));
+        Prefetcher<RowBatch> batches("minibatches", gather_batches(data, labels, indices, TRAIN_BATCH_SIZE));
+        train_on_batches(socket, batches, weights);
+    }
+    if (subscription) subscription->finish(weights);  // Wait for the model that includes every update
+        RowMatrixXs test_data;
+        VectorXs test_labels;
+        //load_data("../Datasets/santander-customer-transaction-prediction.csv", santander_schema(), test_data, test_labels);
+        //load_data("../Datasets/SUSY.csv", susy_schema(), test_data, test_labels);
+        load_data("../Datasets/HIGGS.csv", higgs_schema(), test_data, test_labels);
 
-            // Send weight updates
-            send_in_batches(socket, gradient);
+        predict_samples(test_data, weights);
+    
+}
 
-            // Receive updated global model
-            boost::asio::read(socket, boost::asio::buffer(weights.data(), weights.size() * sizeof(double)));
+// **Out-of-core training: one block in memory at a time, shuffled within the block**
+void train_and_send_stream(FramedSocket& socket, BlockReader& reader, VectorXs& weights) {
+    std::random_device rd;
+    std::mt19937 g(rd());
 
-            std::cout << "[DEBUG] Updated weights received from server (first 10): " 
-                      << weights.head(10).transpose() << std::endl;
-        }
+    for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
+        std::cout << "[INFO] Starting Epoch " << epoch + 1 << " (streaming "
+                  << reader.block_rows() << " rows per block)" << std::endl;
+        reader.rewind();
+        // Minibatches cross block boundaries on one prefetch thread, fed by the block reader's
+        Prefetcher<RowBatch> blocks("blocks", read_blocks(reader), 1);
+        Prefetcher<RowBatch> batches("minibatches", gather_block_batches(blocks, [&g](int rows) {
+            return shuffled_window(rows, g);
+        }, TRAIN_BATCH_SIZE));
+        train_on_batches(socket, batches, weights);
     }
-        std::vector<std::vector<float>> test_features;
-        std::vector<int> test_labels;
-        //load_data("../Datasets/santander-customer-transaction-prediction.csv", test_features, test_labels);
-        //load_data("../Datasets/SUSY.csv", test_features, test_labels);
-        load_data("../Datasets/HIGGS.csv", test_features, test_labels);
-
-        MatrixXd test_data(test_features.size(), test_features[0].size());
-        for (size_t i = 0; i < test_features.size(); ++i) {
-            for (size_t j = 0; j < test_features[i].size(); ++j) {
-                test_data(i, j) = test_features[i][j];
-            }
-        }
+    if (subscription) subscription->finish(weights);  // Wait for the model that includes every update
+}
 
-        predict_samples(test_data, weights);
-    
+// **Predicts over every row of the dataset, as the in-memory path does, one block at a time**
+void predict_stream(BlockReader& reader, const VectorXs& weights) {
+    RowBatch block;
+    size_t first_row = 0;
+    Prefetcher<RowBatch> blocks("blocks", read_blocks(reader), 1);
+    while (blocks.next(block)) {
+        predict_samples(block.features, weights, first_row);
+        first_row += block.features.rows();
+    }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        ClientOptions options = parse_client_options(argc, argv);
+        reject_unsupported(options, OPTION_STREAM | OPTION_SHARD | OPTION_WIRE | OPTION_TOP_K | OPTION_SUBSCRIBE,
+                           "Logistic Regression");
+        update_encoding = wire_encoding<Scalar>(options.wire);
+        sparsifier = TopKSparsifier(options.top_k);
         boost::asio::io_context io_context;
-        tcp::socket socket(io_context);
-        
-        std::vector<std::vector<float>> features;
-        std::vector<int> labels;
-        //load_data("../Datasets/santander-customer-transaction-prediction.csv", features, labels);
-        //load_data("../Datasets/SUSY.csv", features, labels);
-        load_data("../Datasets/HIGGS.csv", features, labels);
-
-        // **Convert std::vector<std::vector<float>> to Eigen::MatrixXd**
-        MatrixXd local_data(features.size(), features[0].size());
-        VectorXd local_labels(labels.size());
-        
-        for (size_t i = 0; i < features.size(); ++i) {
-            for (size_t j = 0; j < features[i].size(); ++j) {
-                local_data(i, j) = features[i][j];  // Convert to Eigen::MatrixXd
-            }
-            local_labels(i) = labels[i];  // Convert to Eigen::VectorXd
+        FramedSocket socket(io_context);
+        std::unique_ptr<ModelSubscription<VectorXs>> pushes;  // Ends before the socket closes
+
+        if (options.stream) {
+            VectorXs weights;
+            {
+                //BlockReader reader("../Datasets/santander-customer-transaction-prediction.csv", shard_of(santander_schema(), options), options.memory_mb << 20);
+                //BlockReader reader("../Datasets/SUSY.csv", shard_of(susy_schema(), options), options.memory_mb << 20);
+                BlockReader reader("../Datasets/HIGGS.csv", shard_of(higgs_schema(), options), options.memory_mb << 20);
+                if (!reader.is_open()) return 1;
+
+                weights = VectorXs::Zero(reader.cols());
+                socket = connect_to_server(io_context, options);
+                if (options.subscribe) pushes = std::make_unique<ModelSubscription<VectorXs>>(socket, MODEL_LOGISTIC_REGRESSION);
+                subscription = pushes.get();
+                train_and_send_stream(socket, reader, weights);
+            }  // The shard's reader is gone before the test reader takes the memory budget
+
+            //BlockReader test_reader("../Datasets/santander-customer-transaction-prediction.csv", santander_schema(), options.memory_mb << 20);
+            //BlockReader test_reader("../Datasets/SUSY.csv", susy_schema(), options.memory_mb << 20);
+            BlockReader test_reader("../Datasets/HIGGS.csv", higgs_schema(), options.memory_mb << 20);
+            if (test_reader.is_open()) predict_stream(test_reader, weights);
+            socket.close();
+            return 0;
         }
+        
+        // **Load straight into row-major RowMatrixXs / VectorXs**
+        RowMatrixXs local_data;
+        VectorXs local_labels;
+        //load_data("../Datasets/santander-customer-transaction-prediction.csv", shard_of(santander_schema(), options), local_data, local_labels);
+        //load_data("../Datasets/SUSY.csv", shard_of(susy_schema(), options), local_data, local_labels);
+        load_data("../Datasets/HIGGS.csv", shard_of(higgs_schema(), options), local_data, local_labels);
 
         // **Declare and Initialize weights**
-        VectorXd weights = VectorXd::Zero(local_data.cols());
+        VectorXs weights = VectorXs::Zero(local_data.cols());
 
         // **Connect to server**
-        socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        socket = connect_to_server(io_context, options);
+        if (options.subscribe) pushes = std::make_unique<ModelSubscription<VectorXs>>(socket, MODEL_LOGISTIC_REGRESSION);
+        subscription = pushes.get();
 
         // **Start training and sending updates**
         train_and_send_batches(socket, local_data, local_labels, weights);
@@ -1,17 +1,24 @@
 #include <iostream>
 #include <vector>
+#include <numeric>
+#include <deque>
+#include <algorithm>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
-//include "data_loader.cpp"
-//include "data_loader_susy.cpp"
-#include "data_loader_higgs.cpp"
-// g++ client_updated.cpp -o client  -I /usr/include/eigen3
+#include "../Common/datasets.cpp"
+#include "../Common/client_options.cpp"
+#include "../Common/prefetcher.cpp"
+#include "../Common/awaitable_protocol.cpp"
+// g++ -std=c++20 client.cpp -o client -I /usr/include/eigen3 -pthread
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
 const int COMPUTE_BATCH_SIZE = 100;
 
+using NaiveBayesBatch = SampleBatch<MatrixXd, VectorXd>;
+
 struct NaiveBayesBatchStats {
     std::vector<VectorXd> means;
     std::vector<VectorXd> variances;
@@ -19,7 +26,7 @@ struct NaiveBayesBatchStats {
 };
 
 // Compute class-wise statistics for a given batch
-NaiveBayesBatchStats compute_class_statistics(const MatrixXd& batch_data, const VectorXd& batch_labels, int total_samples, int num_classes) {
+NaiveBayesBatchStats compute_class_statistics(const FeaturesRef<double>& batch_data, const LabelsRef<double>& batch_labels, int total_samples, int num_classes) {
     NaiveBayesBatchStats stats;
     stats.means.resize(num_classes, VectorXd::Zero(batch_data.cols()));
     stats.variances.resize(num_classes, VectorXd::Zero(batch_data.cols()));
@@ -71,7 +78,7 @@ int predict(const VectorXd& sample, const std::vector<VectorXd>& means, const st
     return std::distance(log_probs.begin(), std::max_element(log_probs.begin(), log_probs.end()));
 }
 
-void predict_samples(const MatrixXd& test_data, const std::vector<VectorXd>& means, const std::vector<VectorXd>& variances, const std::vector<double>& priors, int num_classes) {
+void predict_samples(const FeaturesRef<double>& test_data, const std::vector<VectorXd>& means, const std::vector<VectorXd>& variances, const std::vector<double>& priors, int num_classes) {
     std::cout << "[DEBUG] Starting predictions for test data..." << std::endl;
 
     for (int i = 0; i < test_data.rows(); ++i) {
@@ -84,44 +91,65 @@ void predict_samples(const MatrixXd& test_data, const std::vector<VectorXd>& mea
     std::cout << "[DEBUG] Predictions completed." << std::endl;
 }
 
-void send_batches_and_receive_updates(tcp::socket& socket, const MatrixXd& local_data, const VectorXd& local_labels, int num_epochs, int num_classes) {
+// One row per class: prior, means, variances
+void pack_statistics(const NaiveBayesBatchStats& stats, MatrixXd& packed) {
+    int num_classes = static_cast<int>(stats.means.size());
+    int num_features = static_cast<int>(stats.means[0].size());
+    packed.resize(num_classes, 1 + 2 * num_features);
+    for (int c = 0; c < num_classes; ++c) {
+        packed(c, 0) = stats.priors[c];
+        packed.row(c).segment(1, num_features) = stats.means[c].transpose();
+        packed.row(c).segment(1 + num_features, num_features) = stats.variances[c].transpose();
+    }
+}
+
+void unpack_statistics(const MatrixXd& packed, NaiveBayesBatchStats& stats) {
+    int num_classes = static_cast<int>(packed.rows());
+    int num_features = static_cast<int>((packed.cols() - 1) / 2);
+    stats.means.resize(num_classes);
+    stats.variances.resize(num_classes);
+    stats.priors.resize(num_classes);
+    for (int c = 0; c < num_classes; ++c) {
+        stats.priors[c] = packed(c, 0);
+        stats.means[c] = packed.row(c).segment(1, num_features).transpose();
+        stats.variances[c] = packed.row(c).segment(1 + num_features, num_features).transpose();
+    }
+}
+
+void predict_test_data(const NaiveBayesBatchStats& model, int num_classes) {
+    MappedDataset<double> test_data;
+    //load_data("../Datasets/santander-customer-transaction-prediction.csv", santander_schema(), test_data);
+    //load_data("../Datasets/SUSY.csv", susy_schema(), test_data);
+    load_data("../Datasets/HIGGS.csv", higgs_schema(), test_data);
+
+    predict_samples(test_data.features(), model.means, model.variances, model.priors, num_classes);
+}
+
+void send_batches_and_receive_updates(FramedSocket& socket, const FeaturesRef<double>& local_data, const LabelsRef<double>& local_labels, int num_epochs, int num_classes) {
     //int num_classes = *std::max_element(local_labels.data(), local_labels.data() + local_labels.size()) + 1;
-    int num_batches = local_data.rows() / COMPUTE_BATCH_SIZE + (local_data.rows() % COMPUTE_BATCH_SIZE != 0);
-    std::vector<VectorXd> updated_means(num_classes);
-    std::vector<VectorXd> updated_variances(num_classes);
-    std::vector<double> updated_priors(num_classes);
+    std::vector<int> rows(local_data.rows());
+    std::iota(rows.begin(), rows.end(), 0);
+    NaiveBayesBatchStats updated;
 
     try {
         for (int epoch = 0; epoch < num_epochs; ++epoch) {
-            for (int batch_idx = 0; batch_idx < num_batches; ++batch_idx) {
-                int start_row = batch_idx * COMPUTE_BATCH_SIZE;
-                int end_row = std::min(static_cast<int>(local_data.rows()), start_row + COMPUTE_BATCH_SIZE);
-
-                MatrixXd batch_data = local_data.block(start_row, 0, end_row - start_row, local_data.cols());
-                VectorXd batch_labels = local_labels.segment(start_row, end_row - start_row);
+            // The next batch is copied out on the prefetch thread while this one is exchanged
+            Prefetcher<NaiveBayesBatch> batches("minibatches", gather_batches(local_data, local_labels, rows, COMPUTE_BATCH_SIZE));
+            NaiveBayesBatch batch;
+            while (batches.next(batch)) {
+                const MatrixXd& batch_data = batch.features;
+                const VectorXd& batch_labels = batch.labels;
 
                 NaiveBayesBatchStats batch_stats = compute_class_statistics(batch_data, batch_labels, local_data.rows(), num_classes);
-                int num_features = batch_data.cols();
                 int total_samples = local_data.rows();
 
-                boost::asio::write(socket, boost::asio::buffer(&total_samples, sizeof(int)));
-                boost::asio::write(socket, boost::asio::buffer(&num_classes, sizeof(int)));
-                boost::asio::write(socket, boost::asio::buffer(&num_features, sizeof(int)));
-
-                for (int c = 0; c < num_classes; ++c) {
-                    boost::asio::write(socket, boost::asio::buffer(&batch_stats.priors[c], sizeof(double)));
-                    boost::asio::write(socket, boost::asio::buffer(batch_stats.means[c].data(), num_features * sizeof(double)));
-                    boost::asio::write(socket, boost::asio::buffer(batch_stats.variances[c].data(), num_features * sizeof(double)));
-                }
-
-                for (int c = 0; c < num_classes; ++c) {
-                    updated_means[c].resize(num_features);
-                    updated_variances[c].resize(num_features);
+                MatrixXd packed;
+                pack_statistics(batch_stats, packed);
+                send_message(socket, MSG_UPDATE, MODEL_NAIVE_BAYES, total_samples, packed);
 
-                    boost::asio::read(socket, boost::asio::buffer(updated_means[c].data(), num_features * sizeof(double)));
-                    boost::asio::read(socket, boost::asio::buffer(updated_variances[c].data(), num_features * sizeof(double)));
-                    boost::asio::read(socket, boost::asio::buffer(&updated_priors[c], sizeof(double)));
-                }
+                // The global statistics come back in the same layout
+                receive_message(socket, MSG_MODEL, MODEL_NAIVE_BAYES, packed);
+                unpack_statistics(packed, updated);
 
                 std::cout << "[DEBUG] Updated statistics received from server." << std::endl;
                 
@@ -135,48 +163,146 @@ void send_batches_and_receive_updates(tcp::socket& socket, const MatrixXd& local
 
         socket.close();
 
-        std::vector<std::vector<float>> test_features;
-        std::vector<int> test_labels;
-        //load_data("../Datasets/santander-customer-transaction-prediction.csv", test_features, test_labels);
-        //load_data("../Datasets/SUSY.csv", test_features, test_labels);
-        load_data("../Datasets/HIGGS.csv", test_features, test_labels);
-
-        MatrixXd test_data(test_features.size(), test_features[0].size());
-        for (size_t i = 0; i < test_features.size(); ++i) {
-            for (size_t j = 0; j < test_features[i].size(); ++j) {
-                test_data(i, j) = test_features[i][j];
-            }
-        }
-
-        predict_samples(test_data, updated_means, updated_variances, updated_priors, num_classes);
+        predict_test_data(updated, num_classes);
 
     } catch (const std::exception& e) {
         std::cerr << "[ERROR] Exception during batch sending or receiving: " << e.what() << std::endl;
     }
 }
 
-int main() {
-    try {
-        std::vector<std::vector<float>> features;
-        std::vector<int> labels;
-        //load_data("../Datasets/santander-customer-transaction-prediction.csv", features, labels);
-        //load_data("../Datasets/SUSY.csv", features, labels);
-        load_data("../Datasets/HIGGS.csv", features, labels);
-        
-        MatrixXd local_data(features.size(), features[0].size());
-        VectorXd local_labels(labels.size());
-        for (size_t i = 0; i < features.size(); ++i) {
-            for (size_t j = 0; j < features[i].size(); ++j) {
-                local_data(i, j) = features[i][j];
-            }
-            local_labels(i) = labels[i];
+// A logical client hosted by this process: rows [begin, end) of the shared local data
+struct VirtualClient {
+    uint32_t id;
+    Index begin, end;
+    Index next;  // First row of its next batch
+};
+
+// An update written ahead of its reply, and the bytes that reply will take
+struct InFlight {
+    uint32_t client_id;
+    size_t reply_bytes;
+};
+
+// Reply bytes the socket buffers can hold while this end is busy writing:
+// the smaller buffer, halved, as Linux reports twice the data it keeps
+size_t reply_budget(FramedSocket& socket) {
+    boost::asio::socket_base::receive_buffer_size receive;
+    boost::asio::socket_base::send_buffer_size send;
+    socket.get_option(receive);
+    socket.get_option(send);
+    return static_cast<size_t>(std::min(receive.value(), send.value())) / 2;
+}
+
+// Reads the reply to the oldest update in flight
+awaitable<void> receive_reply(FramedSocket& socket, MessageBuffers& buffers, std::deque<InFlight>& in_flight,
+                              size_t& owed, MatrixXd& reply) {
+    MessageHeader header;
+    co_await async_receive_message(socket, buffers, MSG_MODEL, MODEL_NAIVE_BAYES, reply, &header);
+    if (header.client_id != in_flight.front().client_id)
+        throw std::runtime_error("reply for virtual client " + std::to_string(header.client_id) +
+                                 ", expected " + std::to_string(in_flight.front().client_id));
+    owed -= in_flight.front().reply_bytes;
+    in_flight.pop_front();
+}
+
+// Runs clients over one connection, one batch per client per round. Updates
+// are written ahead of their replies, which the server sends in request
+// order, as long as the replies owed fit in the socket buffers: a server
+// blocked writing a reply stops reading updates, and this end would then
+// block writing one. At least one update is always in flight.
+// While this connection waits, the others on the thread compute. Leaves the
+// last global statistics received in `latest`. The data views are copied into
+// the coroutine, which runs on after its caller's expression ends.
+awaitable<void> run_virtual_clients(FramedSocket& socket, FeaturesRef<double> local_data, LabelsRef<double> local_labels,
+                                    std::vector<VirtualClient>& clients, int num_classes, MatrixXd& latest) {
+    MessageBuffers buffers;
+    std::deque<InFlight> in_flight;
+    size_t owed = 0, budget = reply_budget(socket);
+    MatrixXd packed, reply;
+    for (bool active = true; active;) {
+        active = false;
+        for (VirtualClient& client : clients) {
+            if (client.next == client.end) continue;
+            active = true;
+            Index rows = std::min<Index>(COMPUTE_BATCH_SIZE, client.end - client.next);
+            int total_samples = static_cast<int>(client.end - client.begin);
+            pack_statistics(compute_class_statistics(local_data.middleRows(client.next, rows),
+                                                     local_labels.segment(client.next, rows), total_samples,
+                                                     num_classes),
+                            packed);
+            client.next += rows;
+
+            // The global statistics come back in the layout of the update
+            size_t reply_bytes = sizeof(MessageHeader) + packed.size() * sizeof(double);
+            while (!in_flight.empty() && owed + reply_bytes > budget)
+                co_await receive_reply(socket, buffers, in_flight, owed, reply);
+            co_await async_send_message(socket, buffers, MSG_UPDATE, MODEL_NAIVE_BAYES, total_samples, packed,
+                                        wire_dtype<double>(), 0, client.id);
+            in_flight.push_back({client.id, reply_bytes});
+            owed += reply_bytes;
         }
+    }
+    while (!in_flight.empty()) co_await receive_reply(socket, buffers, in_flight, owed, reply);
+    socket.close();
+    latest = std::move(reply);
+}
+
+// --virtual-clients N: N logical clients, each on its own 1/N of the rows, over
+// --connections C sockets, all driven from this thread
+void run_multiplexed(const ClientOptions& options, const FeaturesRef<double>& local_data, const LabelsRef<double>& local_labels,
+                     int num_classes) {
+    int n = options.virtual_clients;
+    std::vector<std::vector<VirtualClient>> per_connection(options.connections);
+    for (int v = 0; v < n; ++v) {
+        Index begin = local_data.rows() * v / n, end = local_data.rows() * (v + 1) / n;
+        per_connection[v % options.connections].push_back({static_cast<uint32_t>(v), begin, end, begin});
+    }
+    std::cout << "[INFO] Running " << n << " virtual clients over " << options.connections << " connection(s)."
+              << std::endl;
+
+    boost::asio::io_context io_context;
+    std::vector<FramedSocket> sockets;
+    for (int c = 0; c < options.connections; ++c) sockets.push_back(connect_to_server(io_context, options));
+    MatrixXd latest;  // Global statistics from the connection that finished last
+    for (int c = 0; c < options.connections; ++c) {
+        boost::asio::co_spawn(io_context,
+            run_virtual_clients(sockets[c], local_data, local_labels, per_connection[c], num_classes, latest),
+            [](std::exception_ptr error) {
+                try {
+                    rethrow_if_failed(error);
+                } catch (const std::exception& e) {
+                    std::cerr << "[ERROR] Exception in virtual client connection: " << e.what() << std::endl;
+                }
+            });
+    }
+    io_context.run();
+    if (latest.size() == 0) return;
+
+    NaiveBayesBatchStats model;
+    unpack_statistics(latest, model);
+    predict_test_data(model, num_classes);
+}
 
-        int num_classes = *std::max_element(labels.begin(), labels.end()) + 1;
+int main(int argc, char* argv[]) {
+    try {
+        ClientOptions options = parse_client_options(argc, argv);
+        reject_unsupported(options, OPTION_SHARD | OPTION_VIRTUAL_CLIENTS, "Naive Bayes");
+        MappedDataset<double> dataset;  // The cache itself when it holds doubles (convert_dataset --float64)
+        //load_data("../Datasets/santander-customer-transaction-prediction.csv", shard_of(santander_schema(), options), dataset);
+        //load_data("../Datasets/SUSY.csv", shard_of(susy_schema(), options), dataset);
+        load_data("../Datasets/HIGGS.csv", shard_of(higgs_schema(), options), dataset);
+        auto local_data = dataset.features();
+        auto local_labels = dataset.labels();
+
+        int num_classes = static_cast<int>(local_labels.maxCoeff()) + 1;
+
+        if (options.virtual_clients > 1) {
+            run_multiplexed(options, local_data, local_labels, num_classes);
+            return 0;
+        }
 
         boost::asio::io_context io_context;
-        tcp::socket socket(io_context);
-        socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        FramedSocket socket = connect_to_server(io_context, options);
 
         send_batches_and_receive_updates(socket, local_data, local_labels, 1, num_classes);
 
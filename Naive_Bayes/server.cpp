@@ -1,12 +1,17 @@
 #include <iostream>
 #include <vector>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
 #include <mutex>
+#include "../Common/async_server.cpp"
+// g++ -std=c++20 server.cpp -o server -I /usr/include/eigen3 -pthread
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
+const uint64_t MAX_UPDATE_ELEMENTS = WIRE_MAX_PAYLOAD_BYTES;  // Any size the wire carries, as before (--max-elements)
+
 // Global variables for aggregated statistics
 std::vector<VectorXd> global_means;
 std::vector<VectorXd> global_variances;
@@ -14,7 +19,10 @@ std::vector<double> global_priors;
 std::vector<int> global_sample_counts;
 std::mutex model_mutex;
 
-void aggregate_statistics(int class_index, const VectorXd& batch_means, const VectorXd& batch_variances, int batch_size) {
+// batch_means and batch_variances may be views into the receive buffer; nothing is copied
+template <typename MeansExpr, typename VariancesExpr>
+void aggregate_statistics(int class_index, const MatrixBase<MeansExpr>& batch_means,
+                          const MatrixBase<VariancesExpr>& batch_variances, int batch_size) {
     std::lock_guard<std::mutex> lock(model_mutex);
 
     if (global_sample_counts[class_index] == 0) {
@@ -25,101 +33,72 @@ void aggregate_statistics(int class_index, const VectorXd& batch_means, const Ve
     } else {
         int total_samples = global_sample_counts[class_index] + batch_size;
 
-        // Update means
-        VectorXd delta_means = batch_means - global_means[class_index];
-        global_means[class_index] += (batch_size * delta_means.array()).matrix() / total_samples;
+        // Both updates use the old means, so variances go first
+        auto delta_means = (batch_means - global_means[class_index]).array();
 
         // Update variances
-        VectorXd combined_variances = (((global_sample_counts[class_index] - 1) * global_variances[class_index].array() +
-                                        (batch_size - 1) * batch_variances.array() +
-                                        (global_sample_counts[class_index] * batch_size * delta_means.array().square()) /
-                                            total_samples) /
-                                       (total_samples - 1))
-                                          .matrix();
-        global_variances[class_index] = combined_variances;
+        global_variances[class_index] = (((global_sample_counts[class_index] - 1) * global_variances[class_index].array() +
+                                          (batch_size - 1) * batch_variances.array() +
+                                          (global_sample_counts[class_index] * batch_size * delta_means.square()) /
+                                              total_samples) /
+                                         (total_samples - 1))
+                                            .matrix();
+
+        // Update means
+        global_means[class_index] += (batch_size * delta_means).matrix() / total_samples;
         global_sample_counts[class_index] = total_samples;
         global_priors[class_index] = static_cast<double>(total_samples);
     }
 }
 
-void process_batches(tcp::socket& socket) {
-    try {
-        while (socket.is_open()) {
-            int total_samples;
-            int num_classes;
-            int num_features;
-
-            // Read batch-specific metadata for each batch
-            boost::asio::read(socket, boost::asio::buffer(&total_samples, sizeof(int)));
-            boost::asio::read(socket, boost::asio::buffer(&num_classes, sizeof(int)));
-            boost::asio::read(socket, boost::asio::buffer(&num_features, sizeof(int)));
-            std::cout << "[DEBUG] Total samples in dataset: " << total_samples << std::endl;
-            std::cout<<"Number of features "<<num_features<<std::endl;
-
-            if (global_means.empty()) {
-                // Initialize global structures
-                global_means.resize(num_classes, VectorXd::Zero(num_features));
-                global_variances.resize(num_classes, VectorXd::Ones(num_features));
-                global_priors.resize(num_classes, 0.0);
-                global_sample_counts.resize(num_classes, 0);
-            }
-
-            for (int c = 0; c < num_classes; ++c) {
-                double prior;
-                VectorXd mean(num_features);
-                VectorXd variance(num_features);
-
-                // Read class-specific statistics
-                boost::asio::read(socket, boost::asio::buffer(&prior, sizeof(double)));
-                boost::asio::read(socket, boost::asio::buffer(mean.data(), num_features * sizeof(double)));
-                boost::asio::read(socket, boost::asio::buffer(variance.data(), num_features * sizeof(double)));
-
-                // Update global statistics
-                aggregate_statistics(c, mean, variance, static_cast<int>(prior * total_samples));
-                
-            }
-
-            for (int c = 0; c < num_classes; ++c) {
-                // Send updated global statistics back to the client
-                boost::asio::write(socket, boost::asio::buffer(global_means[c].data(), num_features * sizeof(double)));
-                boost::asio::write(socket, boost::asio::buffer(global_variances[c].data(), num_features * sizeof(double)));
-                boost::asio::write(socket, boost::asio::buffer(&global_priors[c], sizeof(double)));
-            }
-
-            std::cout << "[DEBUG] Processed batch for Class 0 and Class 1." << std::endl;
-
-            
+// Merges one batch of per-class statistics; the reply is the global
+// statistics in the same layout (one row per class: prior, means, variances)
+int handle_update(const MessageHeader& header, MatrixXd& packed, ModelStamp& stamp) {
+    int total_samples = header.count;
+    int num_classes = static_cast<int>(packed.rows());
+    int num_features = static_cast<int>((packed.cols() - 1) / 2);
+    std::cout << "[DEBUG] Total samples in dataset: " << total_samples << std::endl;
+    std::cout<<"Number of features "<<num_features<<std::endl;
+
+    {
+        // Initialize global structures
+        std::lock_guard<std::mutex> lock(model_mutex);
+        if (global_means.empty()) {
+            global_means.resize(num_classes, VectorXd::Zero(num_features));
+            global_variances.resize(num_classes, VectorXd::Ones(num_features));
+            global_priors.resize(num_classes, 0.0);
+            global_sample_counts.resize(num_classes, 0);
         }
-    } catch (const std::exception& e) {
-        std::cerr << "[ERROR] Exception during batch processing: " << e.what() << std::endl;
     }
-}
 
+    for (int c = 0; c < num_classes; ++c) {
+        double prior = packed(c, 0);
 
-void handle_client(tcp::socket socket) {
-    process_batches(socket);
-}
-
-int main() {
-    try {
-        boost::asio::io_context io_context;
-        tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 8080));
-
-        std::cout << "[DEBUG] Server started. Waiting for clients..." << std::endl;
+        // Update global statistics straight from the received rows
+        aggregate_statistics(c, packed.row(c).segment(1, num_features).transpose(),
+                             packed.row(c).segment(1 + num_features, num_features).transpose(),
+                             static_cast<int>(prior * total_samples));
+    }
 
-        while (true) {
-            tcp::socket socket(io_context);
-            acceptor.accept(socket);
+    std::lock_guard<std::mutex> lock(model_mutex);
+    for (int c = 0; c < num_classes; ++c) {
+        packed(c, 0) = global_priors[c];
+        packed.row(c).segment(1, num_features) = global_means[c].transpose();
+        packed.row(c).segment(1 + num_features, num_features) = global_variances[c].transpose();
+    }
+    stamp.stamp();
 
-            std::cout << "[DEBUG] Client connected." << std::endl;
+    std::cout << "[DEBUG] Processed batch for Class 0 and Class 1." << std::endl;
+    return 0;
+}
 
-            // Use std::move to transfer ownership of the socket
-            std::thread(handle_client, std::move(socket)).detach();
-        }
+int main(int argc, char* argv[]) {
+    try {
+        ServerOptions options = parse_server_options(argc, argv, MAX_UPDATE_ELEMENTS);
+        run_framed_server<MatrixXd>(options, MODEL_NAIVE_BAYES, handle_update);
     } catch (const std::exception& e) {
         std::cerr << "[ERROR] Exception in server: " << e.what() << std::endl;
     }
 
     return 0;
 }
-
@@ -2,10 +2,13 @@
 #include <iostream>
 #include <vector>
 #include <random>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
-#include "data_loader.cpp"
-// g++ client_updated.cpp -o client  -I /usr/include/eigen3
+#include "../Common/datasets.cpp"
+#include "../Common/client_options.cpp"
+#include "../Common/wire_protocol.cpp"
+// g++ -std=c++17 client.cpp -o client -I /usr/include/eigen3 -pthread
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
@@ -13,13 +16,9 @@ using boost::asio::ip::tcp;
 const int NUM_EPOCHS = 5;
 const int TREES_PER_EPOCH = 2;
 
-struct DecisionTree {
-    int feature_index;
-    float threshold;
-    int class_label; // simple leaf label
-};
+using DecisionTree = TreeRecord;  // Trained straight into the wire layout
 
-std::vector<DecisionTree> train_trees(const MatrixXd& data, const VectorXd& labels, int num_trees) {
+std::vector<DecisionTree> train_trees(const FeaturesRef<double>& data, const LabelsRef<double>& labels, int num_trees) {
     std::vector<DecisionTree> forest;
     std::random_device rd;
     std::mt19937 gen(rd());
@@ -58,64 +57,30 @@ std::vector<DecisionTree> train_trees(const MatrixXd& data, const VectorXd& labe
         for (int i : samples) if (labels(i) == 1) count_1++;
         majority_class = (count_1 > samples.size() / 2) ? 1 : 0;
 
-        forest.push_back({best_feature, best_threshold, majority_class});
+        forest.push_back({best_feature, best_threshold, static_cast<uint8_t>(majority_class)});
     }
     return forest;
 }
 
-std::vector<double> serialize_trees(const std::vector<DecisionTree>& trees) {
-    std::vector<double> serialized;
-    for (const auto& tree : trees) {
-        serialized.push_back(tree.feature_index);
-        serialized.push_back(tree.threshold);
-        serialized.push_back(tree.class_label);
-    }
-    return serialized;
-}
-
-std::vector<DecisionTree> deserialize_trees(const std::vector<double>& serialized) {
-    std::vector<DecisionTree> trees;
-    for (size_t i = 0; i + 2 < serialized.size(); i += 3) {
-        trees.push_back({static_cast<int>(serialized[i]), static_cast<float>(serialized[i + 1]), static_cast<int>(serialized[i + 2])});
-    }
-    return trees;
-}
-
-int main() {
+int main(int argc, char* argv[]) {
     try {
-        std::vector<std::vector<float>> features;
-        std::vector<int> labels;
-        load_data("../Datasets/santander-customer-transaction-prediction.csv", features, labels);
-
-        MatrixXd data(features.size(), features[0].size());
-        VectorXd label_vec(labels.size());
-        for (size_t i = 0; i < features.size(); ++i) {
-            for (size_t j = 0; j < features[i].size(); ++j)
-                data(i, j) = features[i][j];
-            label_vec(i) = labels[i];
-        }
+        ClientOptions options = parse_client_options(argc, argv);
+        reject_unsupported(options, OPTION_SHARD, "RF");
+        MappedDataset<double> dataset;  // The cache itself when it holds doubles (convert_dataset --float64)
+        load_data("../Datasets/santander-customer-transaction-prediction.csv", shard_of(santander_schema(), options), dataset);
 
         boost::asio::io_context io_context;
-        tcp::socket socket(io_context);
-        socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        FramedSocket socket = connect_to_server(io_context, options);
 
         for (int epoch = 0; epoch < NUM_EPOCHS; ++epoch) {
-            std::vector<DecisionTree> trees = train_trees(data, label_vec, TREES_PER_EPOCH);
-            std::vector<double> serialized = serialize_trees(trees);
+            std::vector<DecisionTree> trees = train_trees(dataset.features(), dataset.labels(), TREES_PER_EPOCH);
 
             int num_trees = trees.size();
-            int vec_size = serialized.size();
-
-            boost::asio::write(socket, boost::asio::buffer(&num_trees, sizeof(int)));
-            boost::asio::write(socket, boost::asio::buffer(&vec_size, sizeof(int)));
-            boost::asio::write(socket, boost::asio::buffer(serialized.data(), vec_size * sizeof(double)));
+            send_message(socket, MSG_UPDATE, MODEL_RANDOM_FOREST, num_trees, trees);
 
-            int global_vec_size;
-            boost::asio::read(socket, boost::asio::buffer(&global_vec_size, sizeof(int)));
-            std::vector<double> global_serialized(global_vec_size);
-            boost::asio::read(socket, boost::asio::buffer(global_serialized.data(), global_vec_size * sizeof(double)));
+            std::vector<DecisionTree> global_forest;
+            receive_message(socket, MSG_MODEL, MODEL_RANDOM_FOREST, global_forest);
 
-            std::vector<DecisionTree> global_forest = deserialize_trees(global_serialized);
             std::cout << "[INFO] Epoch " << epoch + 1 << ": Global forest size = " << global_forest.size() << std::endl;
         }
 
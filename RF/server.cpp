@@ -1,92 +1,41 @@
 // Federated Random Forest Server (Batch-wise Epoch-based Aggregation)
 #include <iostream>
 #include <vector>
-#include <thread>
+#include <utility>
 #include <boost/asio.hpp>
 #include <mutex>
+#include <stdexcept>
+#include <Eigen/Dense>
+#include "../Common/async_server.cpp"
+// g++ -std=c++20 server.cpp -o server -I /usr/include/eigen3 -pthread
 
 using boost::asio::ip::tcp;
 
-struct DecisionTree {
-    int feature_index;
-    float threshold;
-    int class_label;
-};
+using DecisionTree = TreeRecord;  // Trees arrive and leave in the wire layout
+
+const uint64_t MAX_UPDATE_ELEMENTS = WIRE_MAX_PAYLOAD_BYTES;  // Any size the wire carries, as before (--max-elements)
 
 std::mutex forest_mutex;
 std::vector<DecisionTree> global_forest;
 
-std::vector<DecisionTree> deserialize_trees(const std::vector<double>& serialized, int count) {
-    std::vector<DecisionTree> trees;
-    for (int i = 0; i < count; ++i) {
-        trees.push_back({static_cast<int>(serialized[i * 3]),
-                         static_cast<float>(serialized[i * 3 + 1]),
-                         static_cast<int>(serialized[i * 3 + 2])});
-    }
-    return trees;
-}
-
-std::vector<double> serialize_trees(const std::vector<DecisionTree>& trees) {
-    std::vector<double> serialized;
-    for (const auto& tree : trees) {
-        serialized.push_back(tree.feature_index);
-        serialized.push_back(tree.threshold);
-        serialized.push_back(tree.class_label);
-    }
-    return serialized;
-}
-
-void handle_client(tcp::socket socket) {
-    try {
-        std::cout << "[INFO] New client connected.\n";
-
-        while (true) {
-            int num_trees = 0, vec_size = 0;
-            boost::system::error_code ec;
-            boost::asio::read(socket, boost::asio::buffer(&num_trees, sizeof(int)), ec);
-            if (ec) break; // Client closed connection
-
-            boost::asio::read(socket, boost::asio::buffer(&vec_size, sizeof(int)));
-            std::vector<double> serialized(vec_size);
-            boost::asio::read(socket, boost::asio::buffer(serialized.data(), vec_size * sizeof(double)));
-
-            std::vector<DecisionTree> trees = deserialize_trees(serialized, num_trees);
-            {
-                std::lock_guard<std::mutex> lock(forest_mutex);
-                global_forest.insert(global_forest.end(), trees.begin(), trees.end());
-            }
-
-            std::vector<double> global_serialized;
-            {
-                std::lock_guard<std::mutex> lock(forest_mutex);
-                global_serialized = serialize_trees(global_forest);
-            }
-
-            int global_vec_size = global_serialized.size();
-            boost::asio::write(socket, boost::asio::buffer(&global_vec_size, sizeof(int)));
-            boost::asio::write(socket, boost::asio::buffer(global_serialized.data(), global_vec_size * sizeof(double)));
-        }
-
-        std::cout << "[INFO] Client disconnected.\n";
-
-    } catch (const std::exception& e) {
-        std::cerr << "[ERROR] Exception in server handler: " << e.what() << std::endl;
-    }
+// Adds the client's trees to the global forest; the reply is the whole forest,
+// copied over the receive buffer
+int handle_update(const MessageHeader& header, std::vector<DecisionTree>& payload, ModelStamp& stamp) {
+    if (header.count < 0 || static_cast<size_t>(header.count) != payload.size())
+        throw std::runtime_error("tree count " + std::to_string(header.count) + " does not match the payload");
+    std::lock_guard<std::mutex> lock(forest_mutex);
+    global_forest.insert(global_forest.end(), payload.begin(), payload.end());
+    payload = global_forest;
+    stamp.stamp();
+    return global_forest.size();
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
-        boost::asio::io_context io_context;
-        tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 8080));
-        std::cout << "[INFO] Federated RF Server running on port 8080...\n";
-
-        while (true) {
-            tcp::socket socket(io_context);
-            acceptor.accept(socket);
-            std::thread(handle_client, std::move(socket)).detach();
-        }
+        ServerOptions options = parse_server_options(argc, argv, MAX_UPDATE_ELEMENTS);
+        run_framed_server<std::vector<DecisionTree>>(options, MODEL_RANDOM_FOREST, handle_update);
     } catch (const std::exception& e) {
-        std::cerr << "[ERROR] Exception in main: " << e.what() << std::endl;
+        std::cerr << "[ERROR] Exception in server: " << e.what() << std::endl;
     }
     return 0;
 }
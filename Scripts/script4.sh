@@ -30,12 +30,18 @@ $AMD profile --detail  --show-all-cachelines --config "$config" --duration 20 --
 # Define the application you want to run
 APP="../Naive_Bayes/client"  # Replace with your application name/path
 
-# Loop to run the application 10 times
-for i in {1..20}
-do  
-    #echo "Running iteration $i..."
-    $APP & # Execute the application
-done
+# VIRTUAL_CLIENTS=1 ./script4.sh runs the 20 clients as logical clients of one
+# process over one connection instead; each then trains on 1/20 of the rows
+if [ -n "$VIRTUAL_CLIENTS" ]; then
+    $APP --virtual-clients 20 &
+else
+    # Loop to run the application 10 times
+    for i in {1..20}
+    do  
+        #echo "Running iteration $i..."
+        $APP & # Execute the application
+    done
+fi
 
 
 